@@ -0,0 +1,91 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include <Windows.h>
+
+#undef near
+#undef far
+
+#else
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#endif
+
+rainbow::core::mapped_file::mapped_file(const std::string& name)
+{
+#ifdef _WIN32
+	const auto file = CreateFileA(name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, 
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE) return;
+
+	LARGE_INTEGER size;
+
+	// the empty file can not be mapped
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) { CloseHandle(file); return; }
+
+	const auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	if (mapping == nullptr) { CloseHandle(file); return; }
+
+	const auto data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (data == nullptr) { CloseHandle(mapping); CloseHandle(file); return; }
+
+	mFile = file;
+	mMapping = mapping;
+	mData = static_cast<const uint8*>(data);
+	mSize = static_cast<size_t>(size.QuadPart);
+#else
+	const auto file = open(name.c_str(), O_RDONLY);
+
+	if (file < 0) return;
+
+	struct stat info;
+
+	// the empty file can not be mapped
+	if (fstat(file, &info) != 0 || info.st_size == 0) { close(file); return; }
+
+	const auto data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+
+	// the mapping is still valid after we close the file
+	close(file);
+
+	if (data == MAP_FAILED) return;
+
+	mData = static_cast<const uint8*>(data);
+	mSize = static_cast<size_t>(info.st_size);
+#endif
+}
+
+rainbow::core::mapped_file::~mapped_file()
+{
+	if (mData == nullptr) return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(mData);
+	CloseHandle(mMapping);
+	CloseHandle(mFile);
+#else
+	munmap(const_cast<uint8*>(mData), mSize);
+#endif
+}
+
+const rainbow::core::uint8* rainbow::core::mapped_file::data() const noexcept
+{
+	return mData;
+}
+
+size_t rainbow::core::mapped_file::size() const noexcept
+{
+	return mSize;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "utilities.hpp"
+
+#include <string>
+
+namespace rainbow::core {
+
+	/*
+	 * mapped_file maps a file into memory with read-only access.
+	 * if the file does not exist or can not be mapped, data() is nullptr and size() is 0.
+	 * the memory is unmapped when the mapped_file is destroyed.
+	 */
+	class mapped_file final {
+	public:
+		explicit mapped_file(const std::string& name);
+
+		mapped_file(const mapped_file&) = delete;
+
+		~mapped_file();
+
+		mapped_file& operator=(const mapped_file&) = delete;
+
+		const uint8* data() const noexcept;
+
+		size_t size() const noexcept;
+	private:
+		const uint8* mData = nullptr;
+
+		size_t mSize = 0;
+
+#ifdef _WIN32
+		void* mFile = nullptr;
+		void* mMapping = nullptr;
+#endif
+	};
+	
+}
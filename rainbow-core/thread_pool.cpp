@@ -0,0 +1,296 @@
+#include "thread_pool.hpp"
+
+#ifdef _WIN32
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include <Windows.h>
+
+#undef near
+#undef far
+
+#elif defined(__linux__)
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include <pthread.h>
+#include <sched.h>
+
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+
+namespace rainbow::core {
+
+	struct processor_info {
+		size_t processor = 0;
+		size_t node = 0;
+	};
+
+	static thread_local size_t current_worker_index = 0;
+
+	static std::unique_ptr<thread_pool> default_thread_pool;
+	static std::mutex default_thread_pool_mutex;
+
+#ifdef __linux__
+	// the list of processors is in the format like "0-15,32-47"
+	inline std::vector<size_t> parse_processor_list(const std::string& list)
+	{
+		std::vector<size_t> processors;
+		std::stringstream stream(list);
+		std::string range;
+
+		while (std::getline(stream, range, ',')) {
+			if (range.empty() || range == "\n") continue;
+
+			const auto dash = range.find('-');
+			const auto first = std::stoul(range.substr(0, dash));
+			const auto last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+
+			for (auto processor = first; processor <= last; processor++) processors.push_back(processor);
+		}
+
+		return processors;
+	}
+#endif
+
+	// the processors the process is allowed to run on, ordered by their numa nodes
+	inline std::vector<processor_info> available_processors()
+	{
+		std::vector<processor_info> processors;
+
+#ifdef _WIN32
+		DWORD_PTR process_mask = 0;
+		DWORD_PTR system_mask = 0;
+
+		if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask)) {
+			for (size_t index = 0; index < sizeof(DWORD_PTR) * 8; index++) {
+				if ((process_mask & (static_cast<DWORD_PTR>(1) << index)) == 0) continue;
+
+				UCHAR node = 0;
+
+				if (!GetNumaProcessorNode(static_cast<UCHAR>(index), &node) || node == 0xff) node = 0;
+
+				processors.push_back({ index, node });
+			}
+		}
+#elif defined(__linux__)
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+
+		if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+			for (size_t index = 0; index < CPU_SETSIZE; index++)
+				if (CPU_ISSET(index, &set)) processors.push_back({ index, 0 });
+		}
+
+		std::error_code error;
+
+		// the processors of node i are listed in /sys/devices/system/node/node{i}/cpulist
+		for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", error)) {
+			const auto name = entry.path().filename().string();
+
+			if (name.size() <= 4 || name.compare(0, 4, "node") != 0 ||
+				!std::all_of(name.begin() + 4, name.end(), [](char c) { return c >= '0' && c <= '9'; }))
+				continue;
+
+			std::ifstream file(entry.path() / "cpulist");
+			std::string list;
+
+			if (!std::getline(file, list)) continue;
+
+			const auto node = static_cast<size_t>(std::stoul(name.substr(4)));
+
+			for (const auto processor : parse_processor_list(list)) {
+				for (auto& info : processors) if (info.processor == processor) info.node = node;
+			}
+		}
+#endif
+
+		if (processors.empty()) {
+			for (size_t index = 0; index < std::max(std::thread::hardware_concurrency(), 1u); index++)
+				processors.push_back({ index, 0 });
+		}
+
+		std::stable_sort(processors.begin(), processors.end(), [](const processor_info& lhs, const processor_info& rhs)
+			{
+				return lhs.node < rhs.node;
+			});
+
+		return processors;
+	}
+
+	inline void pin_thread(std::thread& thread, size_t processor)
+	{
+#ifdef _WIN32
+		SetThreadAffinityMask(thread.native_handle(), static_cast<DWORD_PTR>(1) << processor);
+#elif defined(__linux__)
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(processor, &set);
+
+		pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#endif
+	}
+
+}
+
+rainbow::core::thread_pool::thread_pool(size_t workers, bool pin_workers)
+{
+	const auto processors = available_processors();
+
+	if (workers == 0) workers = processors.size();
+
+	for (size_t worker = 0; worker < workers; worker++) {
+		const auto& info = processors[worker % processors.size()];
+
+		mProcessors.push_back(info.processor);
+		mNodes.push_back(info.node);
+
+		mNumaNodes = std::max(mNumaNodes, info.node + 1);
+	}
+
+	// the worker 0 is the thread that uses the pool, we do not pin it
+	for (size_t worker = 1; worker < workers; worker++) {
+		mThreads.push_back(std::thread(&thread_pool::work, this, worker));
+
+		if (pin_workers) pin_thread(mThreads.back(), mProcessors[worker]);
+	}
+}
+
+rainbow::core::thread_pool::~thread_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		mStop = true;
+	}
+
+	mCondition.notify_all();
+
+	for (auto& thread : mThreads) thread.join();
+}
+
+void rainbow::core::thread_pool::parallel_for(size_t count, size_t grain,
+	const std::function<void(size_t begin, size_t end)>& function)
+{
+	if (count == 0) return;
+
+	grain = std::max(grain, static_cast<size_t>(1));
+
+	const auto chunks = (count + grain - 1) / grain;
+
+	std::atomic<size_t> next_chunk = 0;
+
+	const auto work = [&]()
+	{
+		for (auto chunk = next_chunk++; chunk < chunks; chunk = next_chunk++)
+			function(chunk * grain, std::min(chunk * grain + grain, count));
+	};
+
+	std::vector<std::future<void>> futures;
+
+	for (size_t worker = 1; worker < std::min(workers(), chunks); worker++)
+		futures.push_back(submit(work));
+
+	work();
+
+	for (auto& future : futures) wait(future);
+}
+
+size_t rainbow::core::thread_pool::workers() const noexcept
+{
+	return mNodes.size();
+}
+
+size_t rainbow::core::thread_pool::numa_nodes() const noexcept
+{
+	return mNumaNodes;
+}
+
+size_t rainbow::core::thread_pool::numa_node(size_t worker) const noexcept
+{
+	return mNodes[worker % mNodes.size()];
+}
+
+size_t rainbow::core::thread_pool::current_worker() noexcept
+{
+	return current_worker_index;
+}
+
+rainbow::core::thread_pool& rainbow::core::thread_pool::instance()
+{
+	std::lock_guard<std::mutex> lock(default_thread_pool_mutex);
+
+	if (default_thread_pool == nullptr) default_thread_pool = std::make_unique<thread_pool>();
+
+	return *default_thread_pool;
+}
+
+void rainbow::core::thread_pool::configure(size_t workers, bool pin_workers)
+{
+	std::lock_guard<std::mutex> lock(default_thread_pool_mutex);
+
+	default_thread_pool = nullptr;
+	default_thread_pool = std::make_unique<thread_pool>(workers, pin_workers);
+}
+
+void rainbow::core::thread_pool::push(std::function<void()>&& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		mTasks.push_back(std::move(task));
+	}
+
+	mCondition.notify_one();
+}
+
+bool rainbow::core::thread_pool::run_pending_task()
+{
+	std::function<void()> task;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		if (mTasks.empty()) return false;
+
+		task = std::move(mTasks.front());
+
+		mTasks.pop_front();
+	}
+
+	task();
+
+	return true;
+}
+
+void rainbow::core::thread_pool::work(size_t worker)
+{
+	current_worker_index = worker;
+
+	while (true) {
+		std::function<void()> task;
+
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+
+			mCondition.wait(lock, [&]() { return mStop || !mTasks.empty(); });
+
+			if (mStop && mTasks.empty()) return;
+
+			task = std::move(mTasks.front());
+
+			mTasks.pop_front();
+		}
+
+		task();
+	}
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "utilities.hpp"
+
+#include <condition_variable>
+#include <type_traits>
+#include <functional>
+#include <future>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <mutex>
+
+namespace rainbow::core {
+
+	/*
+	 * thread_pool runs the parallel work of renderer(the integrators and the building of hierarchies) on a fixed group of threads.
+	 * workers is the number of threads that do the work, the thread that calls parallel_for or wait also works,
+	 * so the pool only creates workers - 1 threads. if workers is 0, we use all processors the process is allowed to run on.
+	 * the workers are ordered by the numa nodes of their processors, the workers of node 0 first and then the next node,
+	 * so a small pool stays on one node and the nearby workers(the workers that steal from each other first) share a node.
+	 * if pin_workers is true, the threads created by the pool are pinned to their processors,
+	 * so the memory they allocate and touch first(film tiles, allocators of hierarchy) stays on their node.
+	 * the tasks can submit and wait other tasks, the thread waiting a task runs the pending tasks instead of blocking.
+	 */
+	class thread_pool final {
+	public:
+		explicit thread_pool(size_t workers = 0, bool pin_workers = false);
+
+		thread_pool(const thread_pool&) = delete;
+
+		~thread_pool();
+
+		thread_pool& operator=(const thread_pool&) = delete;
+
+		// split [0, count) into the chunks of grain elements, the workers take the chunks one by one
+		void parallel_for(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& function);
+
+		// run the function for each element in [first, last), a worker takes grain elements at once
+		template <typename Iterator, typename Function>
+		void for_each(Iterator first, Iterator last, size_t grain, const Function& function);
+
+		template <typename Function>
+		auto submit(Function&& function) -> std::future<std::invoke_result_t<Function>>;
+
+		template <typename T>
+		T wait(std::future<T>& future);
+
+		size_t workers() const noexcept;
+
+		size_t numa_nodes() const noexcept;
+
+		size_t numa_node(size_t worker) const noexcept;
+
+		// the index of worker of current thread, the threads not created by pool are 0
+		static size_t current_worker() noexcept;
+
+		static thread_pool& instance();
+
+		// replace the pool used by renderer, it should not be called when the pool is running
+		static void configure(size_t workers, bool pin_workers = false);
+	private:
+		void push(std::function<void()>&& task);
+
+		bool run_pending_task();
+
+		void work(size_t worker);
+	private:
+		std::vector<std::thread> mThreads;
+
+		std::vector<size_t> mProcessors;
+		std::vector<size_t> mNodes;
+
+		std::deque<std::function<void()>> mTasks;
+
+		std::condition_variable mCondition;
+		std::mutex mMutex;
+
+		size_t mNumaNodes = 1;
+
+		bool mStop = false;
+	};
+
+	template <typename Iterator, typename Function>
+	void thread_pool::for_each(Iterator first, Iterator last, size_t grain, const Function& function)
+	{
+		parallel_for(static_cast<size_t>(last - first), grain, [&](size_t begin, size_t end)
+			{
+				for (auto index = begin; index < end; index++) function(first[index]);
+			});
+	}
+
+	template <typename Function>
+	auto thread_pool::submit(Function&& function) -> std::future<std::invoke_result_t<Function>>
+	{
+		using result_type = std::invoke_result_t<Function>;
+
+		const auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<Function>(function));
+
+		auto future = task->get_future();
+
+		push([task]() { (*task)(); });
+
+		return future;
+	}
+
+	template <typename T>
+	T thread_pool::wait(std::future<T>& future)
+	{
+		// the task we wait may be in the queue and all workers may be waiting too, so we run the pending tasks
+		while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			if (!run_pending_task()) future.wait_for(std::chrono::microseconds(100));
+		}
+
+		return future.get();
+	}
+
+}
@@ -2,8 +2,11 @@
 
 namespace rainbow::core {
 
+	using int8 = signed char;
 	using int32 = int;
 	
+	using uint8 = unsigned char;
+	using uint16 = unsigned short;
 	using uint32 = unsigned;
 	using uint64 = unsigned long long;
 
@@ -4,6 +4,8 @@
 #include "../../rainbow-core/file_system.hpp"
 #include "../../rainbow-core/logs/log.hpp"
 
+#include <algorithm>
+
 using namespace rainbow::cpus::shared::spectrums;
 
 rainbow::cpus::cameras::pixel::pixel() : pixel(shared::spectrums::spectrum(0), 0)
@@ -30,7 +32,40 @@ rainbow::cpus::cameras::pixel::pixel(const shared::spectrums::spectrum& spectrum
 	
 }
 
-rainbow::cpus::cameras::film_tile::film_tile(const bound2i& sample_region, const std::shared_ptr<film>& film) :
+void rainbow::cpus::cameras::pixel_variance::add_sample(real value) noexcept
+{
+	const auto delta = value - mean;
+
+	count = count + 1;
+	mean = mean + delta / count;
+	m2 = m2 + delta * (value - mean);
+}
+
+void rainbow::cpus::cameras::pixel_variance::merge(const pixel_variance& other) noexcept
+{
+	if (other.count == 0) return;
+
+	const auto delta = other.mean - mean;
+	const auto total = static_cast<real>(count) + other.count;
+
+	mean = mean + delta * other.count / total;
+	m2 = m2 + other.m2 + delta * delta * (static_cast<real>(count) * other.count / total);
+	count = count + other.count;
+}
+
+rainbow::core::real rainbow::cpus::cameras::pixel_variance::variance() const noexcept
+{
+	return count < 2 ? 0 : m2 / (count - 1);
+}
+
+rainbow::core::real rainbow::cpus::cameras::pixel_variance::relative_error() const noexcept
+{
+	if (count < 2) return 0;
+
+	return math::sqrt(variance() / count) / (math::abs(mean) + static_cast<real>(1e-2));
+}
+
+rainbow::cpus::cameras::film_tile::film_tile(const bound2i& sample_region, const std::shared_ptr<film>& film, bool record_variance) :
 	sample_region(sample_region), filter(film->filter())
 {
 	const auto pixel_bound = film->pixels_bound();
@@ -52,6 +87,12 @@ rainbow::cpus::cameras::film_tile::film_tile(const bound2i& sample_region, const
 	pixels = std::vector<pixel>(
 		(static_cast<size_t>(filter_region.max.x) - filter_region.min.x) * 
 		(static_cast<size_t>(filter_region.max.y) - filter_region.min.y));
+
+	if (!record_variance) return;
+
+	variances = std::vector<pixel_variance>(
+		(static_cast<size_t>(sample_region.max.x) - sample_region.min.x) *
+		(static_cast<size_t>(sample_region.max.y) - sample_region.min.y));
 }
 
 void rainbow::cpus::cameras::film_tile::add_sample(const vector2& position, const spectrum& sample) noexcept
@@ -89,6 +130,20 @@ void rainbow::cpus::cameras::film_tile::add_sample(const vector2& position, cons
 			pixels[pixel_index].add_sample(sample * filter_value, filter_value);
 		}
 	}
+
+	if (variances.empty()) return;
+
+	// the variance is recorded by the pixel the sample is in, the filter does not spread it
+	const auto pixel_position = static_cast<vector2i>(floor(position));
+
+	if (pixel_position.x < sample_region.min.x || pixel_position.x >= sample_region.max.x) return;
+	if (pixel_position.y < sample_region.min.y || pixel_position.y >= sample_region.max.y) return;
+
+	const auto variance_index =
+		(pixel_position.y - sample_region.min.y) * (sample_region.max.x - sample_region.min.x) +
+		(pixel_position.x - sample_region.min.x);
+
+	variances[variance_index].add_sample(sample.luminance());
 }
 
 rainbow::cpus::cameras::film::film(
@@ -220,6 +275,47 @@ void rainbow::cpus::cameras::film::add_tile(const film_tile& tile)
 			mPixels[pixel_index(vector2i(x, y))].add_sample(tile_pixel.spectrum_sum, tile_pixel.filter_weight);
 		}
 	}
+
+	if (tile.variances.empty()) return;
+
+	// most renders do not record the variances, so the film allocates them for the first tile that has them
+	if (mVariances.empty()) mVariances = std::vector<pixel_variance>(mPixels.size());
+
+	for (auto y = tile.sample_region.min.y; y < tile.sample_region.max.y; y++) {
+		for (auto x = tile.sample_region.min.x; x < tile.sample_region.max.x; x++) {
+			const auto tile_variance_index =
+				(y - tile.sample_region.min.y) * (tile.sample_region.max.x - tile.sample_region.min.x) +
+				(x - tile.sample_region.min.x);
+
+			mVariances[pixel_index(vector2i(x, y))].merge(tile.variances[tile_variance_index]);
+		}
+	}
+}
+
+void rainbow::cpus::cameras::film::add_tiles(const std::vector<film_tile>& tiles)
+{
+	std::vector<size_t> order(tiles.size());
+
+	for (size_t index = 0; index < order.size(); index++) order[index] = index;
+
+	std::sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs)
+		{
+			const auto& lhs_min = tiles[lhs].sample_region.min;
+			const auto& rhs_min = tiles[rhs].sample_region.min;
+
+			return lhs_min.y != rhs_min.y ? lhs_min.y < rhs_min.y : lhs_min.x < rhs_min.x;
+		});
+
+	for (const auto index : order) add_tile(tiles[index]);
+}
+
+const rainbow::cpus::cameras::pixel_variance& rainbow::cpus::cameras::film::variance(const vector2i& position) const noexcept
+{
+	static const pixel_variance empty_variance;
+
+	if (mVariances.empty()) return empty_variance;
+
+	return mVariances[pixel_index(position)];
 }
 
 rainbow::core::math::vector2i rainbow::cpus::cameras::film::resolution() const noexcept
@@ -32,19 +32,42 @@ namespace rainbow::cpus::cameras {
 		spectrum spectrum() const;
 	};
 
+	// the running mean and variance(welford) of the luminance of the samples in a pixel, the samples are not filtered
+	struct pixel_variance {
+		real mean = 0;
+		real m2 = 0;
+
+		uint32 count = 0;
+
+		void add_sample(real value) noexcept;
+
+		// merge the samples of other into this(chan et al.), the tiles of passes are merged into the film
+		void merge(const pixel_variance& other) noexcept;
+
+		real variance() const noexcept;
+
+		// the standard error of the mean relative to the mean, the dark pixels are not divided by zero
+		real relative_error() const noexcept;
+	};
+
 	struct film_tile {
 		bound2i sample_region;
 		bound2i filter_region;
 
 		std::vector<pixel> pixels;
 
+		// the variances of the pixels in sample region, it is empty if the tile does not record variance
+		std::vector<pixel_variance> variances;
+
 		std::shared_ptr<filter> filter;
 
 		film_tile() = default;
 
+		// the variances are only needed by the noise estimation, so the other tiles skip them
 		film_tile(
 			const bound2i& sample_region,
-			const std::shared_ptr<film>& film);
+			const std::shared_ptr<film>& film,
+			bool record_variance = false);
 
 		void add_sample(const vector2& position, const spectrum& sample) noexcept;
 	};
@@ -69,6 +92,14 @@ namespace rainbow::cpus::cameras {
 		
 		void add_tile(const film_tile& tile);
 
+		// add the tiles in the raster order of their sample regions, the sums of pixels covered by many tiles
+		// do not depend on the order the tiles are rendered, so the image is the same for any schedule
+		void add_tiles(const std::vector<film_tile>& tiles);
+
+		// the variance of the samples in pixel, only the samples added by tiles that record variance are included
+		// if no tile has recorded variance, all pixels have the variance without samples
+		const pixel_variance& variance(const vector2i& position) const noexcept;
+
 		vector2i resolution() const noexcept;
 
 		bound2i pixels_bound() const noexcept;
@@ -81,6 +112,7 @@ namespace rainbow::cpus::cameras {
 
 		std::vector<atomic_spectrum> mValues;
 		std::vector<cameras::pixel> mPixels;
+		std::vector<pixel_variance> mVariances;
 		
 		std::shared_ptr<filters::filter> mFilter;
 
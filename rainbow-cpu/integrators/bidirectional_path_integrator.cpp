@@ -1,4 +1,5 @@
 #include "bidirectional_path_integrator.hpp"
+#include "render_scheduler.hpp"
 
 #include "../../rainbow-core/logs/log.hpp"
 #include "../shared/scope_assignment.hpp"
@@ -7,7 +8,6 @@
 #define __PARALLEL_RENDER__
 #endif
 
-#include <execution>
 #include <variant>
 #include <chrono>
 #include <set>
@@ -1031,43 +1031,19 @@ void rainbow::cpus::integrators::bidirectional_path_integrator::render(
 		bound.max.x - bound.min.x,
 		bound.max.y - bound.min.y);
 
-	const auto tile_size = static_cast<size_t>(16);
-	const auto tile_count = vector2i(
-		(bound_size.x + tile_size - 1) / tile_size,
-		(bound_size.y + tile_size - 1) / tile_size);
-
 	const auto sample_count =
 		static_cast<size_t>(bound_size.x) *
 		static_cast<size_t>(bound_size.y) *
 		mSampler2D->samples_per_pixel();
 
-	struct parallel_input {
-		size_t tile_index;
-
-		bound2i tile;
-	};
-
-	struct parallel_output {
-		film_tile tile;
-	};
-
-	auto outputs = std::vector<parallel_output>();
-	auto inputs = std::vector<parallel_input>();
-
-	for (size_t y = bound.min.y; y < bound.max.y; y += tile_size) {
-		for (size_t x = bound.min.x; x < bound.max.x; x += tile_size) {
-			const auto min_range = vector2i(x, y);
-			const auto max_range = vector2i(
-				min(static_cast<int>(x + tile_size), bound.max.x),
-				min(static_cast<int>(y + tile_size), bound.max.y)
-			);
+#ifdef __PARALLEL_RENDER__
+	const auto scheduler = render_scheduler(bound);
+#else
+	const auto scheduler = render_scheduler(bound, 1);
+#endif
 
-			const auto sample_bound = bound2i(min_range, max_range);
-
-			inputs.push_back({ inputs.size(), sample_bound });
-			outputs.push_back({ film_tile(sample_bound, film) });
-		}
-	}
+	// each strip of tiles has its own output, so the strips of a tile can be rendered by different workers
+	auto outputs = std::vector<film_tile>(scheduler.strips());
 
 #ifdef _DEBUG
 	std::set<std::pair<int, int>> debug_pixel_lists;
@@ -1076,38 +1052,36 @@ void rainbow::cpus::integrators::bidirectional_path_integrator::render(
 		debug_pixel_lists.insert({ debug_pixel.x, debug_pixel.y });
 #endif
 	
-#ifdef __PARALLEL_RENDER__
-	const auto execution_policy = std::execution::par;
-#else
-	const auto execution_policy = std::execution::seq;
-#endif
-
 	const auto samples_per_pixel = mSampler2D->samples_per_pixel();
 
 	logs::info("start rendering...");
 	logs::info("image min range : x = {0}, y = {1}.", bound.min.x, bound.min.y);
 	logs::info("image max range : x = {0}, y = {1}.", bound.max.x, bound.max.y);
-	logs::info("tile size : width = {0}, height = {1}.", tile_size, tile_size);
-
-	std::atomic_int finished_tile_count = 0;
+	logs::info("tile size : width = {0}, height = {1}.", scheduler.tile_size(), scheduler.tile_size());
+	logs::info("render workers : {0}.", scheduler.workers());
 
 	const auto start_rendering_time = std::chrono::high_resolution_clock::now();
 
-	std::for_each(execution_policy, inputs.begin(), inputs.end(), [&](const parallel_input& input)
+	scheduler.run([&](size_t strip, const bound2i& region)
 		{
-			const auto seed = input.tile_index;
-			const auto generator = std::make_shared<random_generator>(seed);
+			// the samplers are seeded by the pixels and the indices of samples, the strip only needs its own copy of them
+			const auto generator = std::make_shared<random_generator>(trace_sample_seed);
+
+			auto& output = outputs[strip] = film_tile(region, film);
 
 			const auto trace_samplers = sampler_group(
 				mSampler1D->clone(generator),
 				mSampler2D->clone(generator));
 				
-			for (auto y = input.tile.min.y; y < input.tile.max.y; y++) {
-				for (auto x = input.tile.min.x; x < input.tile.max.x; x++) {
-					trace_samplers.reset();
+			for (auto y = region.min.y; y < region.max.y; y++) {
+				for (auto x = region.min.x; x < region.max.x; x++) {
+					trace_samplers.start_pixel(vector2i(x, y));
 
 					for (size_t index = 0; index < samples_per_pixel; index++) {
 						const auto position = vector2i(x, y);
+
+						trace_samplers.start_sample(index);
+
 						const auto sample = vector2(x, y) + trace_samplers.sampler2d->next();
 
 						const auto debug = integrator_debug_info(position, index);
@@ -1120,9 +1094,7 @@ void rainbow::cpus::integrators::bidirectional_path_integrator::render(
 
 							// we do not trace these sample, but the filter weight can not be zero
 							// so we will set the sample value to zero.
-							outputs[input.tile_index].tile.add_sample(sample, 0);
-
-							trace_samplers.next_sample();
+							output.add_sample(sample, 0);
 
 							break;
 						}
@@ -1166,18 +1138,14 @@ void rainbow::cpus::integrators::bidirectional_path_integrator::render(
 							}
 						}
 
-						outputs[input.tile_index].tile.add_sample(sample, L);
-						
-						trace_samplers.next_sample();
+						output.add_sample(sample, L);
 					}
 				}
 			}
 
-			logs::info("finish tile {0}, finished {1} / total : {2}", input.tile_index, ++finished_tile_count, inputs.size());
 		});
 
-	for (size_t index = 0; index < outputs.size(); index++)
-		film->add_tile(outputs[index].tile);
+	film->add_tiles(outputs);
 
 	const auto end_rendering_time = std::chrono::high_resolution_clock::now();
 
@@ -21,14 +21,12 @@ spectrum rainbow::cpus::integrators::direct_integrator::trace(
 	const std::shared_ptr<scene>& scene,
 	const integrator_debug_info& debug, 
 	const sampler_group& samplers, 
-	const ray& ray, size_t depth)
+	const ray& ray, const std::optional<surface_interaction>& interaction, size_t depth)
 {
 	// if there are no emitters, we do not trace the ray. just return 0.
 	if (scene->emitters().empty()) return spectrum(0);
 	
 	spectrum L = 0;
-
-	const auto interaction = scene->intersect(ray);
 	
 	// when the ray was not intersect any shapes
 	// we will think it intersect the environment emitter
@@ -59,6 +57,25 @@ spectrum rainbow::cpus::integrators::direct_integrator::trace(
 	
 	// emitter sampling, we sample the emitters with multiple important sampling
 
+	// the shadow rays to the emitters without shape(e.g. point lights) can not be blocked by the emitters
+	// they start from the same point, so we trace them together after sampling all emitters
+	ray_packet<4> shadow_packet;
+
+	std::array<spectrum, ray_packet<4>::size> shadow_values;
+
+	size_t shadow_count = 0;
+
+	const auto trace_shadow_packet = [&]()
+	{
+		const auto blocked = scene->occluded(shadow_packet);
+
+		for (size_t index = 0; index < shadow_count; index++)
+			if ((blocked & (1u << index)) == 0) L += shadow_values[index];
+
+		shadow_packet.active = 0;
+		shadow_count = 0;
+	};
+
 	for (size_t index = 0; index < mEmitterSamples; index++) {
 		// sample which emitter we will sample 
 		auto [emitter, pdf] = uniform_sample_one_emitter(scene, samplers);
@@ -81,27 +98,37 @@ spectrum rainbow::cpus::integrators::direct_integrator::trace(
 			if (function_value.is_black() || function_pdf <= 0) continue;
 
 			const auto shadow_ray = interaction->spawn_ray_to(emitter_sample.interaction.point);
-			const auto shadow_interaction = scene->intersect_with_shadow_ray(shadow_ray);
 
-			// if the shadow ray intersect a entity that is not the emitter
-			// we need skip this shading, because the ray from emitter to entity is occluded
-			if (!shadow_interaction.has_value() || shadow_interaction->entity == emitter) {
+			// if the emitter is delta, the weight should be 1
+			// f(i) * g(i) * w(i) / (p(i) * nf) + f(j) * g(j) * w(j) / (p(j) * ng)
+			// f is the scattering functions, g is the emitter, p is the pdf
+			// nf and ng is the number of samples
+			// weight = (nf * f)^2 / (ng * g)^2 = (nf * f / all)^2 / (ng * g / all)^2
+			// all = nf + ng
+			const auto weight = emitter->component<emitters::emitter>()->is_delta() ? 1 :
+				power_heuristic(emitter_sample.pdf * mFractionalEmitterSamples, function_pdf * mFractionalBSDFSamples) * 
+				mWeightEmitterSamples;
 
-				// if the emitter is delta, the weight should be 1
-				// f(i) * g(i) * w(i) / (p(i) * nf) + f(j) * g(j) * w(j) / (p(j) * ng)
-				// f is the scattering functions, g is the emitter, p is the pdf
-				// nf and ng is the number of samples
-				// weight = (nf * f)^2 / (ng * g)^2 = (nf * f / all)^2 / (ng * g / all)^2
-				// all = nf + ng
-				const auto weight = emitter->component<emitters::emitter>()->is_delta() ? 1 :
-					power_heuristic(emitter_sample.pdf * mFractionalEmitterSamples, function_pdf * mFractionalBSDFSamples) * 
-					mWeightEmitterSamples;
+			const auto value = function_value * emitter_sample.intensity * weight / emitter_sample.pdf;
+
+			if (!emitter->has_component<shape>() && !emitter->component<emitters::emitter>()->is_environment()) {
+				shadow_packet.rays[shadow_count] = shadow_ray;
+				shadow_packet.active = shadow_packet.active | (1u << shadow_count);
+				shadow_values[shadow_count++] = value;
 
-				L += function_value * emitter_sample.intensity * weight / emitter_sample.pdf;
+				if (shadow_count == shadow_packet.size) trace_shadow_packet();
+
+				continue;
 			}
+
+			// if the shadow ray is blocked by a entity that is not the emitter
+			// we need skip this shading, because the ray from emitter to entity is occluded
+			if (!scene->occluded(shadow_ray, emitter)) L += value;
 		}
 	}
 
+	if (shadow_count != 0) trace_shadow_packet();
+
 	// bsdf sampling, we sample the bsdfs with multiple important sampling
 
 	for (size_t index = 0; index < mBSDFSamples; index++) {
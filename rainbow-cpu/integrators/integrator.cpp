@@ -32,6 +32,18 @@ void rainbow::cpus::integrators::sampler_group::reset() const noexcept
 	if (sampler2d != nullptr) sampler2d->reset();
 }
 
+void rainbow::cpus::integrators::sampler_group::start_pixel(const vector2i& pixel, size_t pass, uint64 seed) const
+{
+	if (sampler1d != nullptr) sampler1d->start_pixel(pixel, pass, seed);
+	if (sampler2d != nullptr) sampler2d->start_pixel(pixel, pass, seed);
+}
+
+void rainbow::cpus::integrators::sampler_group::start_sample(size_t index) const
+{
+	if (sampler1d != nullptr) sampler1d->start_sample(index);
+	if (sampler2d != nullptr) sampler2d->start_sample(index);
+}
+
 
 rainbow::cpus::integrators::path_tracing_info::path_tracing_info(
 	const spectrum& value, const spectrum& beta,
@@ -135,11 +147,10 @@ spectrum rainbow::cpus::integrators::uniform_sample_one_emitter(
 			if (!function_value.is_black() && function_pdf > 0) {
 				
 				const auto shadow_ray = interaction.spawn_ray_to(emitter_sample.interaction.point);
-				const auto shadow_interaction = scene->intersect_with_shadow_ray(shadow_ray);
 
-				// if the shadow ray intersect a entity that is not the emitter
+				// if the shadow ray is blocked by a entity that is not the emitter
 				// we need skip this shading, because the ray from emitter to entity is occluded
-				if (!shadow_interaction.has_value() || shadow_interaction->entity == emitter) {
+				if (!scene->occluded(shadow_ray, emitter)) {
 
 					// if we need handle the media, we will evaluate the media beam from surface to light
 					if (media) function_value *= scene->evaluate_media_beam(samplers.sampler1d,
@@ -224,11 +235,10 @@ spectrum rainbow::cpus::integrators::uniform_sample_one_emitter(
 			if (!function_value.is_black() && function_pdf > 0) {
 
 				const auto shadow_ray = interaction.spawn_ray_to(emitter_sample.interaction.point);
-				const auto shadow_interaction = scene->intersect_with_shadow_ray(shadow_ray);
 
-				// if the shadow ray intersect a entity that is not the emitter
+				// if the shadow ray is blocked by a entity that is not the emitter
 				// we need skip this shading, because the ray from emitter to entity is occluded
-				if (!shadow_interaction.has_value() || shadow_interaction->entity == emitter) {
+				if (!scene->occluded(shadow_ray, emitter)) {
 
 					// if we need handle the media, we will evaluate the media beam from surface to light
 					const auto beam = scene->evaluate_media_beam(samplers.sampler1d,
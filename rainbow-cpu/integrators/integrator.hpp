@@ -23,6 +23,11 @@ namespace rainbow::cpus::integrators {
 		integrator_debug_info(const vector2i& pixel, size_t sample);
 	};
 
+	// the seeds of the samplers that generate the samples of a pixel, the camera samples are generated
+	// by their own sampler, the different seeds keep them uncorrelated with the samples of tracing
+	constexpr uint64 trace_sample_seed = 0;
+	constexpr uint64 camera_sample_seed = 1;
+
 	struct sampler_group {
 		std::shared_ptr<sampler1d> sampler1d;
 		std::shared_ptr<sampler2d> sampler2d;
@@ -36,6 +41,10 @@ namespace rainbow::cpus::integrators {
 		void next_sample() const noexcept;
 
 		void reset() const noexcept;
+
+		void start_pixel(const vector2i& pixel, size_t pass = 0, uint64 seed = trace_sample_seed) const;
+
+		void start_sample(size_t index) const;
 	};
 
 	struct path_tracing_info {
@@ -16,7 +16,7 @@ spectrum rainbow::cpus::integrators::path_integrator::trace(
 	const std::shared_ptr<scene>& scene,
 	const integrator_debug_info& debug, 
 	const sampler_group& samplers, 
-	const ray& first_ray, size_t depth)
+	const ray& first_ray, const std::optional<surface_interaction>& first_interaction, size_t depth)
 {
 	path_tracing_info tracing_info;
 
@@ -26,8 +26,14 @@ spectrum rainbow::cpus::integrators::path_integrator::trace(
 	tracing_info.beta = 1;
 	tracing_info.eta = 1;
 	
+	// the first interaction is found before we trace the path, so we only intersect the rays we spawn
+	auto interaction = first_interaction;
+	auto first = true;
+
 	for (auto bounces = static_cast<int>(depth); bounces < mMaxDepth; bounces++) {
-		const auto interaction = scene->intersect(tracing_info.ray);
+		if (!first) interaction = scene->intersect(tracing_info.ray);
+
+		first = false;
 
 		if (!sample_surface_interaction(scene, samplers, interaction, tracing_info, bounces, false))
 			break;
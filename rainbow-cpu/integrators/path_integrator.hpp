@@ -17,7 +17,9 @@ namespace rainbow::cpus::integrators {
 			const std::shared_ptr<scene>& scene,
 			const integrator_debug_info& debug,
 			const sampler_group& samplers,
-			const ray& first_ray, size_t depth) override;
+			const ray& first_ray, const std::optional<surface_interaction>& first_interaction, size_t depth) override;
+
+		using sampler_integrator::trace;
 	protected:
 		sampler_group prepare_samplers(uint64 seed) override;
 	private:
@@ -1,9 +1,10 @@
 #include "photon_mapping_integrator.hpp"
+#include "render_scheduler.hpp"
 
+#include "../../rainbow-core/thread_pool.hpp"
 #include "../../rainbow-core/logs/log.hpp"
 
 #include <unordered_map>
-#include <execution>
 #include <atomic>
 
 #define __NO_DEBUG_MAPPING_PIXEL__
@@ -245,10 +246,8 @@ namespace rainbow::cpus::integrators {
 			max(static_cast<int>(base_size * diagonal.y / max_diagonal), static_cast<int>(1)),
 			max(static_cast<int>(base_size * diagonal.z / max_diagonal), static_cast<int>(1)));
 
-		const auto execution_policy = std::execution::par;
-		
 		// loop the pixels and find voxels that in the box of visible points
-		std::for_each(execution_policy, pixels.begin(), pixels.end(), [&](mapping_pixel& pixel)
+		thread_pool::instance().for_each(pixels.begin(), pixels.end(), 256, [&](mapping_pixel& pixel)
 			{
 				if (!pixel.point.has_value() || pixel.point->beta.is_black()) return;
 
@@ -408,36 +407,15 @@ void rainbow::cpus::integrators::photon_mapping_integrator::render(
 	
 	for (auto& pixel : pixels) pixel.radius = mRadius;
 
-	const auto tile_size = static_cast<size_t>(16);
-	const auto tile_count = vector2i(
-		(bound_size.x + tile_size - 1) / tile_size,
-		(bound_size.y + tile_size - 1) / tile_size);
-
-	struct pixel_input {
-		sampler_group samplers;
-		
-		size_t tile_index;
-
-		bound2i tile;
-	};
-	
-	auto pixel_inputs = std::vector<pixel_input>();
+	const auto scheduler = render_scheduler(pixel_bound);
 
-	for (size_t y = pixel_bound.min.y; y < pixel_bound.max.y; y += tile_size) {
-		for (size_t x = pixel_bound.min.x; x < pixel_bound.max.x; x += tile_size) {
-			const auto min_range = vector2i(x, y);
-			const auto max_range = vector2i(
-				min(static_cast<int>(x + tile_size), pixel_bound.max.x),
-				min(static_cast<int>(y + tile_size), pixel_bound.max.y)
-			);
+	// the samplers are seeded by the pixels and the iterations(the passes of pixels), so each strip only needs its own copy
+	auto pixel_samplers = std::vector<sampler_group>(scheduler.strips());
 
-			const auto sample_bound = bound2i(min_range, max_range);
+	for (size_t index = 0; index < pixel_samplers.size(); index++) {
+		const auto generator = std::make_shared<random_generator>(trace_sample_seed);
 
-			const auto generator = std::make_shared<random_generator>(pixel_inputs.size());
-			const auto samplers = sampler_group(mSampler1D->clone(generator), mSampler2D->clone(generator));
-
-			pixel_inputs.push_back({ samplers, pixel_inputs.size(), sample_bound });
-		}
+		pixel_samplers[index] = sampler_group(mSampler1D->clone(generator), mSampler2D->clone(generator));
 	}
 
 	struct photon_input {
@@ -461,27 +439,26 @@ void rainbow::cpus::integrators::photon_mapping_integrator::render(
 		photon_inputs.push_back({ samplers, begin, end });
 	}
 	
-	const auto execution_policy = std::execution::par;
-
 	logs::info("start rendering...");
 	logs::info("image min range : x = {0}, y = {1}.", pixel_bound.min.x, pixel_bound.min.y);
 	logs::info("image max range : x = {0}, y = {1}.", pixel_bound.max.x, pixel_bound.max.y);
-	logs::info("tile size : width = {0}, height = {1}.", tile_size, tile_size);
+	logs::info("tile size : width = {0}, height = {1}.", scheduler.tile_size(), scheduler.tile_size());
+	logs::info("render workers : {0}.", scheduler.workers());
 
 	const auto start_rendering_time = std::chrono::high_resolution_clock::now();
 	
 	for (size_t iteration = 0; iteration < mIterations; iteration++) {
 		// first pass, loop pixels to build the mapping_pixel and visible points
-		std::for_each(execution_policy, pixel_inputs.begin(), pixel_inputs.end(), [&](const pixel_input& input)
+		scheduler.run([&](size_t strip, const bound2i& region)
 			{
-				const auto trace_samplers = input.samplers;
+				const auto trace_samplers = pixel_samplers[strip];
 			
-				for (auto y = input.tile.min.y; y < input.tile.max.y; y++) {
-					for (auto x = input.tile.min.x; x < input.tile.max.x; x++) {
-
-						trace_samplers.reset();
+				for (auto y = region.min.y; y < region.max.y; y++) {
+					for (auto x = region.min.x; x < region.max.x; x++) {
 
 						const auto position = vector2i(x, y);
+
+						trace_samplers.start_pixel(position, iteration);
 						const auto sample = vector2(x, y) + trace_samplers.sampler2d->next();
 
 						const auto debug = integrator_debug_info(position, 0);
@@ -500,13 +477,13 @@ void rainbow::cpus::integrators::photon_mapping_integrator::render(
 						pixels[offset].L += value;
 					}
 				}
-			});
+			}, false);
 
 		// second pass, grid visible pixels
 		const auto grid = build_visible_point_grid(pixels);
 
 		// third pass, tracing the photon
-		std::for_each(execution_policy, photon_inputs.begin(), photon_inputs.end(), [&](const photon_input& input)
+		thread_pool::instance().for_each(photon_inputs.begin(), photon_inputs.end(), 1, [&](const photon_input& input)
 			{
 				for (auto index = input.begin; index < input.end; index++) {
 					trace_photon(scene, integrator_debug_info(vector2i(), index),
@@ -516,7 +493,7 @@ void rainbow::cpus::integrators::photon_mapping_integrator::render(
 
 		const auto gamma = static_cast<real>(2) / 3;
 		
-		std::for_each(execution_policy, pixels.begin(), pixels.end(), [&](mapping_pixel& pixel)
+		thread_pool::instance().for_each(pixels.begin(), pixels.end(), 256, [&](mapping_pixel& pixel)
 			{
 				if (pixel.m > 0) {
 					const auto new_n = pixel.n + gamma * pixel.m;
@@ -0,0 +1,323 @@
+#include "render_scheduler.hpp"
+
+#include "../../rainbow-core/thread_pool.hpp"
+#include "../../rainbow-core/logs/log.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <deque>
+
+namespace rainbow::cpus::integrators {
+
+	// the tasks are ranges of strips, the begin is in the high 32 bits and the end is in the low 32 bits
+	// so a worker can claim a strip and a thief can split the range with one compare and swap
+	inline uint64 pack_strips(uint64 begin, uint64 end)
+	{
+		return (begin << 32) | end;
+	}
+
+	inline size_t strips_begin(uint64 range)
+	{
+		return static_cast<size_t>(range >> 32);
+	}
+
+	inline size_t strips_end(uint64 range)
+	{
+		return static_cast<size_t>(range & 0xffffffff);
+	}
+
+	// the cell of grid that contains the value, it works for the negative values too
+	inline int grid_floor(int value, int size)
+	{
+		return value >= 0 ? value / size : -((-value + size - 1) / size);
+	}
+
+	inline int grid_ceil(int value, int size)
+	{
+		return -grid_floor(-value, size);
+	}
+
+	inline uint64 hilbert_index(uint32 size, uint32 x, uint32 y)
+	{
+		uint64 index = 0;
+
+		for (uint32 step = size / 2; step > 0; step = step / 2) {
+			const uint32 rx = (x & step) != 0 ? 1 : 0;
+			const uint32 ry = (y & step) != 0 ? 1 : 0;
+
+			index = index + static_cast<uint64>(step) * step * ((3 * rx) ^ ry);
+
+			// rotate the quadrant, so the curve in it starts at the end of the curve of previous quadrant
+			if (ry == 0) {
+				if (rx == 1) {
+					x = size - 1 - x;
+					y = size - 1 - y;
+				}
+
+				std::swap(x, y);
+			}
+		}
+
+		return index;
+	}
+
+	struct render_worker {
+		std::mutex mutex;
+
+		// the tasks owned by worker, the owner pops the front and the thieves steal the back
+		std::deque<uint64> tasks;
+
+		// the strips of running task that are not claimed
+		std::atomic<uint64> running = 0;
+	};
+
+	inline bool claim_strip(std::atomic<uint64>& running, size_t& strip)
+	{
+		auto range = running.load();
+
+		while (strips_begin(range) < strips_end(range)) {
+			if (running.compare_exchange_weak(range, pack_strips(strips_begin(range) + 1, strips_end(range)))) {
+				strip = strips_begin(range);
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	inline bool split_strips(std::atomic<uint64>& running, uint64& task)
+	{
+		auto range = running.load();
+
+		while (strips_end(range) - strips_begin(range) >= 2) {
+			// the owner keeps the first half, the strips near the strip it is rendering
+			const auto middle = strips_begin(range) + (strips_end(range) - strips_begin(range) + 1) / 2;
+
+			if (running.compare_exchange_weak(range, pack_strips(strips_begin(range), middle))) {
+				task = pack_strips(middle, strips_end(range));
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+}
+
+rainbow::cpus::integrators::render_tile::render_tile(size_t index, size_t strip, const bound2i& region) :
+	index(index), strip(strip), region(region)
+{
+	constexpr auto width = static_cast<int>(render_scheduler::strip_width);
+	constexpr auto height = static_cast<int>(render_scheduler::strip_size);
+
+	first_cell = vector2i(grid_floor(region.min.x, width), grid_floor(region.min.y, height));
+	columns = grid_ceil(region.max.x, width) - first_cell.x;
+
+	strips = static_cast<size_t>(columns) * static_cast<size_t>(grid_ceil(region.max.y, height) - first_cell.y);
+}
+
+rainbow::core::math::bound2i rainbow::cpus::integrators::render_tile::strip_region(size_t strip) const noexcept
+{
+	constexpr auto width = static_cast<int>(render_scheduler::strip_width);
+	constexpr auto height = static_cast<int>(render_scheduler::strip_size);
+
+	// the strips of tile are in row major order, the rows of strips go from top to bottom
+	const auto local = static_cast<int>(strip - this->strip);
+	const auto cell = vector2i(first_cell.x + local % columns, first_cell.y + local / columns);
+
+	return bound2i(
+		vector2i(max(cell.x * width, region.min.x), max(cell.y * height, region.min.y)),
+		vector2i(min(cell.x * width + width, region.max.x), min(cell.y * height + height, region.max.y)));
+}
+
+rainbow::cpus::integrators::render_scheduler::render_scheduler(const bound2i& bound, size_t workers) :
+	mWorkers(workers != 0 ? workers : thread_pool::instance().workers())
+{
+	const auto size = vector2i(bound.max.x - bound.min.x, bound.max.y - bound.min.y);
+
+	if (size.x <= 0 || size.y <= 0) return;
+
+	// the tiles are aligned to the grid of tile size, so the tiles of different sizes are aligned to the grid of strips
+	const auto first_tile = [&](size_t tile_size)
+	{
+		return vector2i(
+			grid_floor(bound.min.x, static_cast<int>(tile_size)),
+			grid_floor(bound.min.y, static_cast<int>(tile_size)));
+	};
+
+	const auto tile_count = [&](size_t tile_size)
+	{
+		const auto first = first_tile(tile_size);
+
+		return vector_t<2, size_t>(
+			static_cast<size_t>(grid_ceil(bound.max.x, static_cast<int>(tile_size)) - first.x),
+			static_cast<size_t>(grid_ceil(bound.max.y, static_cast<int>(tile_size)) - first.y));
+	};
+
+	// the large tiles have better locality, but each worker needs enough tiles to balance the load
+	mTileSize = max_tile_size;
+
+	while (mTileSize > min_tile_size && tile_count(mTileSize).x * tile_count(mTileSize).y < mWorkers * tiles_per_worker)
+		mTileSize = mTileSize / 2;
+
+	const auto first = first_tile(mTileSize);
+	const auto count = tile_count(mTileSize);
+
+	uint32 curve_size = 1;
+
+	while (curve_size < max(count.x, count.y)) curve_size = curve_size * 2;
+
+	std::vector<std::pair<uint64, bound2i>> regions;
+
+	for (size_t y = 0; y < count.y; y++) {
+		for (size_t x = 0; x < count.x; x++) {
+			const auto origin = vector2i(
+				(first.x + static_cast<int>(x)) * static_cast<int>(mTileSize),
+				(first.y + static_cast<int>(y)) * static_cast<int>(mTileSize));
+
+			const auto min_range = vector2i(max(origin.x, bound.min.x), max(origin.y, bound.min.y));
+			const auto max_range = vector2i(
+				min(static_cast<int>(origin.x + mTileSize), bound.max.x),
+				min(static_cast<int>(origin.y + mTileSize), bound.max.y));
+
+			regions.push_back({ hilbert_index(curve_size, static_cast<uint32>(x), static_cast<uint32>(y)), bound2i(min_range, max_range) });
+		}
+	}
+
+	std::sort(regions.begin(), regions.end(), [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+
+	mTiles.reserve(regions.size());
+
+	for (const auto& region : regions) {
+		mTiles.push_back(render_tile(mTiles.size(), mStripTiles.size(), region.second));
+
+		for (size_t strip = 0; strip < mTiles.back().strips; strip++)
+			mStripTiles.push_back(static_cast<uint32>(mTiles.back().index));
+	}
+}
+
+void rainbow::cpus::integrators::render_scheduler::run(const render_function& function, bool log_tiles) const
+{
+	if (mStripTiles.empty()) return;
+
+	const auto workers = std::make_unique<render_worker[]>(mWorkers);
+	const auto remaining = std::make_unique<std::atomic<size_t>[]>(mTiles.size());
+
+	// the worker i owns the i-th range of tiles, the tiles of a range are nearby on the hilbert curve
+	for (size_t worker = 0; worker < mWorkers; worker++) {
+		const auto begin = worker * mTiles.size() / mWorkers;
+		const auto end = (worker + 1) * mTiles.size() / mWorkers;
+
+		for (auto index = begin; index < end; index++)
+			workers[worker].tasks.push_back(pack_strips(mTiles[index].strip, mTiles[index].strip + mTiles[index].strips));
+	}
+
+	for (size_t index = 0; index < mTiles.size(); index++) remaining[index] = mTiles[index].strips;
+
+	std::atomic<size_t> finished_strips = 0;
+	std::atomic<size_t> finished_tiles = 0;
+
+	const auto find_task = [&](size_t worker, uint64& task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(workers[worker].mutex);
+
+			if (!workers[worker].tasks.empty()) {
+				task = workers[worker].tasks.front();
+				workers[worker].tasks.pop_front();
+
+				return true;
+			}
+		}
+
+		// steal the tile that the owner will render last, the nearby workers are tried first(they are on the same numa node)
+		for (size_t offset = 1; offset < mWorkers; offset++) {
+			auto& victim = workers[(worker + offset) % mWorkers];
+
+			std::lock_guard<std::mutex> lock(victim.mutex);
+
+			if (!victim.tasks.empty()) {
+				task = victim.tasks.back();
+				victim.tasks.pop_back();
+
+				return true;
+			}
+		}
+
+		// all tiles are started, we split the running task with the most strips
+		while (true) {
+			size_t victim = 0;
+			size_t victim_strips = 0;
+
+			for (size_t index = 0; index < mWorkers; index++) {
+				const auto range = workers[index].running.load();
+				const auto strips = strips_end(range) - strips_begin(range);
+
+				if (strips_begin(range) < strips_end(range) && strips > victim_strips) {
+					victim = index;
+					victim_strips = strips;
+				}
+			}
+
+			if (victim_strips < 2) return false;
+
+			if (split_strips(workers[victim].running, task)) return true;
+		}
+	};
+
+	const auto work = [&](size_t worker)
+	{
+		uint64 task = 0;
+		size_t strip = 0;
+
+		while (finished_strips.load() < mStripTiles.size()) {
+			// the deques are filled before the workers start and the running ranges only shrink, so when there is
+			// no task to steal or split, this worker will never find one, the owners finish their last strips
+			if (!find_task(worker, task)) return;
+
+			workers[worker].running = task;
+
+			while (claim_strip(workers[worker].running, strip)) {
+				const auto& tile = mTiles[mStripTiles[strip]];
+
+				function(strip, tile.strip_region(strip));
+
+				if (--remaining[tile.index] == 0 && log_tiles)
+					logs::info("finish tile {0}, finished {1} / total : {2}", tile.index, ++finished_tiles, mTiles.size());
+
+				++finished_strips;
+			}
+		}
+	};
+
+	if (mWorkers == 1) { work(0); return; }
+
+	thread_pool::instance().parallel_for(mWorkers, 1, [&](size_t begin, size_t end)
+		{
+			for (auto worker = begin; worker < end; worker++) work(worker);
+		});
+}
+
+const std::vector<rainbow::cpus::integrators::render_tile>& rainbow::cpus::integrators::render_scheduler::tiles() const noexcept
+{
+	return mTiles;
+}
+
+size_t rainbow::cpus::integrators::render_scheduler::tile_size() const noexcept
+{
+	return mTileSize;
+}
+
+size_t rainbow::cpus::integrators::render_scheduler::strips() const noexcept
+{
+	return mStripTiles.size();
+}
+
+size_t rainbow::cpus::integrators::render_scheduler::workers() const noexcept
+{
+	return mWorkers;
+}
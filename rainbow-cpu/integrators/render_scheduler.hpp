@@ -0,0 +1,83 @@
+#pragma once
+
+#include "../../rainbow-core/math/math.hpp"
+
+#include <functional>
+#include <vector>
+
+namespace rainbow::cpus::integrators {
+
+	using namespace core::math;
+	using namespace core;
+
+	struct render_tile {
+		// the index of tile in render order
+		size_t index = 0;
+
+		// the first strip of tile and the number of strips
+		size_t strip = 0;
+		size_t strips = 0;
+
+		bound2i region;
+
+		// the first cell of grid of strips covered by tile and the number of columns
+		vector2i first_cell = vector2i(0);
+
+		int columns = 0;
+
+		render_tile() = default;
+
+		render_tile(size_t index, size_t strip, const bound2i& region);
+
+		bound2i strip_region(size_t strip) const noexcept;
+	};
+
+	/*
+	 * render_scheduler splits the pixels into tiles and renders them with a group of workers.
+	 * the tiles are ordered along the hilbert curve and each worker owns a range of them in its deque,
+	 * so the tiles a worker renders are nearby and share the geometry and textures in cache.
+	 * a tile is rendered strip by strip, when a worker has no tiles it steals a tile from the back
+	 * of other deques, and when all deques are empty it splits the remaining strips of a running tile.
+	 * so the expensive tiles(caustics, glass) are finished by many workers instead of the worker that owns them.
+	 * the tile size is the largest one that still gives each worker enough tiles to balance the load.
+	 *
+	 * the strips are the cells(strip_width x strip_size) of a fixed grid that starts at pixel (0, 0),
+	 * the tiles are aligned to the grid too, so the region of a strip does not depend on the tile size,
+	 * the number of workers or the crop window(the strips on the border are clipped only).
+	 * the strips are indexed in render order, a strip is always rendered by one call of function,
+	 * so the integrators can use the index of strip as the index of output.
+	 */
+	class render_scheduler final {
+	public:
+		// render the pixels of region, the region is the strip with index strip
+		using render_function = std::function<void(size_t strip, const bound2i& region)>;
+
+		constexpr static inline size_t strip_width = 16;
+		constexpr static inline size_t strip_size = 4;
+		constexpr static inline size_t min_tile_size = 16;
+		constexpr static inline size_t max_tile_size = 64;
+		constexpr static inline size_t tiles_per_worker = 16;
+
+		// if workers is 0, we use all workers of thread_pool::instance()
+		explicit render_scheduler(const bound2i& bound, size_t workers = 0);
+
+		void run(const render_function& function, bool log_tiles = true) const;
+
+		const std::vector<render_tile>& tiles() const noexcept;
+
+		size_t tile_size() const noexcept;
+
+		size_t strips() const noexcept;
+
+		size_t workers() const noexcept;
+	private:
+		std::vector<render_tile> mTiles;
+
+		// the tile of each strip
+		std::vector<uint32> mStripTiles;
+
+		size_t mTileSize = 16;
+		size_t mWorkers = 1;
+	};
+
+}
@@ -1,4 +1,5 @@
 #include "sampler_integrator.hpp"
+#include "render_scheduler.hpp"
 
 #include "../../rainbow-core/logs/log.hpp"
 
@@ -6,8 +7,9 @@
 #define __PARALLEL_RENDER__
 #endif
 
-#include <execution>
 #include <chrono>
+#include <limits>
+#include <tuple>
 #include <set>
 
 rainbow::cpus::integrators::sampler_integrator::sampler_integrator(
@@ -27,43 +29,24 @@ void rainbow::cpus::integrators::sampler_integrator::render(
 		bound.max.x - bound.min.x,
 		bound.max.y - bound.min.y);
 
-	const auto tile_size = static_cast<size_t>(16);
-	const auto tile_count = vector2i(
-		(bound_size.x + tile_size - 1) / tile_size,
-		(bound_size.y + tile_size - 1) / tile_size);
+	// the camera rays are traced in packets, a packet has the samples of the pixels in a block of tile
+	constexpr auto packet_size = static_cast<size_t>(16);
+	constexpr auto block_size = 4;
 
 	const auto sample_count =
 		static_cast<size_t>(bound_size.x) *
 		static_cast<size_t>(bound_size.y) *
 		mSampler2D->samples_per_pixel();
 
-	struct parallel_input {
-		size_t tile_index;
-
-		bound2i tile;
-	};
-
-	struct parallel_output {
-		film_tile tile;
-	};
+#ifdef __PARALLEL_RENDER__
+	const auto scheduler = render_scheduler(bound);
+#else
+	const auto scheduler = render_scheduler(bound, 1);
+#endif
 
-	auto outputs = std::vector<parallel_output>();
-	auto inputs = std::vector<parallel_input>();
-
-	for (size_t y = bound.min.y; y < bound.max.y; y += tile_size) {
-		for (size_t x = bound.min.x; x < bound.max.x; x += tile_size) {
-			const auto min_range = vector2i(x, y);
-			const auto max_range = vector2i(
-				min(static_cast<int>(x + tile_size), bound.max.x),
-				min(static_cast<int>(y + tile_size), bound.max.y)
-			);
-
-			const auto sample_bound = bound2i(min_range, max_range);
-			
-			inputs.push_back({ inputs.size(), sample_bound });
-			outputs.push_back({ film_tile(sample_bound, film) });
-		}
-	}
+	// each strip of tiles has its own output, so the strips of a tile can be rendered by different workers
+	// the outputs of a pass are added into the film before the next pass, so the film has the image of finished passes
+	auto outputs = std::vector<film_tile>(scheduler.strips());
 
 #ifdef _DEBUG
 	std::set<std::pair<int, int>> debug_pixel_lists;
@@ -72,70 +55,211 @@ void rainbow::cpus::integrators::sampler_integrator::render(
 		debug_pixel_lists.insert({ debug_pixel.x, debug_pixel.y });
 #endif
 
-#ifdef __PARALLEL_RENDER__
-	const auto execution_policy = std::execution::par;
-#else
-	const auto execution_policy = std::execution::seq;
-#endif
-
 	const auto samples_per_pixel = mSampler2D->samples_per_pixel();
 
 	logs::info("start rendering...");
 	logs::info("image min range : x = {0}, y = {1}.", bound.min.x, bound.min.y);
 	logs::info("image max range : x = {0}, y = {1}.", bound.max.x, bound.max.y);
-	logs::info("tile size : width = {0}, height = {1}.", tile_size, tile_size);
-
-	std::atomic_int finished_tile_count = 0;
+	logs::info("tile size : width = {0}, height = {1}.", scheduler.tile_size(), scheduler.tile_size());
+	logs::info("render workers : {0}.", scheduler.workers());
 
 	const auto start_rendering_time = std::chrono::high_resolution_clock::now();
 	
-	std::for_each(execution_policy, inputs.begin(), inputs.end(), [&](const parallel_input& input)
-		{
-			const auto seed = input.tile_index;
-
-			const auto trace_samplers = prepare_samplers(seed);
-
-			for (auto y = input.tile.min.y; y < input.tile.max.y; y++) {
-				for (auto x = input.tile.min.x; x < input.tile.max.x; x++) {
-					trace_samplers.reset();
-
-					for (size_t index = 0; index < samples_per_pixel; index++) {
-						const auto position = vector2i(x, y);
-						const auto sample = vector2(x, y) + trace_samplers.sampler2d->next();
-						
-						const auto debug = integrator_debug_info(position, index);
-						
-#ifdef _DEBUG
-						// when mDebugPixels is not empty, the debug_pixel_lists is not empty too.
-						// when debug_pixel_lists is not empty, we will only trace the pixel that in the debug lists
-						// in other words, the pixels we called integrator::set_debug_trace_pixel().
-						if (!debug_pixel_lists.empty() && debug_pixel_lists.find({ x, y }) == debug_pixel_lists.end()) {
-
-							// we do not trace these sample, but the filter weight can not be zero
-							// so we will set the sample value to zero.
-							outputs[input.tile_index].tile.add_sample(sample, 0);
-							
-							trace_samplers.next_sample();
-
-							break;
-						}
-#endif					
+	const auto pixel_offset = [&](int x, int y)
+	{
+		return static_cast<size_t>(y - bound.min.y) * bound_size.x + (x - bound.min.x);
+	};
+
+	// the pixels are sampled by the next pass if they are active, it is empty if all pixels are always sampled
+	auto active_pixels = std::vector<uint8>();
+
+	// only the thresholds use the variances of pixels, without them the tiles do not record the variances
+	const auto record_variance = mProgressive.noise_threshold > 0 || mProgressive.adaptive_threshold > 0;
+
+	// a pass renders the samples_per_pixel samples of each active pixel and adds them into the film
+	const auto render_pass = [&](size_t pass)
+	{
+		scheduler.run([&](size_t strip, const bound2i& region)
+			{
+				// the samplers are seeded by the pixels and the indices of samples, the strip only needs its own copy of them
+				// the camera samples are generated by their own sampler, so we can generate the camera rays of a packet
+				// before tracing them, the seed of camera sampler keeps its samples uncorrelated with the samples of tracing
+				const auto trace_samplers = prepare_samplers(trace_sample_seed);
+				const auto camera_sampler = mSampler2D->clone(camera_sample_seed);
+
+				auto& output = outputs[strip] = film_tile(region, film, record_variance);
 
-						outputs[input.tile_index].tile.add_sample(
-							sample,
-							trace(scene, debug, trace_samplers, camera->sample(sample, trace_samplers.sampler2d->next()), 0)
+				ray_packet<packet_size> packet;
+
+				std::array<integrator_debug_info, packet_size> packet_debug;
+				std::array<vector2, packet_size> packet_samples;
+
+				size_t packet_count = 0;
+
+				const auto trace_packet = [&]()
+				{
+					// the camera rays of nearby pixels are coherent, so we find their first interactions together
+					const auto interactions = scene->intersect(packet);
+
+					for (size_t index = 0; index < packet_count; index++) {
+						// the samples of a pixel are in the same order as we trace the pixels one by one
+						if (packet_debug[index].sample == 0) trace_samplers.start_pixel(packet_debug[index].pixel, pass);
+
+						trace_samplers.start_sample(packet_debug[index].sample);
+
+						output.add_sample(
+							packet_samples[index],
+							trace(scene, packet_debug[index], trace_samplers, packet.rays[index], interactions[index], 0)
 						);
+					}
+
+					packet.active = 0;
+					packet_count = 0;
+				};
+
+				// the pixels of strip are visited block by block, the rays of a packet come from the same block
+				for (auto block_y = region.min.y; block_y < region.max.y; block_y += block_size) {
+					for (auto block_x = region.min.x; block_x < region.max.x; block_x += block_size) {
+						const auto block_max = vector2i(
+							min(block_x + block_size, region.max.x),
+							min(block_y + block_size, region.max.y));
+
+						for (auto y = block_y; y < block_max.y; y++) {
+							for (auto x = block_x; x < block_max.x; x++) {
+								// the converged pixels are retired, they only get the samples of their neighbors through filter
+								if (!active_pixels.empty() && active_pixels[pixel_offset(x, y)] == 0) continue;
+
+								camera_sampler->start_pixel(vector2i(x, y), pass, camera_sample_seed);
+
+								for (size_t index = 0; index < samples_per_pixel; index++) {
+									const auto position = vector2i(x, y);
+
+									camera_sampler->start_sample(index);
+
+									const auto sample = vector2(x, y) + camera_sampler->next();
+
+#ifdef _DEBUG
+									// when mDebugPixels is not empty, the debug_pixel_lists is not empty too.
+									// when debug_pixel_lists is not empty, we will only trace the pixel that in the debug lists
+									// in other words, the pixels we called integrator::set_debug_trace_pixel().
+									if (!debug_pixel_lists.empty() && debug_pixel_lists.find({ x, y }) == debug_pixel_lists.end()) {
+
+										// we do not trace these sample, but the filter weight can not be zero
+										// so we will set the sample value to zero.
+										output.add_sample(sample, 0);
+
+										break;
+									}
+#endif
+
+									packet.rays[packet_count] = camera->sample(sample, camera_sampler->next());
+									packet.active = packet.active | (1u << packet_count);
 
-						trace_samplers.next_sample();
+									packet_debug[packet_count] = integrator_debug_info(position, index);
+									packet_samples[packet_count] = sample;
+
+									if (++packet_count == packet.size) trace_packet();
+								}
+							}
+						}
 					}
 				}
+
+				if (packet_count != 0) trace_packet();
+			});
+
+		film->add_tiles(outputs);
+	};
+
+	// estimate the noise(the mean relative error of pixels) and count the active pixels
+	// if retire is true, the active pixels are retired when the relative errors of them and their neighbors are
+	// less than the adaptive threshold, the variance of a few samples may miss the rare paths(caustics, small lights)
+	// and the neighbors that are not converged are the sign of them
+	auto converged_pixels = std::vector<uint8>();
+
+	const auto update_active_pixels = [&](bool retire)
+	{
+		real relative_error = 0;
+		size_t count = 0;
+
+		for (auto y = bound.min.y; y < bound.max.y && record_variance; y++) {
+			for (auto x = bound.min.x; x < bound.max.x; x++) {
+				const auto error = film->variance(vector2i(x, y)).relative_error();
+
+				relative_error += error;
+
+				if (!converged_pixels.empty()) converged_pixels[pixel_offset(x, y)] = error < mProgressive.adaptive_threshold ? 1 : 0;
 			}
+		}
 
-			logs::info("finish tile {0}, finished {1} / total : {2}", input.tile_index, ++finished_tile_count, inputs.size());
-		});
+		for (auto y = bound.min.y; y < bound.max.y && !active_pixels.empty(); y++) {
+			for (auto x = bound.min.x; x < bound.max.x; x++) {
+				if (active_pixels[pixel_offset(x, y)] == 0) continue;
 
-	for (size_t index = 0; index < outputs.size(); index++)
-		film->add_tile(outputs[index].tile);
+				auto converged = retire;
+
+				for (auto ny = max(y - 1, bound.min.y); ny < min(y + 2, bound.max.y) && converged; ny++)
+					for (auto nx = max(x - 1, bound.min.x); nx < min(x + 2, bound.max.x) && converged; nx++)
+						converged = converged_pixels[pixel_offset(nx, ny)] != 0;
+
+				if (converged) active_pixels[pixel_offset(x, y)] = 0; else count++;
+			}
+		}
+
+		if (active_pixels.empty()) count = static_cast<size_t>(bound_size.x) * bound_size.y;
+
+		return std::make_tuple(relative_error / (static_cast<size_t>(bound_size.x) * bound_size.y), count);
+	};
+
+	const auto progressive =
+		mProgressive.target_samples_per_pixel != 0 ||
+		mProgressive.time_budget > 0 ||
+		mProgressive.noise_threshold > 0 ||
+		mProgressive.adaptive_threshold > 0;
+
+	if (mProgressive.adaptive_threshold > 0) {
+		active_pixels = std::vector<uint8>(static_cast<size_t>(bound_size.x) * bound_size.y, 1);
+		converged_pixels = std::vector<uint8>(active_pixels.size(), 0);
+	}
+
+	auto active_count = static_cast<size_t>(bound_size.x) * bound_size.y;
+	auto total_samples = static_cast<uint64>(0);
+
+	const auto max_passes = mProgressive.target_samples_per_pixel != 0 ?
+		(mProgressive.target_samples_per_pixel + samples_per_pixel - 1) / samples_per_pixel :
+		(progressive ? std::numeric_limits<size_t>::max() : 1);
+
+	for (size_t pass = 0; pass < max_passes; pass++) {
+		render_pass(pass);
+
+		if (!progressive) break;
+
+		progressive_info info;
+
+		info.passes = pass + 1;
+		info.samples_per_pixel = info.passes * samples_per_pixel;
+		info.samples = total_samples = total_samples + active_count * samples_per_pixel;
+		info.time = std::chrono::duration_cast<std::chrono::duration<real>>(
+			std::chrono::high_resolution_clock::now() - start_rendering_time).count();
+
+		// the variance of a few samples is not reliable, so we do not retire the pixels in the first passes
+		std::tie(info.noise, active_count) = update_active_pixels(info.passes >= mProgressive.adaptive_min_passes);
+
+		info.active_pixels = active_count;
+
+		logs::info("finish pass {0}, samples per pixel : {1}, active pixels : {2}, noise : {3}.",
+			pass, info.samples_per_pixel, info.active_pixels, info.noise);
+
+		if (mProgressive.pass_finished) mProgressive.pass_finished(film, info);
+
+		// the variance of a pixel needs two samples at least, so the noise of the first pass may be 0
+		if (mProgressive.noise_threshold > 0 && info.passes > 1 && info.noise <= mProgressive.noise_threshold) break;
+
+		if (!active_pixels.empty() && active_count == 0) break;
+
+		// we do not start the next pass if it is expected to end after the budget
+		if (mProgressive.time_budget > 0 && info.time + info.time / info.passes > mProgressive.time_budget) break;
+	}
 
 	const auto end_rendering_time = std::chrono::high_resolution_clock::now();
 	
@@ -143,6 +267,20 @@ void rainbow::cpus::integrators::sampler_integrator::render(
 		std::chrono::duration_cast<std::chrono::duration<double>>(end_rendering_time - start_rendering_time).count());
 }
 
+void rainbow::cpus::integrators::sampler_integrator::set_progressive(const progressive_config& config)
+{
+	mProgressive = config;
+}
+
+rainbow::cpus::shared::spectrums::spectrum rainbow::cpus::integrators::sampler_integrator::trace(
+	const std::shared_ptr<scene>& scene,
+	const integrator_debug_info& debug,
+	const sampler_group& samplers,
+	const ray& ray, size_t depth)
+{
+	return trace(scene, debug, samplers, ray, scene->intersect(ray), depth);
+}
+
 rainbow::cpus::integrators::sampler_group rainbow::cpus::integrators::sampler_integrator::prepare_samplers(uint64 seed)
 {
 	return sampler_group(
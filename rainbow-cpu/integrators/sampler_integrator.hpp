@@ -2,8 +2,54 @@
 
 #include "integrator.hpp"
 
+#include <functional>
+
 namespace rainbow::cpus::integrators {
 
+	struct progressive_info {
+		// the number of finished passes and the samples of the pixels that are never retired
+		size_t passes = 0;
+		size_t samples_per_pixel = 0;
+
+		// the samples of all pixels in finished passes and the pixels sampled by the next pass
+		uint64 samples = 0;
+		size_t active_pixels = 0;
+
+		// the seconds used by the finished passes
+		real time = 0;
+
+		// the mean relative error of pixels estimated from the variances of their samples,
+		// it is 0 if neither noise_threshold nor adaptive_threshold is set(the variances are not recorded)
+		real noise = 0;
+	};
+
+	/*
+	 * progressive_config enables the progressive rendering of sampler_integrator.
+	 * the pixels are rendered in passes, a pass renders the samples_per_pixel(of sampler) samples of each pixel
+	 * and adds them into the film, so the film has the image of the finished passes after each pass.
+	 * if adaptive_threshold is not 0, the pixels whose relative errors(and the errors of neighbors) are less than it are retired,
+	 * the next passes only sample the active pixels, so the converged pixels(sky, matte walls) do not use more samples.
+	 * the rendering stops when any limit is reached or all pixels are retired, the limits that are 0 are ignored.
+	 * if all limits and adaptive_threshold are 0, we only render one pass.
+	 */
+	struct progressive_config {
+		// the samples of each pixel, it is rounded up to the samples of passes
+		size_t target_samples_per_pixel = 0;
+
+		// the seconds of wall clock, we do not start the pass that is expected to end after the budget
+		real time_budget = 0;
+
+		// the mean relative error of pixels
+		real noise_threshold = 0;
+
+		// the relative error of converged pixel and the passes rendered before retiring any pixel
+		real adaptive_threshold = 0;
+		size_t adaptive_min_passes = 2;
+
+		// called after each pass, the film has the intermediate image, e.g. write it for preview
+		std::function<void(const std::shared_ptr<film>& film, const progressive_info& info)> pass_finished;
+	};
+
 	class sampler_integrator : public integrator {
 	public:
 		explicit sampler_integrator(
@@ -16,16 +62,27 @@ namespace rainbow::cpus::integrators {
 			const std::shared_ptr<camera>& camera,
 			const std::shared_ptr<scene>& scene) override;
 
+		void set_progressive(const progressive_config& config);
+
+		// trace the ray whose first interaction is found before, e.g. by the packet of camera rays
 		virtual spectrum trace(
 			const std::shared_ptr<scene>& scene,
 			const integrator_debug_info& debug,
 			const sampler_group& samplers,
-			const ray& ray, size_t depth) = 0;
+			const ray& ray, const std::optional<surface_interaction>& interaction, size_t depth) = 0;
+
+		spectrum trace(
+			const std::shared_ptr<scene>& scene,
+			const integrator_debug_info& debug,
+			const sampler_group& samplers,
+			const ray& ray, size_t depth);
 	protected:
 		virtual sampler_group prepare_samplers(uint64 seed);
 
 		std::shared_ptr<sampler2d> mSampler2D;
 
+		progressive_config mProgressive;
+
 		const size_t mMaxDepth = 5;
 	};
 
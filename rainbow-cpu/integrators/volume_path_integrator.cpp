@@ -14,7 +14,7 @@ rainbow::cpus::shared::spectrum rainbow::cpus::integrators::volume_path_integrat
 	const std::shared_ptr<scene>& scene, 
 	const integrator_debug_info& debug, 
 	const sampler_group& samplers,
-	const ray& first_ray, size_t depth)
+	const ray& first_ray, const std::optional<surface_interaction>& first_interaction, size_t depth)
 {
 	path_tracing_info tracing_info;
 
@@ -27,8 +27,14 @@ rainbow::cpus::shared::spectrum rainbow::cpus::integrators::volume_path_integrat
 	tracing_info.beta = 1;
 	tracing_info.eta = 1;
 
+	// the first interaction is found before we trace the path, so we only intersect the rays we spawn
+	auto interaction = first_interaction;
+	auto first = true;
+
 	for (auto bounces = static_cast<int>(depth); bounces < mMaxDepth; bounces++) {
-		const auto interaction = scene->intersect(tracing_info.ray);
+		if (!first) interaction = scene->intersect(tracing_info.ray);
+
+		first = false;
 
 		// if current medium is not empty, we will sample the medium to decide which interaction we will sample next time
 		// if the medium_sample.interaction is std::nullopt, means we will sample the surface_interaction
@@ -0,0 +1,557 @@
+#include "wavefront_path_integrator.hpp"
+
+#include "../../rainbow-core/thread_pool.hpp"
+#include "../../rainbow-core/logs/log.hpp"
+
+#include "../samplers/random_sampler.hpp"
+
+#ifndef _DEBUG
+#define __PARALLEL_RENDER__
+#endif
+
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+
+using namespace rainbow::cpus::shared::interactions;
+using namespace rainbow::cpus::shared::spectrums;
+
+namespace rainbow::cpus::integrators {
+
+	// the number of paths a worker takes at once when the stage runs for each path
+	constexpr auto wavefront_path_grain = static_cast<size_t>(256);
+
+	// the stages run on the thread pool, in debug mode they run on the calling thread
+	template <typename Iterator, typename Function>
+	void wavefront_for_each(Iterator first, Iterator last, size_t grain, const Function& function)
+	{
+#ifdef __PARALLEL_RENDER__
+		thread_pool::instance().for_each(first, last, grain, function);
+#else
+		std::for_each(first, last, function);
+#endif
+	}
+
+	// the workers sort a chunk of queue each, and then the sorted chunks are merged in pairs
+	template <typename Compare>
+	void wavefront_sort(std::vector<uint32>& queue, const Compare& compare)
+	{
+#ifdef __PARALLEL_RENDER__
+		const auto chunks = min(thread_pool::instance().workers(), queue.size() / wavefront_path_grain + 1);
+#else
+		const auto chunks = static_cast<size_t>(1);
+#endif
+
+		if (chunks <= 1) { std::sort(queue.begin(), queue.end(), compare); return; }
+
+		const auto chunk_begin = [&](size_t chunk) { return queue.begin() + queue.size() * min(chunk, chunks) / chunks; };
+
+		thread_pool::instance().parallel_for(chunks, 1, [&](size_t begin, size_t end)
+			{
+				for (auto chunk = begin; chunk < end; chunk++) std::sort(chunk_begin(chunk), chunk_begin(chunk + 1), compare);
+			});
+
+		for (size_t width = 1; width < chunks; width = width * 2) {
+			thread_pool::instance().parallel_for((chunks + width * 2 - 1) / (width * 2), 1, [&](size_t begin, size_t end)
+				{
+					for (auto merge = begin; merge < end; merge++) {
+						const auto first = merge * width * 2;
+
+						std::inplace_merge(chunk_begin(first), chunk_begin(first + width), chunk_begin(first + width * 2), compare);
+					}
+				});
+		}
+	}
+
+	/*
+	 * wavefront_paths is the state of paths in SoA layout, the i-th element of each array belongs to the path i.
+	 * the paths do not move when we run the stages, the queues only store the indices of paths.
+	 * previous is the last interaction we sampled the scattering functions at and pdf is the pdf of the scattering ray,
+	 * if mis is true, the emitter found by the ray is weighted with them(the bsdf sampling of uniform_sample_one_emitter).
+	 * the shadow ray is traced only if shadow_emitter is not nullptr, if it is not occluded we add shadow_value to value.
+	 */
+	struct wavefront_paths {
+		std::vector<std::optional<surface_interaction>> interactions;
+		std::vector<interaction> previous;
+		std::vector<sampler_group> samplers;
+
+		std::vector<spectrum> value;
+		std::vector<spectrum> beta;
+		std::vector<vector2> position;
+		std::vector<ray> rays;
+		std::vector<real> eta;
+		std::vector<real> pdf;
+		std::vector<size_t> bounces;
+		std::vector<uint8> specular;
+		std::vector<uint8> mis;
+		std::vector<uint8> alive;
+
+		std::vector<std::shared_ptr<const entity>> shadow_emitter;
+		std::vector<spectrum> shadow_value;
+		std::vector<ray> shadow_rays;
+
+		// the keys we sort the paths with, the material of interaction or the emitter of shadow ray
+		std::vector<const void*> keys;
+
+		wavefront_paths() = default;
+
+		explicit wavefront_paths(size_t size);
+	};
+
+	wavefront_paths::wavefront_paths(size_t size) :
+		interactions(size), previous(size), samplers(size), value(size), beta(size), position(size),
+		rays(size), eta(size), pdf(size), bounces(size), specular(size), mis(size), alive(size),
+		shadow_emitter(size), shadow_value(size), shadow_rays(size), keys(size)
+	{
+	}
+
+	constexpr auto wavefront_packet_size = static_cast<size_t>(16);
+
+	// the number of rays we sort and trace together in closest hit stage
+	constexpr auto wavefront_chunk_size = static_cast<size_t>(1 << 14);
+
+	// the greatest multiple of size that is not greater than value, it works for the negative values too
+	inline int wavefront_grid_floor(int value, int size)
+	{
+		return (value >= 0 ? value / size : -((-value + size - 1) / size)) * size;
+	}
+}
+
+rainbow::cpus::integrators::wavefront_path_integrator::wavefront_path_integrator(
+	const std::shared_ptr<sampler2d>& sampler2d,
+	size_t max_depth, real threshold, size_t batch_size) :
+	mSampler2D(sampler2d), mMaxDepth(max_depth), mBatchSize(max(batch_size, static_cast<size_t>(1))), mThreshold(threshold)
+{
+}
+
+void rainbow::cpus::integrators::wavefront_path_integrator::render(
+	const std::shared_ptr<camera>& camera,
+	const std::shared_ptr<scene>& scene)
+{
+	const auto film = camera->film();
+	const auto bound = film->pixels_bound();
+
+	const auto tile_size = 16;
+	const auto block_size = 4;
+
+	const auto samples_per_pixel = mSampler2D->samples_per_pixel();
+
+	struct parallel_input {
+		size_t tile_index;
+
+		// the first path of tile in its batch
+		size_t offset;
+
+		bound2i tile;
+	};
+
+	struct parallel_output {
+		film_tile tile;
+	};
+
+	struct batch_info {
+		size_t begin = 0;
+		size_t end = 0;
+		size_t samples = 0;
+	};
+
+	auto outputs = std::vector<parallel_output>();
+	auto inputs = std::vector<parallel_input>();
+	auto batches = std::vector<batch_info>();
+
+	// the tiles are aligned to the grid of tile size, so the crop window only clips the tiles on its border
+	// and the samples of a pixel are added to the film in the same order
+	for (auto y = wavefront_grid_floor(bound.min.y, tile_size); y < bound.max.y; y += tile_size) {
+		for (auto x = wavefront_grid_floor(bound.min.x, tile_size); x < bound.max.x; x += tile_size) {
+			const auto min_range = vector2i(max(x, bound.min.x), max(y, bound.min.y));
+			const auto max_range = vector2i(min(x + tile_size, bound.max.x), min(y + tile_size, bound.max.y));
+
+			const auto sample_bound = bound2i(min_range, max_range);
+			const auto samples =
+				static_cast<size_t>(max_range.x - min_range.x) *
+				static_cast<size_t>(max_range.y - min_range.y) * samples_per_pixel;
+
+			// a batch has at least one tile, the tiles are added until the samples of batch are more than batch size
+			if (batches.empty() || (batches.back().samples != 0 && batches.back().samples + samples > mBatchSize))
+				batches.push_back({ inputs.size(), inputs.size(), 0 });
+
+			inputs.push_back({ inputs.size(), batches.back().samples, sample_bound });
+			outputs.push_back({ film_tile(sample_bound, film) });
+
+			batches.back().end = inputs.size();
+			batches.back().samples = batches.back().samples + samples;
+		}
+	}
+
+	size_t max_batch_samples = 0;
+
+	for (const auto& batch : batches) max_batch_samples = max(max_batch_samples, batch.samples);
+
+	auto paths = wavefront_paths(max_batch_samples);
+
+	// the samplers of a path are used by one thread at the same time, so each path has its own samplers
+	// they are seeded by the pixel and sample of path when the path is generated, so the batches do not change the image
+	for (size_t index = 0; index < max_batch_samples; index++) {
+		const auto generator = std::make_shared<random_generator>(trace_sample_seed);
+
+		paths.samplers[index] = sampler_group(
+			std::make_shared<random_sampler1d>(samples_per_pixel, generator),
+			std::make_shared<random_sampler2d>(samples_per_pixel, generator));
+	}
+
+	logs::info("start rendering...");
+	logs::info("image min range : x = {0}, y = {1}.", bound.min.x, bound.min.y);
+	logs::info("image max range : x = {0}, y = {1}.", bound.max.x, bound.max.y);
+	logs::info("tile size : width = {0}, height = {1}.", tile_size, tile_size);
+	logs::info("batch size : {0}, batches : {1}.", max_batch_samples, batches.size());
+
+	const auto start_rendering_time = std::chrono::high_resolution_clock::now();
+
+	auto queue = std::vector<uint32>();
+	auto next_queue = std::vector<uint32>();
+
+	for (size_t batch_index = 0; batch_index < batches.size(); batch_index++) {
+		const auto& batch = batches[batch_index];
+
+		// stage 1 : generate the camera rays of batch, the pixels of tile are visited block by block
+		// so the rays in a packet of closest hit stage come from nearby pixels
+		wavefront_for_each(inputs.begin() + batch.begin, inputs.begin() + batch.end, 1, [&](const parallel_input& input)
+			{
+				const auto camera_sampler = mSampler2D->clone(camera_sample_seed);
+
+				auto index = input.offset;
+
+				for (auto block_y = input.tile.min.y; block_y < input.tile.max.y; block_y += block_size) {
+					for (auto block_x = input.tile.min.x; block_x < input.tile.max.x; block_x += block_size) {
+						const auto block_max = vector2i(
+							min(block_x + block_size, input.tile.max.x),
+							min(block_y + block_size, input.tile.max.y));
+
+						for (auto y = block_y; y < block_max.y; y++) {
+							for (auto x = block_x; x < block_max.x; x++) {
+								camera_sampler->start_pixel(vector2i(x, y), 0, camera_sample_seed);
+
+								for (size_t sample = 0; sample < samples_per_pixel; sample++) {
+									camera_sampler->start_sample(sample);
+
+									paths.samplers[index].start_pixel(vector2i(x, y));
+									paths.samplers[index].start_sample(sample);
+
+									paths.position[index] = vector2(x, y) + camera_sampler->next();
+									paths.rays[index] = camera->sample(paths.position[index], camera_sampler->next());
+									paths.value[index] = 0;
+									paths.beta[index] = 1;
+									paths.eta[index] = 1;
+									paths.pdf[index] = 0;
+									paths.bounces[index] = 0;
+									paths.specular[index] = false;
+									paths.mis[index] = false;
+									paths.shadow_emitter[index] = nullptr;
+
+									index++;
+								}
+							}
+						}
+					}
+				}
+			});
+
+		queue.resize(batch.samples);
+
+		std::iota(queue.begin(), queue.end(), static_cast<uint32>(0));
+
+		while (!queue.empty()) {
+			// stage 2 : find the closest interactions
+			intersect_closest(scene, paths, queue);
+
+			// stage 3 : evaluate the materials, the shadow rays and scattering rays are generated
+			evaluate_materials(scene, paths, queue);
+
+			// stage 4 : trace the shadow rays
+			trace_shadow_rays(scene, paths, queue);
+
+			// stage 5 : remove the ended paths, the order of paths in queue is kept
+			next_queue.resize(queue.size());
+			next_queue.erase(std::copy_if(queue.begin(), queue.end(), next_queue.begin(),
+				[&](uint32 index) { return paths.alive[index] != 0; }), next_queue.end());
+
+			std::swap(queue, next_queue);
+		}
+
+		wavefront_for_each(inputs.begin() + batch.begin, inputs.begin() + batch.end, 1, [&](const parallel_input& input)
+			{
+				const auto samples = static_cast<size_t>(input.tile.max.x - input.tile.min.x) *
+					static_cast<size_t>(input.tile.max.y - input.tile.min.y) * samples_per_pixel;
+
+				for (auto index = input.offset; index < input.offset + samples; index++)
+					outputs[input.tile_index].tile.add_sample(paths.position[index], paths.value[index]);
+			});
+
+		logs::info("finish batch {0}, finished {1} / total : {2}", batch_index, batch.end, inputs.size());
+	}
+
+	for (size_t index = 0; index < outputs.size(); index++)
+		film->add_tile(outputs[index].tile);
+
+	const auto end_rendering_time = std::chrono::high_resolution_clock::now();
+
+	logs::info("finish rendering..., time used {0}s.",
+		std::chrono::duration_cast<std::chrono::duration<double>>(end_rendering_time - start_rendering_time).count());
+}
+
+void rainbow::cpus::integrators::wavefront_path_integrator::intersect_closest(
+	const std::shared_ptr<scene>& scene, wavefront_paths& paths, const std::vector<uint32>& queue) const
+{
+	auto chunks = std::vector<size_t>((queue.size() + wavefront_chunk_size - 1) / wavefront_chunk_size);
+
+	std::iota(chunks.begin(), chunks.end(), static_cast<size_t>(0));
+
+	// the rays of secondary bounces are incoherent, the scene sorts the rays of a chunk by their directions and origins
+	// before it traces them in packets, so the nearby rays in packet likely visit the same nodes
+	wavefront_for_each(chunks.begin(), chunks.end(), 1, [&](size_t chunk_index)
+		{
+			const auto begin = chunk_index * wavefront_chunk_size;
+			const auto count = min(queue.size() - begin, wavefront_chunk_size);
+
+			auto interactions = std::vector<std::optional<surface_interaction>>(count);
+			auto rays = std::vector<ray>(count);
+
+			for (size_t index = 0; index < count; index++) rays[index] = paths.rays[queue[begin + index]];
+
+			scene->intersect(rays.data(), count, interactions.data());
+
+			for (size_t index = 0; index < count; index++)
+				paths.interactions[queue[begin + index]] = std::move(interactions[index]);
+		});
+}
+
+void rainbow::cpus::integrators::wavefront_path_integrator::evaluate_materials(
+	const std::shared_ptr<scene>& scene, wavefront_paths& paths, std::vector<uint32>& queue) const
+{
+	// the paths with the same material are evaluated together, so the code and textures of a material stay in cache
+	// the paths without material(miss or invisible entity) have nullptr key
+	wavefront_for_each(queue.begin(), queue.end(), wavefront_path_grain, [&](uint32 index)
+		{
+			const auto& interaction = paths.interactions[index];
+
+			paths.keys[index] = interaction.has_value() ? interaction->entity->component<material>().get() : nullptr;
+		});
+
+	wavefront_sort(queue, [&](uint32 lhs, uint32 rhs)
+		{
+			return std::less<const void*>()(paths.keys[lhs], paths.keys[rhs]) || (paths.keys[lhs] == paths.keys[rhs] && lhs < rhs);
+		});
+
+	wavefront_for_each(queue.begin(), queue.end(), wavefront_path_grain, [&](uint32 index)
+		{
+			evaluate_material(scene, paths, index);
+		});
+}
+
+void rainbow::cpus::integrators::wavefront_path_integrator::evaluate_material(
+	const std::shared_ptr<scene>& scene, wavefront_paths& paths, uint32 index) const
+{
+	const auto& samplers = paths.samplers[index];
+	const auto& interaction = paths.interactions[index];
+	const auto& direction = paths.rays[index].direction;
+
+	const auto bounces = paths.bounces[index];
+	const auto type = scattering_type::all ^ scattering_type::specular;
+
+	auto& value = paths.value[index];
+	auto& beta = paths.beta[index];
+
+	paths.alive[index] = false;
+
+	// the emitter found by the camera ray or specular ray is not sampled by emitter sampling, so we evaluate it without weight
+	// the emitter found by other rays is weighted with the pdf of emitter sampling as uniform_sample_one_emitter does
+	// the path ended at max depth only evaluates the weighted emitter, it is the bsdf sampling of the last bounce
+	const auto emitter_weight = [&](const entity& emitter)
+	{
+		if (bounces < mMaxDepth && (bounces == 0 || paths.specular[index])) return static_cast<real>(1);
+
+		if (!paths.mis[index]) return static_cast<real>(0);
+
+		const auto emitter_pdf = emitter.pdf<emitters::emitter>(paths.previous[index], direction) / scene->emitters().size();
+
+		return emitter_pdf > 0 ? power_heuristic(paths.pdf[index], emitter_pdf) : static_cast<real>(0);
+	};
+
+	if (!interaction.has_value()) {
+		for (const auto& environment : scene->environments()) {
+			const auto weight = emitter_weight(*environment);
+
+			if (weight > 0) value += beta * environment->evaluate<emitter>(interactions::interaction(), -direction) * weight;
+		}
+
+		return;
+	}
+
+	if (interaction->entity->has_component<emitter>()) {
+		const auto weight = emitter_weight(*interaction->entity);
+
+		if (weight > 0) value += beta * interaction->entity->evaluate<emitter>(interaction.value(), -direction) * weight;
+	}
+
+	if (bounces >= mMaxDepth) return;
+
+	// the invisible entity does not change the direction and bounces, the previous interaction is kept for weighting the emitter
+	if (!interaction->entity->has_component<material>()) {
+		paths.rays[index] = interaction->spawn_ray(direction);
+		paths.alive[index] = true;
+
+		return;
+	}
+
+	const auto surface_properties =
+		interaction->entity->component<material>()->build_surface_properties(interaction.value());
+
+	const auto& scattering_functions = surface_properties.functions;
+
+	// emitter sampling, the shadow ray is traced in the next stage with the shadow rays of other paths
+	if (scattering_functions.count(type) != 0 && !scene->emitters().empty()) {
+		auto [emitter, pdf] = uniform_sample_one_emitter(scene, samplers);
+
+		auto emitter_sample = emitter->sample<emitters::emitter>(interaction.value(), samplers.sampler2d->next());
+
+		emitter_sample.pdf = emitter_sample.pdf * pdf;
+
+		if (!emitter_sample.intensity.is_black() && emitter_sample.pdf > 0) {
+			const auto wi = interaction->from_world_to_space(emitter_sample.wi);
+			const auto wo = interaction->from_world_to_space(interaction->wo);
+
+			const auto function_value = scattering_functions.evaluate(wo, wi, type) *
+				math::abs(dot(emitter_sample.wi, interaction->shading_space.z()));
+			const auto function_pdf = scattering_functions.pdf(wo, wi, type);
+
+			if (!function_value.is_black() && function_pdf > 0) {
+				const auto weight = emitter->component<emitters::emitter>()->is_delta() ? 1 :
+					power_heuristic(emitter_sample.pdf, function_pdf);
+
+				paths.shadow_rays[index] = interaction->spawn_ray_to(emitter_sample.interaction.point);
+				paths.shadow_value[index] = beta * function_value * emitter_sample.intensity * weight / emitter_sample.pdf;
+				paths.shadow_emitter[index] = emitter;
+			}
+		}
+	}
+
+	const auto scattering_sample = scattering_functions.sample(interaction.value(), samplers.sampler2d->next());
+
+	if (scattering_sample.value.is_black() || scattering_sample.pdf == 0) return;
+
+	beta *= scattering_sample.value * math::abs(dot(scattering_sample.wi, interaction->shading_space.z())) / scattering_sample.pdf;
+
+	paths.specular[index] = has(scattering_sample.type, scattering_type::specular);
+
+	// the weight of emitter found by the ray uses the pdf of non-specular functions, the same pdf as emitter sampling uses
+	// so the weights of the two strategies sum to 1 in each direction
+	paths.mis[index] = !paths.specular[index] && !scene->emitters().empty();
+	paths.pdf[index] = paths.mis[index] ? scattering_functions.pdf(
+		interaction->from_world_to_space(interaction->wo),
+		interaction->from_world_to_space(scattering_sample.wi), type) : 0;
+	paths.previous[index] = interaction.value();
+
+	if (has(scattering_sample.type, scattering_type::specular | scattering_type::transmission)) {
+		const auto surface_eta = scattering_functions.eta();
+
+		paths.eta[index] = paths.eta[index] * ((dot(interaction->wo, interaction->normal) > 0) ?
+			(surface_eta * surface_eta) : (1 / (surface_eta * surface_eta)));
+	}
+
+	paths.rays[index] = interaction->spawn_ray(scattering_sample.wi);
+
+	// the bssrdf traces its probe rays and shadow ray by itself, the emitter of its ray is evaluated only if it is specular
+	if (surface_properties.bssrdf != nullptr && has(scattering_sample.type, scattering_type::transmission)) {
+		auto tracing_info = path_tracing_info(value, beta, medium_info(), paths.rays[index],
+			paths.eta[index], paths.specular[index] != 0);
+
+		if (!sample_scattering_surface_function(scene, samplers, surface_properties, tracing_info, false)) return;
+
+		value = tracing_info.value;
+		beta = tracing_info.beta;
+
+		paths.rays[index] = tracing_info.ray;
+		paths.specular[index] = tracing_info.specular;
+		paths.mis[index] = false;
+	}
+
+	// russian roulette, if the path is ended the emitter of its ray is not evaluated, it is the same as we end it after
+	// the bsdf sampling of emitter with probability q
+	const auto max_component = (beta * paths.eta[index]).max_component();
+
+	if (max_component < mThreshold && bounces > 3) {
+		const auto q = max(static_cast<real>(0.05), 1 - max_component);
+
+		if (samplers.sampler1d->next().x < q) return;
+
+		beta = beta / (1 - q);
+	}
+
+	paths.bounces[index] = paths.bounces[index] + 1;
+
+	// the path at max depth is traced again only if we need the emitter found by its ray
+	paths.alive[index] = bounces + 1 < mMaxDepth || paths.mis[index];
+}
+
+void rainbow::cpus::integrators::wavefront_path_integrator::trace_shadow_rays(
+	const std::shared_ptr<scene>& scene, wavefront_paths& paths, const std::vector<uint32>& queue) const
+{
+	auto shadow_queue = std::vector<uint32>(queue.size());
+
+	shadow_queue.erase(std::copy_if(queue.begin(), queue.end(), shadow_queue.begin(),
+		[&](uint32 index) { return paths.shadow_emitter[index] != nullptr; }), shadow_queue.end());
+
+	if (shadow_queue.empty()) return;
+
+	// the shadow rays of a packet should ignore the same emitter, so we sort them by emitter
+	// the rays to the same emitter from nearby paths are coherent
+	wavefront_for_each(shadow_queue.begin(), shadow_queue.end(), wavefront_path_grain, [&](uint32 index)
+		{
+			paths.keys[index] = paths.shadow_emitter[index].get();
+		});
+
+	wavefront_sort(shadow_queue, [&](uint32 lhs, uint32 rhs)
+		{
+			return std::less<const void*>()(paths.keys[lhs], paths.keys[rhs]) || (paths.keys[lhs] == paths.keys[rhs] && lhs < rhs);
+		});
+
+	// a packet starts at the first ray of emitter or when the last packet is full
+	// the last element of packets is the end of queue, so the packet i is [packets[i], packets[i + 1])
+	auto packets = std::vector<size_t>();
+
+	for (size_t index = 0; index < shadow_queue.size(); index++) {
+		if (packets.empty() || index - packets.back() == wavefront_packet_size ||
+			paths.keys[shadow_queue[index]] != paths.keys[shadow_queue[packets.back()]])
+			packets.push_back(index);
+	}
+
+	auto packet_indices = std::vector<size_t>(packets.size());
+
+	std::iota(packet_indices.begin(), packet_indices.end(), static_cast<size_t>(0));
+
+	packets.push_back(shadow_queue.size());
+
+	wavefront_for_each(packet_indices.begin(), packet_indices.end(), 16, [&](size_t packet_index)
+		{
+			const auto begin = packets[packet_index];
+			const auto end = packets[packet_index + 1];
+			const auto emitter = paths.shadow_emitter[shadow_queue[begin]];
+
+			ray_packet<wavefront_packet_size> packet;
+
+			for (size_t index = begin; index < end; index++) {
+				packet.rays[index - begin] = paths.shadow_rays[shadow_queue[index]];
+				packet.active = packet.active | (1u << (index - begin));
+			}
+
+			const auto occluded = scene->occluded(packet, emitter);
+
+			for (size_t index = begin; index < end; index++) {
+				const auto path = shadow_queue[index];
+
+				if ((occluded & (1u << (index - begin))) == 0) paths.value[path] += paths.shadow_value[path];
+
+				paths.shadow_emitter[path] = nullptr;
+			}
+		});
+}
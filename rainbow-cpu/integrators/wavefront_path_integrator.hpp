@@ -0,0 +1,53 @@
+#pragma once
+
+#include "integrator.hpp"
+
+namespace rainbow::cpus::integrators {
+
+	struct wavefront_paths;
+
+	/*
+	 * wavefront_path_integrator traces the same paths as path_integrator, but it does not trace a path from camera to the end.
+	 * the paths of a batch(some tiles with at most batch_size samples) are kept in a queue and we run each stage
+	 * over all paths in queue before we run the next stage:
+	 * 1. generate the camera rays of batch.
+	 * 2. find the closest interactions of the rays in queue, the rays are sorted by direction and origin and traced in packets.
+	 * 3. sort the paths by their materials, evaluate the materials, sample the emitters and the scattering functions.
+	 * 4. sort the shadow rays by their emitters and trace them in packets.
+	 * 5. remove the ended paths from queue and go to 2 until the queue is empty.
+	 * the emitter found by the scattering ray is evaluated when we find the interaction of ray at next iteration,
+	 * so we do not trace the extra ray of uniform_sample_one_emitter.
+	 * the samples of camera come from sampler2d, the other samples of a path come from a random sampler,
+	 * because the paths of a pixel are not traced one after another.
+	 * the media are not supported, the bssrdf is sampled when we evaluate the material.
+	 */
+	class wavefront_path_integrator final : public integrator {
+	public:
+		explicit wavefront_path_integrator(
+			const std::shared_ptr<sampler2d>& sampler2d,
+			size_t max_depth = 5, real threshold = 1,
+			size_t batch_size = 1 << 18);
+
+		~wavefront_path_integrator() = default;
+
+		void render(
+			const std::shared_ptr<camera>& camera,
+			const std::shared_ptr<scene>& scene) override;
+	private:
+		void intersect_closest(const std::shared_ptr<scene>& scene, wavefront_paths& paths, const std::vector<uint32>& queue) const;
+
+		void evaluate_materials(const std::shared_ptr<scene>& scene, wavefront_paths& paths, std::vector<uint32>& queue) const;
+
+		void evaluate_material(const std::shared_ptr<scene>& scene, wavefront_paths& paths, uint32 index) const;
+
+		void trace_shadow_rays(const std::shared_ptr<scene>& scene, wavefront_paths& paths, const std::vector<uint32>& queue) const;
+
+		std::shared_ptr<sampler2d> mSampler2D;
+
+		size_t mMaxDepth = 5;
+		size_t mBatchSize = 1 << 18;
+
+		real mThreshold = static_cast<real>(1.0);
+	};
+
+}
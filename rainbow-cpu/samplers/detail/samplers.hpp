@@ -42,4 +42,26 @@ namespace rainbow::cpus::samplers {
 		mCurrentSampleIndex = 0;
 	}
 
+	template <size_t Dimension>
+	void sampler_t<Dimension>::start_pixel(const vector2i& pixel, size_t pass, uint64 seed)
+	{
+		// the samplers of a group share the generator, so the dimension is hashed too
+		mPixelSeed = hash_seed(seed, Dimension, static_cast<uint32>(pixel.x), static_cast<uint32>(pixel.y), pass);
+
+		// the samplers generating the samples of pixel at reset(stratified) use the seed of pixel
+		mRandomGenerator->seed(mPixelSeed);
+
+		reset();
+
+		start_sample(0);
+	}
+
+	template <size_t Dimension>
+	void sampler_t<Dimension>::start_sample(size_t index)
+	{
+		mCurrentSampleIndex = index;
+
+		mRandomGenerator->seed(hash_seed(mPixelSeed, index));
+	}
+
 }
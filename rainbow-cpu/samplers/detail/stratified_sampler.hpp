@@ -81,6 +81,14 @@ namespace rainbow::cpus::samplers {
 		sampler_t<Dimension>::reset();
 	}
 
+	template <size_t Dimension>
+	void stratified_sampler_t<Dimension>::start_sample(size_t index)
+	{
+		mCurrentDimension = 0;
+
+		sampler_t<Dimension>::start_sample(index);
+	}
+
 	template <>
 	inline void stratified_sampler_t<1>::stratified_sample(samples& samples)
 	{
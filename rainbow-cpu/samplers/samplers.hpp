@@ -11,6 +11,7 @@
 namespace rainbow::cpus::samplers {
 
 	using namespace shared;
+	using namespace math;
 	
 	template <size_t Dimension>
 	class sampler_t : public interfaces::noncopyable {
@@ -34,9 +35,18 @@ namespace rainbow::cpus::samplers {
 		virtual void next_sample();
 
 		virtual void reset();
+
+		// start the samples of pixel, the samples only depend on the pixel, pass, seed and the index of sample,
+		// so the pixels can be rendered by any worker in any order and the image is the same
+		virtual void start_pixel(const vector2i& pixel, size_t pass = 0, uint64 seed = 0);
+
+		// jump to the sample of current pixel, the generator is seeded by the hash of pixel and index
+		virtual void start_sample(size_t index);
 	protected:
 		std::shared_ptr<random_generator> mRandomGenerator;
 
+		uint64 mPixelSeed = 0;
+
 		size_t mCurrentSampleIndex;
 		size_t mSamplesPerPixel;
 	};
@@ -24,6 +24,8 @@ namespace rainbow::cpus::samplers {
 		void next_sample() override;
 
 		void reset() override;
+
+		void start_sample(size_t index) override;
 	private:
 		using samples = std::vector<typename sampler_t<Dimension>::sample_type>;
 
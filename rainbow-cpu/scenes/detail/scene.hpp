@@ -0,0 +1,32 @@
+#pragma once
+
+#include "../scene.hpp"
+
+namespace rainbow::cpus::scenes {
+
+	template <size_t N>
+	std::array<std::optional<surface_interaction>, N> scene::intersect(const ray_packet<N>& packet) const
+	{
+		std::array<std::optional<surface_interaction>, N> interactions;
+		std::array<surface_hit, N> hits;
+
+		// we only record the nearest hits when we travel the scene
+		// and build the surface_interaction of the rays that hit something at the end
+		const auto found = intersect(packet.rays.data(), N, packet.active, hits.data());
+
+		for (size_t index = 0; index < N; index++) {
+			if ((found & (1u << index)) == 0) continue;
+
+			interactions[index] = hits[index].entity->compute_surface_interaction(packet.rays[index], hits[index]);
+		}
+
+		return interactions;
+	}
+
+	template <size_t N>
+	uint32 scene::occluded(const ray_packet<N>& packet, const std::shared_ptr<const entity>& ignore) const
+	{
+		return occluded(packet.rays.data(), N, packet.active, ignore.get());
+	}
+
+}
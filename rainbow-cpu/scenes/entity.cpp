@@ -15,46 +15,69 @@ rainbow::cpus::scenes::entity::entity(
 	mShapeInstanceProperties = mShape != nullptr ? mShape->instance(mLocalToWorld) : shape_instance_properties();
 }
 
-std::optional<surface_interaction> rainbow::cpus::scenes::entity::intersect(const ray& ray, size_t index) const
+bool rainbow::cpus::scenes::entity::intersect(const ray& ray, size_t index, surface_hit& hit) const
 {
 	// we do not start intersect test when the entity does not have shape
-	if (!has_component<shape>()) return std::nullopt;
+	if (!has_component<shape>()) return false;
 
 	// transform ray from world to local
 	const auto local_ray = mWorldToLocal(ray);
-	auto interaction = mShape->intersect(local_ray, index);
 
-	// if the ray does not intersect the shape, we return std::nullopt means no intersect
-	if (!interaction.has_value()) return std::nullopt;
+	// if the ray does not intersect the shape, we return false means no intersect
+	if (!mShape->intersect(local_ray, index, hit)) return false;
 
-	interaction->entity = shared_from_this();
+	hit.entity = this;
 
 	// if the transform has scale transform, the length of should be scale too.
 	ray.length = mLocalToWorld(local_ray).length;
 
-	// transform it from local to world space.
-	return mLocalToWorld(interaction.value());
+	return true;
 }
 
-std::optional<surface_interaction> rainbow::cpus::scenes::entity::intersect(const ray& ray) const
+bool rainbow::cpus::scenes::entity::intersect(const ray& ray, surface_hit& hit) const
 {
 	// we do not start intersect test when the entity does not have shape
-	if (!has_component<shape>()) return std::nullopt;
+	if (!has_component<shape>()) return false;
 
 	// transform ray from world to local
 	const auto local_ray = mWorldToLocal(ray);
-	auto interaction = mShape->intersect(local_ray);
 
-	// if the ray does not intersect the shape, we return std::nullopt means no intersect
-	if (!interaction.has_value()) return std::nullopt;
-	
-	interaction->entity = shared_from_this();
-	
+	// if the ray does not intersect the shape, we return false means no intersect
+	if (!mShape->intersect(local_ray, hit)) return false;
+
+	hit.entity = this;
+
 	// if the transform has scale transform, the length of should be scale too.
 	ray.length = mLocalToWorld(local_ray).length;
 
-	// transform it from local to world space.
-	return mLocalToWorld(interaction.value());
+	return true;
+}
+
+surface_interaction rainbow::cpus::scenes::entity::compute_surface_interaction(const ray& ray, const surface_hit& hit) const
+{
+	// the hit.distance is in local space, so we transform the ray into local space again
+	// and only transform the final interaction from local to world space.
+	auto interaction = mShape->compute_surface_interaction(mWorldToLocal(ray), hit);
+
+	interaction.entity = shared_from_this();
+
+	return mLocalToWorld(interaction);
+}
+
+bool rainbow::cpus::scenes::entity::occluded(const ray& ray, size_t index) const
+{
+	// the entity without shape can not block any ray
+	if (!has_component<shape>()) return false;
+
+	return mShape->occluded(mWorldToLocal(ray), index);
+}
+
+bool rainbow::cpus::scenes::entity::occluded(const ray& ray) const
+{
+	// the entity without shape can not block any ray
+	if (!has_component<shape>()) return false;
+
+	return mShape->occluded(mWorldToLocal(ray));
 }
 
 rainbow::core::math::bound3 rainbow::cpus::scenes::entity::bounding_box(size_t index) const
@@ -91,3 +114,12 @@ transform entity::transform() const noexcept
 {
 	return mLocalToWorld;
 }
+
+void rainbow::cpus::scenes::entity::set_transform(const shared::transform& transform)
+{
+	mLocalToWorld = transform;
+	mWorldToLocal = transform.inverse();
+
+	// the area of shape instance may be changed by the scale component of transform
+	mShapeInstanceProperties = mShape != nullptr ? mShape->instance(mLocalToWorld) : shape_instance_properties();
+}
\ No newline at end of file
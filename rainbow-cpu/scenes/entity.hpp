@@ -28,9 +28,15 @@ namespace rainbow::cpus::scenes {
 
 		~entity() = default;
 
-		std::optional<surface_interaction> intersect(const ray& ray, size_t index) const;
+		bool intersect(const ray& ray, size_t index, surface_hit& hit) const;
 
-		std::optional<surface_interaction> intersect(const ray& ray) const;
+		bool intersect(const ray& ray, surface_hit& hit) const;
+
+		surface_interaction compute_surface_interaction(const ray& ray, const surface_hit& hit) const;
+
+		bool occluded(const ray& ray, size_t index) const;
+
+		bool occluded(const ray& ray) const;
 
 		bound3 bounding_box(size_t index) const;
 
@@ -41,6 +47,8 @@ namespace rainbow::cpus::scenes {
 		spectrum power() const noexcept;
 
 		transform transform() const noexcept;
+
+		void set_transform(const shared::transform& transform);
 		
 		template <typename T>
 		spectrum evaluate(const interaction& interaction, const vector3& wi) const;
@@ -1,8 +1,9 @@
 #include "scene.hpp"
 
-#include "../shared/accelerators/bounding_volume_hierarchy.hpp"
+#include "../shared/accelerators/accelerators.hpp"
 
 #include <unordered_map>
+#include <algorithm>
 
 using namespace rainbow::cpus::shared::interactions;
 
@@ -27,88 +28,208 @@ void rainbow::cpus::scenes::scene::add_entity(const std::shared_ptr<entity>& ent
 	mEntities.push_back(entity);
 }
 
-void rainbow::cpus::scenes::scene::build_accelerator()
+void rainbow::cpus::scenes::scene::build_accelerator(const accelerator_type& type)
 {
-	// build the accelerator structure
-	// if there are some shapes that was referenced too many times
-	// we do not put the sub-shapes of shape into accelerator structure because them are too many
-	// int this situation, we create a accelerator structure in the shape
-	// and put the bounding box of entire shape into accelerator structure
-	// to find a sub-shape of shape, we first find the shape in scene's accelerator structure
-	// and find the sub-shape in shape's accelerator structure
-	// for shape that was referenced only few times
-	// we put all sub-shapes into accelerator structure
-	constexpr static size_t reference_threshold = 1;
-	constexpr static size_t sub_shape_threshold = 1 << 17;
-	
-	std::unordered_map<std::shared_ptr<shape>, size_t> reference_count;
-	
-	for (const auto& entity : mEntities) {
-		if (!entity->has_component<shape>()) continue;
+	// build the two-level accelerator structure
+	// each unique shape builds its own accelerator(bottom-level) and we build it only once
+	// the entities that use the same shape are the instances of shape, they share the same bottom-level accelerator
+	// the scene's accelerator(top-level) only stores the instances, so its memory does not depend on the size of shapes
+	std::unordered_map<std::shared_ptr<shape>, uint32> shape_indices;
 
-		reference_count[entity->component<shape>()]++;
-	}
-	
-	std::vector<accelerators::bounding_box<entity_reference>> boxes;
+	mShapes.clear();
+	mShapeBoxes.clear();
+	mInstances.clear();
+	mInstanceIndices.clear();
 
 	for (const auto& entity : mEntities) {
 		if (!entity->has_component<shape>()) continue;
 
 		const auto shape = entity->component<shapes::shape>();
-		const auto count = reference_count.at(shape);
-		
-		if (count <= reference_threshold && count * shape->count() <= sub_shape_threshold) {
-
-			for (size_t index = 0; index < shape->count(); index++)
-				boxes.push_back(accelerators::bounding_box<entity_reference>(
-					std::make_shared<entity_reference>(entity, index)));
-			
-		}else {
-			// if the reference count greater than "reference_threshold"
-			// or the total sub-shapes greater than "sub_shape_threshold"
-			// we will put the entire shape into scene's accelerator structure
-			// and we will build a accelerator in the shape
-			shape->build_accelerator();
-
-			boxes.push_back(accelerators::bounding_box<entity_reference>(
-				std::make_shared<entity_reference>(entity, entity_reference::all)));
+
+		if (shape_indices.find(shape) == shape_indices.end()) {
+			shape_indices.insert({ shape, static_cast<uint32>(mShapes.size()) });
+
+			shape->build_accelerator(type);
+
+			mShapes.push_back(shape);
+			mShapeBoxes.push_back(shape->bounding_box(shared::transform()));
 		}
-		
+
+		mInstanceIndices.insert({ entity.get(), mInstances.size() });
+		mInstances.push_back(shape_instance(entity.get(), shape_indices.at(shape)));
+	}
+
+	std::vector<accelerators::bounding_box<instance_reference>> boxes;
+	std::vector<instance_reference> references;
+
+	boxes.reserve(mInstances.size());
+	references.reserve(mInstances.size());
+
+	for (size_t index = 0; index < mInstances.size(); index++) {
+		references.push_back(instance_reference(this, index));
+		boxes.push_back(accelerators::bounding_box<instance_reference>(references.back(), static_cast<uint32>(index)));
 	}
 	
-	mAccelerator = std::make_shared<bounding_volume_hierarchy<entity_reference>>(boxes);
+	// the top-level accelerator is refittable, so we can update it when the entities move
+	bounding_volume_hierarchy_config config;
+
+	config.refittable = true;
+
+	mAccelerator = create_accelerator(type, references, boxes, config);
+}
+
+void rainbow::cpus::scenes::scene::update_entity_transform(const std::shared_ptr<entity>& entity, const transform& transform)
+{
+	entity->set_transform(transform);
+
+	const auto instance = mInstanceIndices.find(entity.get());
+
+	if (instance == mInstanceIndices.end()) return;
+
+	mInstances[instance->second].local_to_world = transform;
+	mInstances[instance->second].world_to_local = transform.inverse();
+}
+
+void rainbow::cpus::scenes::scene::refit()
+{
+	if (mAccelerator == nullptr) return;
+
+	// the bounding box of instance is computed from the transform in instance
+	// so refitting only visits the instances and the nodes of top-level accelerator
+	mAccelerator->refit();
+
+	mBoundingBox.min = vector3(std::numeric_limits<real>::max());
+	mBoundingBox.max = vector3(std::numeric_limits<real>::lowest());
+
+	for (const auto& box : mAccelerator->boxes()) mBoundingBox.union_it(box.box);
 }
 
 std::optional<surface_interaction> rainbow::cpus::scenes::scene::intersect(const ray& ray) const
 {
-	if (mAccelerator != nullptr) return mAccelerator->intersect(ray);
-	
-	std::optional<surface_interaction> nearest_interaction;
+	// we only record the nearest hit when we travel the scene
+	// and build the surface_interaction of it at the end
+	surface_hit hit;
 
-	for (const auto& entity : mEntities) {
-		const auto interaction = entity->intersect(ray);
+	auto found = false;
 
-		if (interaction.has_value()) nearest_interaction = interaction;
+	if (mAccelerator != nullptr) found = mAccelerator->intersect(ray, hit);
+	else {
+		for (const auto& entity : mEntities) 
+			if (entity->intersect(ray, hit)) found = true;
 	}
 
-	return nearest_interaction;
+	if (!found) return std::nullopt;
+
+	return hit.entity->compute_surface_interaction(ray, hit);
 }
 
 std::optional<surface_interaction> rainbow::cpus::scenes::scene::intersect_with_shadow_ray(const ray& ray) const
 {
-	if (mAccelerator != nullptr) return mAccelerator->intersect_with_shadow_ray(ray);
-	
-	std::optional<surface_interaction> nearest_interaction;
+	surface_hit hit;
+
+	auto found = false;
+
+	if (mAccelerator != nullptr) found = mAccelerator->intersect_with_shadow_ray(ray, hit);
+	else {
+		for (const auto& entity : mEntities) {
+			if (!entity->visible()) continue;
+
+			if (entity->intersect(ray, hit)) found = true;
+		}
+	}
+
+	if (!found) return std::nullopt;
+
+	return hit.entity->compute_surface_interaction(ray, hit);
+}
+
+bool rainbow::cpus::scenes::scene::occluded(const ray& ray, const std::shared_ptr<const entity>& ignore) const
+{
+	// the ray is occluded if any visible entity(except the ignore entity) blocks it
+	// we do not need the nearest one, so we can stop at the first blocker
+	if (mAccelerator != nullptr)
+		return mAccelerator->occluded(ray, [&](const instance_reference& reference) { return reference.instance->mInstances[reference.index].entity == ignore.get(); });
 
 	for (const auto& entity : mEntities) {
-		if (!entity->visible()) continue;
-		
-		const auto interaction = entity->intersect(ray);
+		if (!entity->visible() || entity == ignore) continue;
 
-		if (interaction.has_value()) nearest_interaction = interaction;
+		if (entity->occluded(ray)) return true;
 	}
 
-	return nearest_interaction;
+	return false;
+}
+
+void rainbow::cpus::scenes::scene::intersect(const ray* rays, size_t count, std::optional<surface_interaction>* interactions) const
+{
+	constexpr auto packet_size = static_cast<size_t>(16);
+
+	// the high 32 bits of order are the sort key of ray and the low 32 bits are the index of ray
+	// so the rays with the same key keep their order
+	auto orders = std::vector<uint64>(count);
+
+	for (size_t index = 0; index < count; index++)
+		orders[index] = (static_cast<uint64>(ray_sort_key(rays[index], mBoundingBox)) << 32) | static_cast<uint64>(index);
+
+	std::sort(orders.begin(), orders.end());
+
+	for (size_t begin = 0; begin < count; begin += packet_size) {
+		const auto packet_count = min(count - begin, packet_size);
+
+		std::array<surface_hit, packet_size> hits;
+		std::array<ray, packet_size> packet;
+
+		for (size_t index = 0; index < packet_count; index++)
+			packet[index] = rays[orders[begin + index] & 0xffffffff];
+
+		const auto found = intersect(packet.data(), packet_count, (1u << packet_count) - 1, hits.data());
+
+		for (size_t index = 0; index < packet_count; index++) {
+			const auto ray_index = orders[begin + index] & 0xffffffff;
+
+			if ((found & (1u << index)) == 0) interactions[ray_index] = std::nullopt;
+			else interactions[ray_index] = hits[index].entity->compute_surface_interaction(packet[index], hits[index]);
+		}
+	}
+}
+
+rainbow::core::uint32 rainbow::cpus::scenes::scene::intersect(const ray* rays, size_t count, uint32 active, surface_hit* hits) const
+{
+	if (mAccelerator != nullptr) return mAccelerator->intersect(rays, count, active, hits);
+
+	uint32 found = 0;
+
+	for (size_t index = 0; index < count; index++) {
+		if ((active & (1u << index)) == 0) continue;
+
+		for (const auto& entity : mEntities)
+			if (entity->intersect(rays[index], hits[index])) found = found | (1u << index);
+	}
+
+	return found;
+}
+
+rainbow::core::uint32 rainbow::cpus::scenes::scene::occluded(const ray* rays, size_t count, uint32 active, const entity* ignore) const
+{
+	if (mAccelerator != nullptr)
+		return mAccelerator->occluded(rays, count, active, [&](const instance_reference& reference) { return reference.instance->mInstances[reference.index].entity == ignore; });
+
+	uint32 blocked = 0;
+
+	for (size_t index = 0; index < count; index++) {
+		if ((active & (1u << index)) == 0) continue;
+
+		for (const auto& entity : mEntities) {
+			if (!entity->visible() || entity.get() == ignore) continue;
+
+			if (entity->occluded(rays[index])) {
+				blocked = blocked | (1u << index);
+
+				break;
+			}
+		}
+	}
+
+	return blocked;
 }
 
 spectrum scene::evaluate_media_beam(const std::shared_ptr<sampler1d>& sampler,
@@ -175,22 +296,86 @@ const std::vector<std::shared_ptr<entity>>& rainbow::cpus::scenes::scene::enviro
 	return mEnvironments;
 }
 
-rainbow::cpus::scenes::scene::entity_reference::entity_reference(const std::shared_ptr<scenes::entity>& entity, size_t index) :
-	entity(entity), index(index)
+rainbow::cpus::scenes::scene::shape_instance::shape_instance(const scenes::entity* entity, uint32 shape) :
+	local_to_world(entity->transform()), world_to_local(entity->transform().inverse()), entity(entity), shape(shape),
+	flags(entity->visible() ? visible_flag : 0)
+{
+}
+
+rainbow::cpus::scenes::scene::instance_reference::instance_reference(const scene* instance, size_t index) :
+	instance(instance), index(index)
 {
 }
 
-std::optional<surface_interaction> rainbow::cpus::scenes::scene::entity_reference::intersect(const ray& ray) const
+bool rainbow::cpus::scenes::scene::instance_reference::intersect(const ray& ray, surface_hit& hit) const
 {
-	return index == all ? entity->intersect(ray) : entity->intersect(ray, index);
+	const auto& record = instance->mInstances[index];
+
+	// transform ray from world to the local space of instance and test it with the shared shape
+	const auto local_ray = record.world_to_local(ray);
+
+	if (!instance->mShapes[record.shape]->intersect(local_ray, hit)) return false;
+
+	hit.entity = record.entity;
+
+	// if the transform has scale transform, the length of should be scale too.
+	ray.length = record.local_to_world(local_ray).length;
+
+	return true;
+}
+
+bool rainbow::cpus::scenes::scene::instance_reference::occluded(const ray& ray) const
+{
+	const auto& record = instance->mInstances[index];
+
+	return instance->mShapes[record.shape]->occluded(record.world_to_local(ray));
 }
 
-rainbow::core::math::bound3 rainbow::cpus::scenes::scene::entity_reference::bounding_box() const
+rainbow::core::uint32 rainbow::cpus::scenes::scene::instance_reference::intersect(const ray* rays, size_t count, uint32 active, surface_hit* hits) const
 {
-	return index == all ? entity->bounding_box() : entity->bounding_box(index);
+	const auto& record = instance->mInstances[index];
+
+	// transform the rays into the local space of instance, the shared shape traces them together
+	ray local_rays[max_ray_packet_size];
+
+	for (size_t lane = 0; lane < count; lane++)
+		if ((active & (1u << lane)) != 0) local_rays[lane] = record.world_to_local(rays[lane]);
+
+	const auto found = instance->mShapes[record.shape]->intersect(local_rays, count, active, hits);
+
+	for (size_t lane = 0; lane < count; lane++) {
+		if ((found & (1u << lane)) == 0) continue;
+
+		hits[lane].entity = record.entity;
+
+		rays[lane].length = record.local_to_world(local_rays[lane]).length;
+	}
+
+	return found;
+}
+
+rainbow::core::uint32 rainbow::cpus::scenes::scene::instance_reference::occluded(const ray* rays, size_t count, uint32 active) const
+{
+	const auto& record = instance->mInstances[index];
+
+	ray local_rays[max_ray_packet_size];
+
+	for (size_t lane = 0; lane < count; lane++)
+		if ((active & (1u << lane)) != 0) local_rays[lane] = record.world_to_local(rays[lane]);
+
+	return instance->mShapes[record.shape]->occluded(local_rays, count, active);
+}
+
+rainbow::core::math::bound3 rainbow::cpus::scenes::scene::instance_reference::bounding_box() const
+{
+	const auto& record = instance->mInstances[index];
+
+	// the box of shape in local space is computed once, so we do not need to visit all sub-shapes for each instance
+	// the box transformed from local space may be larger than the box built in world space
+	return record.local_to_world(instance->mShapeBoxes[record.shape]);
 }
 
-bool rainbow::cpus::scenes::scene::entity_reference::visible() const noexcept
+bool rainbow::cpus::scenes::scene::instance_reference::visible() const noexcept
 {
-	return entity->visible();
+	return (instance->mInstances[index].flags & shape_instance::visible_flag) != 0;
 }
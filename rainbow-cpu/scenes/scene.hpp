@@ -1,13 +1,16 @@
 #pragma once
 
 #include "../shared/accelerators/accelerator.hpp"
+#include "../shared/ray_packet.hpp"
 #include "../interfaces/noncopyable.hpp"
 #include "../emitters/emitter.hpp"
 #include "../shapes/shape.hpp"
 #include "entity.hpp"
 
+#include <unordered_map>
 #include <memory>
 #include <vector>
+#include <array>
 
 namespace rainbow::cpus::scenes {
 
@@ -23,12 +26,33 @@ namespace rainbow::cpus::scenes {
 
 		void add_entity(const std::shared_ptr<entity>& entity);
 
-		void build_accelerator();
+		void build_accelerator(const accelerator_type& type = accelerator_type::bounding_volume_hierarchy4);
+
+		// change the transform of entity, the accelerator will not be updated until we refit it
+		void update_entity_transform(const std::shared_ptr<entity>& entity, const transform& transform);
+
+		// update the accelerator after the transform of entities changed, the accelerators of shapes are not changed
+		void refit();
 
 		std::optional<surface_interaction> intersect(const ray& ray) const;
 
 		std::optional<surface_interaction> intersect_with_shadow_ray(const ray& ray) const;
 
+		bool occluded(const ray& ray, const std::shared_ptr<const entity>& ignore = nullptr) const;
+
+		// trace the active rays of packet together, the i-th interaction is the interaction of packet.rays[i]
+		// the rays should be coherent(e.g. the camera rays of nearby pixels), or it is not faster than tracing them one by one
+		template <size_t N>
+		std::array<std::optional<surface_interaction>, N> intersect(const ray_packet<N>& packet) const;
+
+		// the bit i of result is 1 means packet.rays[i] is occluded
+		template <size_t N>
+		uint32 occluded(const ray_packet<N>& packet, const std::shared_ptr<const entity>& ignore = nullptr) const;
+
+		// trace a stream of incoherent rays(e.g. the secondary rays of paths), interactions[i] is the interaction of rays[i]
+		// the rays are sorted by ray_sort_key and traced in packets, so the rays of a packet likely visit the same nodes
+		void intersect(const ray* rays, size_t count, std::optional<surface_interaction>* interactions) const;
+
 		spectrum evaluate_media_beam(
 			const std::shared_ptr<sampler1d>& sampler, const std::tuple<medium_info, interaction>& from, 
 			const interaction& to) const;
@@ -43,23 +67,52 @@ namespace rainbow::cpus::scenes {
 
 		const std::vector<std::shared_ptr<entity>>& environments() const noexcept;
 	private:
-		struct entity_reference {
-			constexpr static inline size_t all = std::numeric_limits<size_t>::max();
+		/*
+		 * shape_instance is the record of entity in the top-level accelerator.
+		 * each unique shape has its own bottom-level accelerator and it is shared by all instances of it,
+		 * so the instance only stores the transform pair of entity, the index of shape in mShapes and the flags.
+		 */
+		struct shape_instance {
+			constexpr static inline uint32 visible_flag = 1 << 0;
 
-			std::shared_ptr<entity> entity;
+			shared::transform local_to_world;
+			shared::transform world_to_local;
+
+			const class entity* entity = nullptr;
+
+			uint32 shape = 0;
+			uint32 flags = 0;
+
+			shape_instance() = default;
+
+			shape_instance(const class entity* entity, uint32 shape);
+		};
 
-			size_t index = all;
+		struct instance_reference {
+			const scene* instance = nullptr;
 
-			entity_reference() = default;
+			size_t index = 0;
 
-			entity_reference(const std::shared_ptr<class entity>& entity, size_t index = all);
+			instance_reference() = default;
 
-			std::optional<surface_interaction> intersect(const ray& ray) const;
+			instance_reference(const scene* instance, size_t index);
+
+			bool intersect(const ray& ray, surface_hit& hit) const;
+
+			bool occluded(const ray& ray) const;
+
+			uint32 intersect(const ray* rays, size_t count, uint32 active, surface_hit* hits) const;
+
+			uint32 occluded(const ray* rays, size_t count, uint32 active) const;
 
 			bound3 bounding_box() const;
 
 			bool visible() const noexcept;
 		};
+
+		uint32 intersect(const ray* rays, size_t count, uint32 active, surface_hit* hits) const;
+
+		uint32 occluded(const ray* rays, size_t count, uint32 active, const entity* ignore) const;
 	private:
 		bound3 mBoundingBox;
 		
@@ -67,7 +120,17 @@ namespace rainbow::cpus::scenes {
 		std::vector<std::shared_ptr<entity>> mEmitters;
 		std::vector<std::shared_ptr<entity>> mEnvironments;
 
-		std::shared_ptr<accelerator<entity_reference>> mAccelerator;
+		// the shapes(bottom-level accelerators) and their bounding boxes in local space
+		std::vector<std::shared_ptr<shape>> mShapes;
+		std::vector<bound3> mShapeBoxes;
+
+		std::vector<shape_instance> mInstances;
+
+		std::unordered_map<const entity*, size_t> mInstanceIndices;
+
+		std::shared_ptr<accelerator<instance_reference>> mAccelerator;
 	};
 
-}
\ No newline at end of file
+}
+
+#include "detail/scene.hpp"
\ No newline at end of file
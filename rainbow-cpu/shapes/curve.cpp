@@ -39,28 +39,6 @@ namespace rainbow::cpus::shapes {
 		};
 	}
 
-	inline std::tuple<vector3, vector3> evaluate_bezier_curve(
-		const std::array<vector3, 4>& control_points, real u)
-	{
-		std::array<vector3, 3> a = {
-			lerp(control_points[0], control_points[1], u),
-			lerp(control_points[1], control_points[2], u),
-			lerp(control_points[2], control_points[3], u)
-		};
-
-		std::array<vector3, 2> b = {
-			lerp(a[0], a[1], u),
-			lerp(a[1], a[2], u)
-		};
-
-		const auto point = lerp(b[0], b[1], u);
-
-		if (length_squared(b[1] - b[0]) > 0)
-			return { point, static_cast<real>(3) * (b[1] - b[0]) };
-		else
-			return { point, control_points[3] - control_points[0] };
-	}
-
 	inline real max_component_in_array(const std::array<vector3, 4>& points, int dimension)
 	{
 		return max(
@@ -91,6 +69,55 @@ namespace rainbow::cpus::shapes {
 
 		return true;
 	}
+
+	inline std::optional<std::tuple<vector3, real, real>> intersect_bezier_segment(const std::array<vector3, 4>& control_points,
+		const std::array<real, 2>& width, const ray& ray, real u_min, real u_max)
+	{
+		// the edge_function0 is the edge_function of begin
+		// the edge_function1 is the edge_function of end
+		// we use edge_function to test the side of the point(0, 0)
+		// we project the curve to the x-y plane(just ignore the z value)
+		// in fact, edge_function is the dot of tangent at begin/end and vector from point to begin/end
+		const auto edge_function0 = 
+			(control_points[1].y - control_points[0].y) * -control_points[0].y + control_points[0].x * (control_points[0].x - control_points[1].x);
+		const auto edge_function1 =
+			(control_points[2].y - control_points[3].y) * -control_points[3].y + control_points[3].x * (control_points[3].x - control_points[2].x);
+
+		if (edge_function0 < 0 || edge_function1 < 0) return std::nullopt;
+
+		// now, we will assume the curve is a segment from begin to end point
+		const auto direction = vector2(control_points[3]) - vector2(control_points[0]);
+		const auto denominator = length_squared(direction);
+
+		if (denominator == 0) return std::nullopt;
+
+		// w is the factor of segment, when w = 0, the point should be begin, when w = 1, the point should be end(parametric form)
+		// the distance of begin point and the projection of (0, 0) in vector(points[3] - points[0]) should be
+		// length((0, 0) - points[0]) * cos theta, where theta is the angle between the vector((0, 0) - points[0]) and vector (points[3] - points[0])
+		// cos theta = ((0, 0) - points[0]) dot (points[3] - points[0]) / (length((0,0) - points[0]) * length(points[3] - points[0]))
+		// so the distance = ((0, 0) - points[0]) dot (points[3] - points[0]) / length(points[3] - points[0])
+		// so the w = distance / length(points[3] - points[0])
+		const auto w = dot(-vector2(control_points[0]), direction) / denominator;
+		const auto u = clamp(lerp(u_min, u_max, w), u_min, u_max);
+
+		const auto width_u = lerp(width[0], width[1], u);
+
+		// now, evaluate the point on the curve using w. the point is in ray space
+		// dp_dw should be the tangent at this point
+		const auto [point, dp_dw] = 
+			evaluate_bezier_curve(control_points, clamp(w, static_cast<real>(0), static_cast<real>(1)));
+
+		const auto distance2 = point.x * point.x + point.y * point.y;
+
+		if (distance2 > width_u * width_u * 0.25f || point.z < 0 || point.z > ray.length) 
+			return std::nullopt;
+
+		const auto distance = sqrt(distance2);
+		const auto edge_function = point.x * dp_dw.y - point.y * dp_dw.x;
+		const auto v = (edge_function > 0) ? static_cast<real>(0.5) + distance / width_u : static_cast<real>(0.5) - distance / width_u;
+
+		return std::make_tuple(point, u, v);
+	}
 }
 
 rainbow::cpus::shapes::curve::curve(
@@ -102,46 +129,26 @@ rainbow::cpus::shapes::curve::curve(
 {
 }
 
-std::optional<surface_interaction> rainbow::cpus::shapes::curve::intersect(const ray& ray, size_t index) const
+bool rainbow::cpus::shapes::curve::intersect(const ray& ray, size_t index, surface_hit& hit) const
 {
-	return intersect(ray);
+	return intersect(ray, hit);
 }
 
-std::optional<surface_interaction> rainbow::cpus::shapes::curve::intersect(const ray& ray) const
+bool rainbow::cpus::shapes::curve::intersect(const ray& ray, surface_hit& hit) const
 {
-	std::array<vector3, 4> points = {
-		blossom_bezier_curve(mControlPoints, { mUMin, mUMin, mUMin }),
-		blossom_bezier_curve(mControlPoints, { mUMin, mUMin, mUMax }),
-		blossom_bezier_curve(mControlPoints, { mUMin, mUMax, mUMax }),
-		blossom_bezier_curve(mControlPoints, { mUMax, mUMax, mUMax }),
-	};
+	const auto [local_to_ray, points] = ray_space(ray);
 
-	auto dx = math::cross(ray.direction, points[3] - points[0]);
+	if (!intersect_curve(points, mWidth, ray, mUMin, mUMax, 5, hit)) return false;
 
-	if (length_squared(dx) == 0) dx = coordinate_system(ray.direction).x();
-
-	// build the transform from ray space to local space, we use left hand(the positive z-axis is the ray)
-	// we also need a vector called up, we use dx = cross(ray.direction, points[3] - points[0])
-	// if the dx is point, we will use coordinate_system to build a dx.
-	const auto local_to_ray = look_at_left_hand(ray.origin, ray.origin + ray.direction, dx);
+	hit.index = 0;
 
-	// transform points from local space to ray space
-	points[0] = transform_point(local_to_ray, points[0]);
-	points[1] = transform_point(local_to_ray, points[1]);
-	points[2] = transform_point(local_to_ray, points[2]);
-	points[3] = transform_point(local_to_ray, points[3]);
-
-	// evaluate the max width of curve
-	const auto max_width = max(
-		lerp(mWidth[0], mWidth[1], mUMin), 
-		lerp(mWidth[0], mWidth[1], mUMax));
-
-	// the bounding box in ray space, so we only need the length of ray(the origin is (0, 0, 0), the direction is (0, 0, 1))
-	// if the bounding box is not intersect with the ray, we return std::nullopt
-	if (!intersect_in_ray_space(points, max_width, ray.length)) 
-		return std::nullopt;
+	return true;
+}
 
-	return recursive_intersect(points, ray, local_to_ray.inverse(), mUMin, mUMax, 5);
+surface_interaction rainbow::cpus::shapes::curve::compute_surface_interaction(const ray& ray, const surface_hit& hit) const
+{
+	// the ray space is only decided by the ray, so it is the same space we found the hit
+	return curve_surface_interaction(mControlPoints, mWidth, std::get<0>(ray_space(ray)), ray, hit, reverse_orientation());
 }
 
 bound3 rainbow::cpus::shapes::curve::bounding_box(const transform& transform, size_t index) const
@@ -249,110 +256,185 @@ real rainbow::cpus::shapes::curve::area() const noexcept
 	return length * width;
 }
 
-void rainbow::cpus::shapes::curve::build_accelerator()
+bool rainbow::cpus::shapes::curve::occluded(const ray& ray, size_t index) const
+{
+	return occluded(ray);
+}
+
+bool rainbow::cpus::shapes::curve::occluded(const ray& ray) const
+{
+	const auto [local_to_ray, points] = ray_space(ray);
+
+	return occluded_curve(points, mWidth, ray, mUMin, mUMax, 5);
+}
+
+void rainbow::cpus::shapes::curve::build_accelerator(const accelerators::accelerator_type& type)
+{
+}
+
+std::tuple<rainbow::cpus::shared::transform, std::array<vector3, 4>> rainbow::cpus::shapes::curve::ray_space(const ray& ray) const
+{
+	return curve_ray_space(blossom_bezier_curve(mControlPoints, mUMin, mUMax), ray);
+}
+
+std::array<rainbow::cpus::shapes::vector3, 4> rainbow::cpus::shapes::blossom_bezier_curve(
+	const std::array<vector3, 4>& control_points, real u_min, real u_max)
+{
+	return {
+		blossom_bezier_curve(control_points, { u_min, u_min, u_min }),
+		blossom_bezier_curve(control_points, { u_min, u_min, u_max }),
+		blossom_bezier_curve(control_points, { u_min, u_max, u_max }),
+		blossom_bezier_curve(control_points, { u_max, u_max, u_max }),
+	};
+}
+
+std::tuple<rainbow::cpus::shapes::vector3, rainbow::cpus::shapes::vector3> rainbow::cpus::shapes::evaluate_bezier_curve(
+	const std::array<vector3, 4>& control_points, real u)
 {
+	std::array<vector3, 3> a = {
+		lerp(control_points[0], control_points[1], u),
+		lerp(control_points[1], control_points[2], u),
+		lerp(control_points[2], control_points[3], u)
+	};
+
+	std::array<vector3, 2> b = {
+		lerp(a[0], a[1], u),
+		lerp(a[1], a[2], u)
+	};
+
+	const auto point = lerp(b[0], b[1], u);
+
+	if (length_squared(b[1] - b[0]) > 0)
+		return { point, static_cast<real>(3) * (b[1] - b[0]) };
+	else
+		return { point, control_points[3] - control_points[0] };
+}
+
+std::tuple<rainbow::cpus::shared::transform, std::array<vector3, 4>> rainbow::cpus::shapes::curve_ray_space(
+	const std::array<vector3, 4>& control_points, const ray& ray)
+{
+	auto points = control_points;
+	auto dx = math::cross(ray.direction, points[3] - points[0]);
+
+	if (length_squared(dx) == 0) dx = coordinate_system(ray.direction).x();
+
+	// build the transform from ray space to local space, we use left hand(the positive z-axis is the ray)
+	// we also need a vector called up, we use dx = cross(ray.direction, points[3] - points[0])
+	// if the dx is point, we will use coordinate_system to build a dx.
+	const auto local_to_ray = look_at_left_hand(ray.origin, ray.origin + ray.direction, dx);
+
+	// transform points from local space to ray space
+	points[0] = transform_point(local_to_ray, points[0]);
+	points[1] = transform_point(local_to_ray, points[1]);
+	points[2] = transform_point(local_to_ray, points[2]);
+	points[3] = transform_point(local_to_ray, points[3]);
+
+	return { local_to_ray, points };
 }
 
-std::optional<surface_interaction> rainbow::cpus::shapes::curve::recursive_intersect(
-	const std::array<vector3, 4>& control_points, const ray& ray,
-	const transform& ray_to_local, real u_min, real u_max, size_t depth) const
+bool rainbow::cpus::shapes::intersect_curve(const std::array<vector3, 4>& control_points, const std::array<real, 2>& width,
+	const ray& ray, real u_min, real u_max, size_t depth, surface_hit& hit)
 {
+	// find the max width of this part of curve
+	const auto max_width = max(
+		lerp(width[0], width[1], u_min),
+		lerp(width[0], width[1], u_max));
+
+	// the bounding box in ray space, so we only need the length of ray(the origin is (0, 0, 0), the direction is (0, 0, 1))
+	// if the bounding box is not intersect with the ray, we return false
+	if (!intersect_in_ray_space(control_points, max_width, ray.length))
+		return false;
+
 	if (depth > 0) {
 		const auto points = subdivide_bezier_curve(control_points);
 
 		std::array<real, 3> u = { u_min, (u_min + u_max) * 0.5f, u_max };
 
-		std::optional<surface_interaction> nearest_interaction = std::nullopt;
-		
+		auto found = false;
+
 		// loop the segments of curve(divide them into two part)
+		// the ray.length is updated when we find a nearer hit
 		for (size_t index = 0; index < 2; index++) {
-			// find the max_width of this segment of curve
-			const auto max_width = max(
-				lerp(mWidth[0], mWidth[1], u[index + 0]),
-				lerp(mWidth[0], mWidth[1], u[index + 1]));
-
 			std::array<vector3, 4> sub_points = {
 				points[index * 3 + 0], points[index * 3 + 1],
 				points[index * 3 + 2], points[index * 3 + 3]
 			};
 
-			// if the ray is not intersect with curve segment we just continue
-			if (!intersect_in_ray_space(sub_points, max_width, ray.length))
-				continue;
-
-			// now, intersect the sub-curve
-			const auto interaction = recursive_intersect(sub_points, ray, ray_to_local,
-				u[index + 0], u[index + 1], depth - 1);
-
-			if (interaction.has_value()) nearest_interaction = interaction;
+			if (intersect_curve(sub_points, width, ray, u[index + 0], u[index + 1], depth - 1, hit)) found = true;
 		}
 
-		return nearest_interaction;
+		return found;
 	}
 
 	// the case depth = 0
+	const auto segment = intersect_bezier_segment(control_points, width, ray, u_min, u_max);
 
-	// the edge_function0 is the edge_function of begin
-	// the edge_function1 is the edge_function of end
-	// we use edge_function to test the side of the point(0, 0)
-	// we project the curve to the x-y plane(just ignore the z value)
-	// in fact, edge_function is the dot of tangent at begin/end and vector from point to begin/end
-	const auto edge_function0 = 
-		(control_points[1].y - control_points[0].y) * -control_points[0].y + control_points[0].x * (control_points[0].x - control_points[1].x);
-	const auto edge_function1 =
-		(control_points[2].y - control_points[3].y) * -control_points[3].y + control_points[3].x * (control_points[3].x - control_points[2].x);
+	if (!segment.has_value()) return false;
 
-	if (edge_function0 < 0 || edge_function1 < 0) return std::nullopt;
+	const auto [point, u, v] = segment.value();
 
-	// now, we will assume the curve is a segment from begin to end point
-	const auto direction = vector2(control_points[3]) - vector2(control_points[0]);
-	const auto denominator = length_squared(direction);
+	// update the length of ray, it is the length of vector((0, 0) - point)
+	ray.length = length(point);
 
-	if (denominator == 0) return std::nullopt;
+	hit.parameters = vector2(u, v);
+	hit.distance = ray.length;
 
-	// w is the factor of segment, when w = 0, the point should be begin, when w = 1, the point should be end(parametric form)
-	// the distance of begin point and the projection of (0, 0) in vector(points[3] - points[0]) should be
-	// length((0, 0) - points[0]) * cos theta, where theta is the angle between the vector((0, 0) - points[0]) and vector (points[3] - points[0])
-	// cos theta = ((0, 0) - points[0]) dot (points[3] - points[0]) / (length((0,0) - points[0]) * length(points[3] - points[0]))
-	// so the distance = ((0, 0) - points[0]) dot (points[3] - points[0]) / length(points[3] - points[0])
-	// so the w = distance / length(points[3] - points[0])
-	const auto w = dot(-vector2(control_points[0]), direction) / denominator;
-	const auto u = clamp(lerp(u_min, u_max, w), u_min, u_max);
+	return true;
+}
 
-	const auto width = lerp(mWidth[0], mWidth[1], u);
+bool rainbow::cpus::shapes::occluded_curve(const std::array<vector3, 4>& control_points, const std::array<real, 2>& width,
+	const ray& ray, real u_min, real u_max, size_t depth)
+{
+	const auto max_width = max(
+		lerp(width[0], width[1], u_min),
+		lerp(width[0], width[1], u_max));
+
+	if (!intersect_in_ray_space(control_points, max_width, ray.length))
+		return false;
+
+	// the case depth = 0, we only need to know whether the ray hits the segment
+	if (depth == 0) return intersect_bezier_segment(control_points, width, ray, u_min, u_max).has_value();
 
-	// now, evaluate the point on the curve using w. the point is in ray space
-	// dp_dw should be the tangent at this point
-	const auto [point, dp_dw] = 
-		evaluate_bezier_curve(control_points, clamp(w, static_cast<real>(0), static_cast<real>(1)));
+	const auto points = subdivide_bezier_curve(control_points);
+
+	std::array<real, 3> u = { u_min, (u_min + u_max) * 0.5f, u_max };
+
+	// loop the segments of curve, any segment blocks the ray means the ray is occluded
+	for (size_t index = 0; index < 2; index++) {
+		std::array<vector3, 4> sub_points = {
+			points[index * 3 + 0], points[index * 3 + 1],
+			points[index * 3 + 2], points[index * 3 + 3]
+		};
 
-	const auto distance2 = point.x * point.x + point.y * point.y;
+		if (occluded_curve(sub_points, width, ray, u[index + 0], u[index + 1], depth - 1)) return true;
+	}
 
-	if (distance2 > width * width * 0.25f || point.z < 0 || point.z > ray.length) 
-		return std::nullopt;
+	return false;
+}
 
-	const auto distance = sqrt(distance2);
-	const auto edge_function = point.x * dp_dw.y - point.y * dp_dw.x;
-	const auto v = (edge_function > 0) ? static_cast<real>(0.5) + distance / width : static_cast<real>(0.5) - distance / width;
+rainbow::cpus::shared::interactions::surface_interaction rainbow::cpus::shapes::curve_surface_interaction(
+	const std::array<vector3, 4>& control_points, const std::array<real, 2>& width,
+	const transform& local_to_ray, const ray& ray, const surface_hit& hit, bool reverse_orientation)
+{
+	const auto u = hit.parameters.x;
+	const auto v = hit.parameters.y;
+	const auto width_u = lerp(width[0], width[1], u);
 
 	// evaluate the dp_du and local_point
-	const auto [local_point, dp_du] = evaluate_bezier_curve(mControlPoints, u);
+	const auto [local_point, dp_du] = evaluate_bezier_curve(control_points, u);
 
 	// because the curve is the cylinder mode, the normal is not always same
 	// transform the dp_du from local space to ray space, and build dp_dv plane
-	const auto dp_du_plane = transform_vector(ray_to_local.inverse(), dp_du);
-	const auto dp_dv_plane = normalize(vector3(-dp_du_plane.y, dp_du_plane.x, 0)) * width;
+	const auto dp_du_plane = transform_vector(local_to_ray, dp_du);
+	const auto dp_dv_plane = normalize(vector3(-dp_du_plane.y, dp_du_plane.x, 0)) * width_u;
 
 	// now, we can use v to find the angle the dp_dv plane should rotate
 	const auto theta = lerp(static_cast<real>(-90), static_cast<real>(90), v);
 	const auto rotate = shared::rotate(-theta, dp_du_plane);
 
-	const auto dp_dv = transform_vector(ray_to_local, transform_vector(rotate, dp_dv_plane));
+	const auto dp_dv = transform_vector(local_to_ray.inverse(), transform_vector(rotate, dp_dv_plane));
 	const auto normal =
-		reverse_orientation() ? -normalize(math::cross(dp_du, dp_dv)) : normalize(math::cross(dp_du, dp_dv));
-
-	// update the length of ray, it is the length of vector((0, 0) - point)
-	ray.length = length(point);
+		reverse_orientation ? -normalize(math::cross(dp_du, dp_dv)) : normalize(math::cross(dp_du, dp_dv));
 
 	// use local_point as the point of interaction
 	return surface_interaction(
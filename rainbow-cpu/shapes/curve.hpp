@@ -3,6 +3,7 @@
 #include "shape.hpp"
 
 #include <array>
+#include <tuple>
 
 namespace rainbow::cpus::shapes {
 
@@ -16,9 +17,15 @@ namespace rainbow::cpus::shapes {
 
 		~curve() = default;
 
-		std::optional<surface_interaction> intersect(const ray& ray, size_t index) const override;
+		bool intersect(const ray& ray, size_t index, surface_hit& hit) const override;
 
-		std::optional<surface_interaction> intersect(const ray& ray) const override;
+		bool intersect(const ray& ray, surface_hit& hit) const override;
+
+		surface_interaction compute_surface_interaction(const ray& ray, const surface_hit& hit) const override;
+
+		bool occluded(const ray& ray, size_t index) const override;
+
+		bool occluded(const ray& ray) const override;
 
 		bound3 bounding_box(const transform& transform, size_t index) const override;
 
@@ -36,10 +43,9 @@ namespace rainbow::cpus::shapes {
 
 		real area() const noexcept override;
 
-		void build_accelerator() override;
+		void build_accelerator(const accelerators::accelerator_type& type) override;
 	private:
-		std::optional<surface_interaction> recursive_intersect(const std::array<vector3, 4>& control_points,
-			const ray& ray, const transform& ray_to_local, real u_min, real u_max, size_t depth) const;
+		std::tuple<transform, std::array<vector3, 4>> ray_space(const ray& ray) const;
 	private:
 		std::array<vector3, 4> mControlPoints;
 		std::array<real, 2> mWidth;
@@ -47,5 +53,28 @@ namespace rainbow::cpus::shapes {
 		real mUMin;
 		real mUMax;
 	};
-	
+
+	// the control points of the part of curve in [u_min, u_max]
+	std::array<vector3, 4> blossom_bezier_curve(const std::array<vector3, 4>& control_points, real u_min, real u_max);
+
+	// the point and the tangent of curve at u
+	std::tuple<vector3, vector3> evaluate_bezier_curve(const std::array<vector3, 4>& control_points, real u);
+
+	// transform the control points into the space of ray, the origin is (0, 0, 0) and the direction is (0, 0, 1)
+	std::tuple<transform, std::array<vector3, 4>> curve_ray_space(const std::array<vector3, 4>& control_points, const ray& ray);
+
+	/*
+	 * intersect_curve tests the ray with the part of curve in [u_min, u_max], the control points of the part are in ray space.
+	 * width is the width of whole curve at u = 0 and u = 1. the part is split into 2^depth segments and they are tested as flat ribbons.
+	 * if we find a nearer hit, the ray.length, hit.parameters and hit.distance are updated(hit.index is not).
+	 */
+	bool intersect_curve(const std::array<vector3, 4>& control_points, const std::array<real, 2>& width,
+		const ray& ray, real u_min, real u_max, size_t depth, surface_hit& hit);
+
+	bool occluded_curve(const std::array<vector3, 4>& control_points, const std::array<real, 2>& width,
+		const ray& ray, real u_min, real u_max, size_t depth);
+
+	// build the interaction of hit with the whole curve, local_to_ray is the ray space we found the hit in
+	surface_interaction curve_surface_interaction(const std::array<vector3, 4>& control_points, const std::array<real, 2>& width,
+		const transform& local_to_ray, const ray& ray, const surface_hit& hit, bool reverse_orientation);
 }
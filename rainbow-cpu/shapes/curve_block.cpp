@@ -0,0 +1,91 @@
+#include "curve_block.hpp"
+#include "../shared/simd.hpp"
+
+rainbow::cpus::shapes::curve_block::curve_block()
+{
+	for (size_t axis = 0; axis < 3; axis++) {
+		for (size_t lane = 0; lane < width; lane++) {
+			for (size_t component = 0; component < 3; component++) axes[axis][component][lane] = 0;
+
+			lower[axis][lane] = 0;
+			upper[axis][lane] = 0;
+		}
+	}
+
+	for (size_t lane = 0; lane < width; lane++) segments[lane] = 0;
+}
+
+void rainbow::cpus::shapes::curve_block::set(size_t lane, uint32 segment, const coordinate_system& frame, const bound3& box)
+{
+	for (size_t axis = 0; axis < 3; axis++) {
+		for (size_t component = 0; component < 3; component++)
+			axes[axis][component][lane] = frame.axes[axis][static_cast<int>(component)];
+
+		lower[axis][lane] = box.min[static_cast<int>(axis)];
+		upper[axis][lane] = box.max[static_cast<int>(axis)];
+	}
+
+	segments[lane] = segment;
+}
+
+rainbow::core::uint32 rainbow::cpus::shapes::curve_block::intersect(const ray& ray, real length) const
+{
+	static_assert(width == 4, "the SIMD test of curve_block only support 4 boxes.");
+
+	const auto lanes = (1u << count) - 1;
+
+#if defined(RAINBOW_SSE)
+	auto t_min = _mm_setzero_ps();
+	auto t_max = _mm_set1_ps(length);
+
+	// transform the ray into the frame of each box and do the slab test
+	for (size_t axis = 0; axis < 3; axis++) {
+		const auto ax = _mm_load_ps(axes[axis][0]);
+		const auto ay = _mm_load_ps(axes[axis][1]);
+		const auto az = _mm_load_ps(axes[axis][2]);
+
+		const auto origin = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(ax, _mm_set1_ps(ray.origin.x)),
+			_mm_mul_ps(ay, _mm_set1_ps(ray.origin.y))),
+			_mm_mul_ps(az, _mm_set1_ps(ray.origin.z)));
+
+		const auto direction = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(ax, _mm_set1_ps(ray.direction.x)),
+			_mm_mul_ps(ay, _mm_set1_ps(ray.direction.y))),
+			_mm_mul_ps(az, _mm_set1_ps(ray.direction.z)));
+
+		const auto inv_direction = _mm_div_ps(_mm_set1_ps(1), direction);
+
+		const auto t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(lower[axis]), origin), inv_direction);
+		const auto t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(upper[axis]), origin), inv_direction);
+
+		t_min = _mm_max_ps(t_min, _mm_min_ps(t0, t1));
+		t_max = _mm_min_ps(t_max, _mm_max_ps(t0, t1));
+	}
+
+	return static_cast<uint32>(_mm_movemask_ps(_mm_cmple_ps(t_min, t_max))) & lanes;
+#else
+	uint32 mask = 0;
+
+	for (size_t lane = 0; lane < count; lane++) {
+		real t_min = 0;
+		real t_max = length;
+
+		for (size_t axis = 0; axis < 3; axis++) {
+			const auto frame_axis = vector3(axes[axis][0][lane], axes[axis][1][lane], axes[axis][2][lane]);
+			const auto inv_direction = static_cast<real>(1) / dot(frame_axis, ray.direction);
+			const auto origin = dot(frame_axis, ray.origin);
+
+			const auto t0 = (lower[axis][lane] - origin) * inv_direction;
+			const auto t1 = (upper[axis][lane] - origin) * inv_direction;
+
+			t_min = max(t_min, min(t0, t1));
+			t_max = min(t_max, max(t0, t1));
+		}
+
+		if (t_min <= t_max) mask = mask | (1u << lane);
+	}
+
+	return mask & lanes;
+#endif
+}
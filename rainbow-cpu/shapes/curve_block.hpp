@@ -0,0 +1,36 @@
+#pragma once
+
+#include "../shared/coordinate_system.hpp"
+#include "../shared/ray.hpp"
+
+namespace rainbow::cpus::shapes {
+
+	using namespace shared;
+
+	/*
+	 * curve_block stores the oriented bounding boxes of at most 4 curve segments in SoA layout.
+	 * axes[axis][component][lane] is the component of axis of the box(lane), the box is [lower, upper] in that frame.
+	 * the box of a hair segment is long and thin along the segment, so it is much tighter than the axis-aligned box of it.
+	 * segments[lane] is the index of segment in curve set and count is the number of segments in block.
+	 * we can test the ray with all boxes in block with one SIMD slab test.
+	 */
+	struct alignas(16) curve_block {
+		constexpr static inline size_t width = 4;
+
+		real axes[3][3][width];
+		real lower[3][width];
+		real upper[3][width];
+
+		uint32 segments[width];
+		uint32 count = 0;
+
+		curve_block();
+
+		// box is the bounding box of segment in the frame
+		void set(size_t lane, uint32 segment, const coordinate_system& frame, const bound3& box);
+
+		// the bit i of result is 1 means the ray intersect the box(i) in [0, length]
+		uint32 intersect(const ray& ray, real length) const;
+	};
+
+}
@@ -0,0 +1,371 @@
+#include "curve_set.hpp"
+
+#include "../shared/accelerators/block_hierarchy.hpp"
+#include "../shared/accelerators/accelerators.hpp"
+
+using namespace rainbow::cpus::shared::interactions;
+
+namespace rainbow::cpus::shapes {
+
+	// the frame of oriented box, the z-axis is the chord of segment and the x-axis is the direction the segment bends to
+	inline coordinate_system segment_frame(const std::array<vector3, 4>& control_points)
+	{
+		const auto chord = control_points[3] - control_points[0];
+
+		if (length_squared(chord) == 0) return coordinate_system();
+
+		const auto z = normalize(chord);
+
+		// the offsets of inner control points from the chord, we use the farther one
+		const auto offset1 = (control_points[1] - control_points[0]) - z * dot(control_points[1] - control_points[0], z);
+		const auto offset2 = (control_points[2] - control_points[0]) - z * dot(control_points[2] - control_points[0], z);
+		const auto offset = length_squared(offset1) > length_squared(offset2) ? offset1 : offset2;
+
+		// the segment is straight, any x-axis is fine
+		if (length_squared(offset) == 0) return coordinate_system(z);
+
+		const auto x = normalize(offset);
+
+		return coordinate_system(x, math::cross(z, x), z);
+	}
+
+}
+
+rainbow::cpus::shapes::curve_set::curve_set(
+	const std::vector<vector3>& control_points,
+	const std::vector<real>& widths,
+	size_t split_depth, bool reverse_orientation) :
+	shape(reverse_orientation, control_points.size() / 4),
+	mSplitDepth(std::min(split_depth, max_split_depth))
+{
+	const auto segments = static_cast<size_t>(1) << mSplitDepth;
+
+	mControlPoints.reserve(mCount);
+	mWidths.reserve(mCount);
+	mSegments.reserve(mCount * segments);
+
+	for (size_t index = 0; index < mCount; index++) {
+		mControlPoints.push_back({
+			control_points[index * 4 + 0], control_points[index * 4 + 1],
+			control_points[index * 4 + 2], control_points[index * 4 + 3]
+		});
+
+		mWidths.push_back({ widths[index * 2 + 0], widths[index * 2 + 1] });
+
+		// the segments split the curve as the first levels of recursive intersection do
+		for (size_t part = 0; part < segments; part++) {
+			curve_segment segment;
+
+			segment.u_min = static_cast<real>(part + 0) / segments;
+			segment.u_max = static_cast<real>(part + 1) / segments;
+			segment.curve = static_cast<uint32>(index);
+			segment.control_points = blossom_bezier_curve(mControlPoints.back(), segment.u_min, segment.u_max);
+
+			mSegments.push_back(segment);
+		}
+
+		mArea = mArea + area(index);
+	}
+}
+
+bool rainbow::cpus::shapes::curve_set::intersect(const ray& ray, size_t index, surface_hit& hit) const
+{
+	const auto segments = static_cast<size_t>(1) << mSplitDepth;
+
+	auto found = false;
+
+	for (size_t segment = index * segments; segment < (index + 1) * segments; segment++)
+		if (intersect_with_segment(ray, segment, hit)) found = true;
+
+	return found;
+}
+
+bool rainbow::cpus::shapes::curve_set::intersect(const ray& ray, surface_hit& hit) const
+{
+	if (mAccelerator != nullptr) return mAccelerator->intersect(ray, hit);
+
+	auto found = false;
+
+	for (size_t segment = 0; segment < mSegments.size(); segment++)
+		if (intersect_with_segment(ray, segment, hit)) found = true;
+
+	return found;
+}
+
+rainbow::cpus::shared::interactions::surface_interaction rainbow::cpus::shapes::curve_set::compute_surface_interaction(
+	const ray& ray, const surface_hit& hit) const
+{
+	// the interaction does not depend on the rotation of ray space around the ray,
+	// so we can use the ray space of whole curve instead of the segment we found the hit
+	const auto& control_points = mControlPoints[hit.index];
+
+	const auto local_to_ray = std::get<0>(curve_ray_space(control_points, ray));
+
+	return curve_surface_interaction(control_points, mWidths[hit.index], local_to_ray, ray, hit, reverse_orientation());
+}
+
+bool rainbow::cpus::shapes::curve_set::occluded(const ray& ray, size_t index) const
+{
+	const auto segments = static_cast<size_t>(1) << mSplitDepth;
+
+	for (size_t segment = index * segments; segment < (index + 1) * segments; segment++)
+		if (occluded_with_segment(ray, segment)) return true;
+
+	return false;
+}
+
+bool rainbow::cpus::shapes::curve_set::occluded(const ray& ray) const
+{
+	if (mAccelerator != nullptr) return mAccelerator->occluded(ray, nullptr);
+
+	for (size_t segment = 0; segment < mSegments.size(); segment++)
+		if (occluded_with_segment(ray, segment)) return true;
+
+	return false;
+}
+
+rainbow::core::math::bound3 rainbow::cpus::shapes::curve_set::bounding_box(const transform& transform, size_t index) const
+{
+	const auto segments = static_cast<size_t>(1) << mSplitDepth;
+
+	auto box = segment_bounding_box(transform, index * segments);
+
+	for (size_t segment = index * segments + 1; segment < (index + 1) * segments; segment++)
+		box.union_it(segment_bounding_box(transform, segment));
+
+	return box;
+}
+
+rainbow::core::math::bound3 rainbow::cpus::shapes::curve_set::bounding_box(const transform& transform) const
+{
+	// start from an inverted box, so a set without curves never reads the first curve
+	auto box = bound3();
+
+	box.min = vector3(+std::numeric_limits<real>::infinity());
+	box.max = vector3(-std::numeric_limits<real>::infinity());
+
+	for (size_t index = 0; index < mCount; index++)
+		box.union_it(bounding_box(transform, index));
+
+	return box;
+}
+
+rainbow::cpus::shapes::shape_sample rainbow::cpus::shapes::curve_set::sample(const shape_instance_properties& properties, const vector2& sample) const
+{
+	// not support in this version
+	throw std::exception();
+}
+
+rainbow::core::real rainbow::cpus::shapes::curve_set::pdf(const shape_instance_properties& properties) const
+{
+	// not support in this version
+	throw std::exception();
+}
+
+rainbow::core::real rainbow::cpus::shapes::curve_set::area(const transform& transform, size_t index) const noexcept
+{
+	const auto& control_points = mControlPoints[index];
+
+	real length = 0;
+
+	// the approximate area is the length of control polygon * the average of width, the same as curve
+	for (size_t point = 0; point < 3; point++)
+		length = length + distance(transform_point(transform, control_points[point + 0]), transform_point(transform, control_points[point + 1]));
+
+	return length * (mWidths[index][0] + mWidths[index][1]) * static_cast<real>(0.5);
+}
+
+rainbow::core::real rainbow::cpus::shapes::curve_set::area(const transform& transform) const noexcept
+{
+	real area = 0;
+
+	for (size_t index = 0; index < mCount; index++)
+		area = area + this->area(transform, index);
+
+	return area;
+}
+
+rainbow::core::real rainbow::cpus::shapes::curve_set::area(size_t index) const noexcept
+{
+	return area(transform(), index);
+}
+
+rainbow::core::real rainbow::cpus::shapes::curve_set::area() const noexcept
+{
+	return mArea;
+}
+
+void rainbow::cpus::shapes::curve_set::build_accelerator(const accelerator_type& type)
+{
+	// we only need build it once
+	if (mAccelerator != nullptr) return;
+
+	const auto nodes = build_curve_blocks();
+
+	std::vector<accelerators::bounding_box<curve_block_reference>> block_boxes;
+	std::vector<curve_block_reference> block_references;
+
+	build_references(this, mCurveBlocks.size(), block_references, block_boxes);
+
+	mAccelerator = create_accelerator(type, block_references, block_boxes, nodes);
+}
+
+rainbow::cpus::shapes::curve_set::curve_segment_reference::curve_segment_reference(const curve_set* instance, size_t segment) :
+	instance(instance), segment(segment)
+{
+}
+
+bool rainbow::cpus::shapes::curve_set::curve_segment_reference::intersect(const ray& ray, surface_hit& hit) const
+{
+	return instance->intersect_with_segment(ray, segment, hit);
+}
+
+bool rainbow::cpus::shapes::curve_set::curve_segment_reference::occluded(const ray& ray) const
+{
+	return instance->occluded_with_segment(ray, segment);
+}
+
+rainbow::core::math::bound3 rainbow::cpus::shapes::curve_set::curve_segment_reference::bounding_box() const
+{
+	return instance->segment_bounding_box(transform(), segment);
+}
+
+bool rainbow::cpus::shapes::curve_set::curve_segment_reference::visible() const noexcept
+{
+	return true;
+}
+
+rainbow::cpus::shapes::curve_set::curve_block_reference::curve_block_reference(const curve_set* instance, size_t block) :
+	instance(instance), block(block)
+{
+}
+
+bool rainbow::cpus::shapes::curve_set::curve_block_reference::intersect(const ray& ray, surface_hit& hit) const
+{
+	return instance->intersect_with_block(ray, block, hit);
+}
+
+bool rainbow::cpus::shapes::curve_set::curve_block_reference::occluded(const ray& ray) const
+{
+	return instance->occluded_with_block(ray, block);
+}
+
+rainbow::core::math::bound3 rainbow::cpus::shapes::curve_set::curve_block_reference::bounding_box() const
+{
+	const auto& curve_block = instance->mCurveBlocks[block];
+
+	auto box = instance->segment_bounding_box(transform(), curve_block.segments[0]);
+
+	for (size_t lane = 1; lane < curve_block.count; lane++)
+		box.union_it(instance->segment_bounding_box(transform(), curve_block.segments[lane]));
+
+	return box;
+}
+
+bool rainbow::cpus::shapes::curve_set::curve_block_reference::visible() const noexcept
+{
+	return true;
+}
+
+bool rainbow::cpus::shapes::curve_set::intersect_with_segment(const ray& ray, size_t segment, surface_hit& hit) const
+{
+	const auto& part = mSegments[segment];
+
+	const auto [local_to_ray, points] = curve_ray_space(part.control_points, ray);
+
+	// the segment is the part of curve after mSplitDepth levels of subdivision, so we refine it with the levels left
+	if (!intersect_curve(points, mWidths[part.curve], ray, part.u_min, part.u_max, max_split_depth - mSplitDepth, hit))
+		return false;
+
+	hit.index = part.curve;
+
+	return true;
+}
+
+bool rainbow::cpus::shapes::curve_set::occluded_with_segment(const ray& ray, size_t segment) const
+{
+	const auto& part = mSegments[segment];
+
+	const auto [local_to_ray, points] = curve_ray_space(part.control_points, ray);
+
+	return occluded_curve(points, mWidths[part.curve], ray, part.u_min, part.u_max, max_split_depth - mSplitDepth);
+}
+
+bool rainbow::cpus::shapes::curve_set::intersect_with_block(const ray& ray, size_t block, surface_hit& hit) const
+{
+	const auto& curve_block = mCurveBlocks[block];
+
+	const auto mask = curve_block.intersect(ray, ray.length);
+
+	if (mask == 0) return false;
+
+	auto found = false;
+
+	// only the segments whose oriented box is hit are transformed into ray space and refined
+	// the ray.length is updated by each hit, so the segments after it are refined with the nearer length
+	for (size_t lane = 0; lane < curve_block::width; lane++) {
+		if ((mask & (1u << lane)) == 0) continue;
+
+		if (intersect_with_segment(ray, curve_block.segments[lane], hit)) found = true;
+	}
+
+	return found;
+}
+
+bool rainbow::cpus::shapes::curve_set::occluded_with_block(const ray& ray, size_t block) const
+{
+	const auto& curve_block = mCurveBlocks[block];
+
+	const auto mask = curve_block.intersect(ray, ray.length);
+
+	for (size_t lane = 0; lane < curve_block::width; lane++)
+		if ((mask & (1u << lane)) != 0 && occluded_with_segment(ray, curve_block.segments[lane])) return true;
+
+	return false;
+}
+
+rainbow::core::math::bound3 rainbow::cpus::shapes::curve_set::segment_bounding_box(const transform& transform, size_t segment) const
+{
+	const auto& part = mSegments[segment];
+
+	// the curve is in the convex hull of its control points, so we only need expand the box with the half of max width
+	const auto max_width = max(
+		lerp(mWidths[part.curve][0], mWidths[part.curve][1], part.u_min),
+		lerp(mWidths[part.curve][0], mWidths[part.curve][1], part.u_max));
+
+	auto box = bound3(part.control_points[0], part.control_points[1]);
+
+	box.union_it(part.control_points[2]);
+	box.union_it(part.control_points[3]);
+
+	return transform(bound3(box.min - vector3(max_width * 0.5f), box.max + vector3(max_width * 0.5f)));
+}
+
+std::vector<rainbow::cpus::shared::accelerators::linear_bounding_volume_hierarchy_node> rainbow::cpus::shapes::curve_set::build_curve_blocks()
+{
+	std::vector<accelerators::bounding_box<curve_segment_reference>> boxes;
+	std::vector<curve_segment_reference> references;
+
+	build_references(this, mSegments.size(), references, boxes);
+
+	// the oriented boxes of segments are packed into the blocks
+	return build_block_hierarchy(references, boxes, bounding_volume_hierarchy_config(), mCurveBlocks,
+		[&](curve_block& block, size_t lane, const curve_segment_reference& reference)
+		{
+			const auto& part = mSegments[reference.segment];
+
+			const auto frame = segment_frame(part.control_points);
+
+			const auto max_width = max(
+				lerp(mWidths[part.curve][0], mWidths[part.curve][1], part.u_min),
+				lerp(mWidths[part.curve][0], mWidths[part.curve][1], part.u_max));
+
+			auto box = bound3(world_to_local(frame, part.control_points[0]), world_to_local(frame, part.control_points[1]));
+
+			box.union_it(world_to_local(frame, part.control_points[2]));
+			box.union_it(world_to_local(frame, part.control_points[3]));
+
+			block.set(lane, static_cast<uint32>(reference.segment), frame,
+				bound3(box.min - vector3(max_width * 0.5f), box.max + vector3(max_width * 0.5f)));
+		});
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "../shared/accelerators/bounding_volume_hierarchy.hpp"
+
+#include "curve_block.hpp"
+#include "curve.hpp"
+
+#include <vector>
+#include <array>
+
+namespace rainbow::cpus::shapes {
+
+	using namespace accelerators;
+
+	/*
+	 * curve_set is a shape of many cubic bezier curves(e.g. hair and fur), the curve i is control_points[i * 4 + 0, 1, 2, 3]
+	 * and its width is from widths[i * 2 + 0] at u = 0 to widths[i * 2 + 1] at u = 1.
+	 * each curve is split into 2^split_depth segments when we create the set, each segment has an oriented bounding box
+	 * along it and the hierarchy is built over the segments. the boxes of a leaf are packed into a curve_block,
+	 * so we only transform the curve into ray space and refine it when the ray hits the oriented box of segment.
+	 * the curve is refined to the same depth as curve, so the hits are the same.
+	 */
+	class curve_set final : public shape {
+	public:
+		explicit curve_set(
+			const std::vector<vector3>& control_points,
+			const std::vector<real>& widths,
+			size_t split_depth = 2,
+			bool reverse_orientation = false);
+
+		~curve_set() = default;
+
+		bool intersect(const ray& ray, size_t index, surface_hit& hit) const override;
+
+		bool intersect(const ray& ray, surface_hit& hit) const override;
+
+		surface_interaction compute_surface_interaction(const ray& ray, const surface_hit& hit) const override;
+
+		bool occluded(const ray& ray, size_t index) const override;
+
+		bool occluded(const ray& ray) const override;
+
+		bound3 bounding_box(const transform& transform, size_t index) const override;
+
+		bound3 bounding_box(const transform& transform) const override;
+
+		shape_sample sample(const shape_instance_properties& properties, const vector2& sample) const override;
+
+		real pdf(const shape_instance_properties& properties) const override;
+
+		real area(const transform& transform, size_t index) const noexcept override;
+
+		real area(const transform& transform) const noexcept override;
+
+		real area(size_t index) const noexcept override;
+
+		real area() const noexcept override;
+
+		void build_accelerator(const accelerator_type& type) override;
+	private:
+		struct curve_segment {
+			std::array<vector3, 4> control_points;
+
+			real u_min = 0;
+			real u_max = 1;
+
+			uint32 curve = 0;
+
+			curve_segment() = default;
+		};
+
+		struct curve_segment_reference {
+			const curve_set* instance = nullptr;
+
+			size_t segment = 0;
+
+			curve_segment_reference() = default;
+
+			curve_segment_reference(const curve_set* instance, size_t segment);
+
+			bool intersect(const ray& ray, surface_hit& hit) const;
+
+			bool occluded(const ray& ray) const;
+
+			bound3 bounding_box() const;
+
+			bool visible() const noexcept;
+		};
+
+		struct curve_block_reference {
+			const curve_set* instance = nullptr;
+
+			size_t block = 0;
+
+			curve_block_reference() = default;
+
+			curve_block_reference(const curve_set* instance, size_t block);
+
+			bool intersect(const ray& ray, surface_hit& hit) const;
+
+			bool occluded(const ray& ray) const;
+
+			bound3 bounding_box() const;
+
+			bool visible() const noexcept;
+		};
+
+		bool intersect_with_segment(const ray& ray, size_t segment, surface_hit& hit) const;
+
+		bool occluded_with_segment(const ray& ray, size_t segment) const;
+
+		bool intersect_with_block(const ray& ray, size_t block, surface_hit& hit) const;
+
+		bool occluded_with_block(const ray& ray, size_t block) const;
+
+		bound3 segment_bounding_box(const transform& transform, size_t segment) const;
+
+		std::vector<linear_bounding_volume_hierarchy_node> build_curve_blocks();
+	private:
+		std::shared_ptr<accelerator<curve_block_reference>> mAccelerator;
+
+		std::vector<curve_block> mCurveBlocks;
+		std::vector<curve_segment> mSegments;
+
+		std::vector<std::array<vector3, 4>> mControlPoints;
+		std::vector<std::array<real, 2>> mWidths;
+
+		size_t mSplitDepth = 2;
+
+		real mArea = 0;
+
+		// the depth curve is refined to, the segments are refined with the levels left after splitting
+		constexpr static inline size_t max_split_depth = 5;
+	};
+
+}
@@ -9,12 +9,12 @@ rainbow::cpus::shapes::disk::disk(real radius, real height, bool reverse_orienta
 {
 }
 
-std::optional<surface_interaction> rainbow::cpus::shapes::disk::intersect(const ray& ray, size_t index) const
+bool rainbow::cpus::shapes::disk::intersect(const ray& ray, size_t index, surface_hit& hit) const
 {
-	return intersect(ray);
+	return intersect(ray, hit);
 }
 
-std::optional<surface_interaction> rainbow::cpus::shapes::disk::intersect(const ray& ray) const
+bool rainbow::cpus::shapes::disk::intersect(const ray& ray, surface_hit& hit) const
 {
 	const auto inner_radius = static_cast<real>(0);
 	const auto outer_radius = mRadius;
@@ -23,7 +23,7 @@ std::optional<surface_interaction> rainbow::cpus::shapes::disk::intersect(const
 	// in local space, the disk is in x-y plane
 	// if the direction.z of ray is 0, it means the ray is parallel with disk(or in the same plane)
 	// so it can not intersect with ray
-	if (ray.direction.z == 0) return std::nullopt;
+	if (ray.direction.z == 0) return false;
 
 	// the hit point.z should be mHeight(the z position of disk)
 	// so ray.origin.z + ray.direction.z * t = point.z = mHeight
@@ -31,7 +31,7 @@ std::optional<surface_interaction> rainbow::cpus::shapes::disk::intersect(const
 	const auto t_hit = (mHeight - ray.origin.z) / ray.direction.z;
 
 	// the point is out of ray
-	if (t_hit <= 0 || t_hit >= ray.length) return std::nullopt;
+	if (t_hit <= 0 || t_hit >= ray.length) return false;
 
 	const auto point_hit = ray.origin + ray.direction * t_hit;
 
@@ -41,12 +41,34 @@ std::optional<surface_interaction> rainbow::cpus::shapes::disk::intersect(const
 
 	// the point is not on the disk but on the plane
 	if (distance_2 > outer_radius * outer_radius ||
-		distance_2 < inner_radius * inner_radius) return std::nullopt;
+		distance_2 < inner_radius * inner_radius) return false;
+
+	auto phi = atan2(point_hit.y, point_hit.x);
+
+	if (phi < 0) phi = phi + two_pi<real>();
+	if (phi > phi_max) return false;
+
+	// in this version, we need set the ray.length to t_hit to avoid the ray intersect the objects far from this
+	ray.length = t_hit;
+
+	hit.index = 0;
+	hit.distance = t_hit;
+
+	return true;
+}
+
+surface_interaction rainbow::cpus::shapes::disk::compute_surface_interaction(const ray& ray, const surface_hit& hit) const
+{
+	const auto inner_radius = static_cast<real>(0);
+	const auto outer_radius = mRadius;
+	const auto phi_max = two_pi<real>();
+
+	const auto point_hit = ray.origin + ray.direction * hit.distance;
+	const auto distance_2 = point_hit.x * point_hit.x + point_hit.y * point_hit.y;
 
 	auto phi = atan2(point_hit.y, point_hit.x);
 
 	if (phi < 0) phi = phi + two_pi<real>();
-	if (phi > phi_max) return std::nullopt;
 
 	const auto radius_hit = sqrt(distance_2);
 	const auto u = phi / phi_max;
@@ -56,11 +78,8 @@ std::optional<surface_interaction> rainbow::cpus::shapes::disk::intersect(const
 	const auto dp_dv = vector3(point_hit.x, point_hit.y, 0) * (inner_radius - outer_radius) / radius_hit;
 	const auto normal = 
 		reverse_orientation() ? -normalize(math::cross(dp_du, dp_dv)) : normalize(math::cross(dp_du, dp_dv));
-	
-	// in this version, we need set the ray.length to t_hit to avoid the ray intersect the objects far from this
-	ray.length = t_hit;
 
-	// the entity will be set when entity::intersect called
+	// the entity will be set when entity::compute_surface_interaction called
 	return surface_interaction(
 		nullptr,
 		dp_du, dp_dv,
@@ -71,6 +90,29 @@ std::optional<surface_interaction> rainbow::cpus::shapes::disk::intersect(const
 	);
 }
 
+bool rainbow::cpus::shapes::disk::occluded(const ray& ray, size_t index) const
+{
+	return occluded(ray);
+}
+
+bool rainbow::cpus::shapes::disk::occluded(const ray& ray) const
+{
+	const auto inner_radius = static_cast<real>(0);
+	const auto outer_radius = mRadius;
+
+	if (ray.direction.z == 0) return false;
+
+	const auto t_hit = (mHeight - ray.origin.z) / ray.direction.z;
+
+	if (t_hit <= 0 || t_hit >= ray.length) return false;
+
+	const auto point_hit = ray.origin + ray.direction * t_hit;
+	const auto distance_2 = point_hit.x * point_hit.x + point_hit.y * point_hit.y;
+
+	// because the phi_max is 2 * pi, we only need test the radius of point
+	return distance_2 <= outer_radius * outer_radius && distance_2 >= inner_radius * inner_radius;
+}
+
 rainbow::core::math::bound3 rainbow::cpus::shapes::disk::bounding_box(const transform& transform, size_t index) const
 {
 	return bounding_box(transform);
@@ -125,6 +167,6 @@ rainbow::core::real rainbow::cpus::shapes::disk::area() const noexcept
 	return pi<real>() * mRadius * mRadius;
 }
 
-void rainbow::cpus::shapes::disk::build_accelerator()
+void rainbow::cpus::shapes::disk::build_accelerator(const accelerators::accelerator_type& type)
 {
 }
@@ -10,9 +10,15 @@ namespace rainbow::cpus::shapes {
 
 		~disk() = default;
 
-		std::optional<surface_interaction> intersect(const ray& ray, size_t index) const override;
+		bool intersect(const ray& ray, size_t index, surface_hit& hit) const override;
 
-		std::optional<surface_interaction> intersect(const ray& ray) const override;
+		bool intersect(const ray& ray, surface_hit& hit) const override;
+
+		surface_interaction compute_surface_interaction(const ray& ray, const surface_hit& hit) const override;
+
+		bool occluded(const ray& ray, size_t index) const override;
+
+		bool occluded(const ray& ray) const override;
 
 		bound3 bounding_box(const transform& transform, size_t index) const override;
 
@@ -30,7 +36,7 @@ namespace rainbow::cpus::shapes {
 
 		real area() const noexcept override;
 
-		void build_accelerator() override;
+		void build_accelerator(const accelerators::accelerator_type& type) override;
 	private:
 		real mHeight;
 		real mRadius;
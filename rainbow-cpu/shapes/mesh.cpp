@@ -3,7 +3,12 @@
 #include "../../rainbow-core/shading_function.hpp"
 #include "../../rainbow-core/sample_function.hpp"
 
-#include "../shared/accelerators/bounding_volume_hierarchy.hpp"
+#include "../shared/accelerators/block_hierarchy.hpp"
+#include "../shared/accelerators/accelerators.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
 
 using namespace rainbow::cpus::shared::interactions;
 
@@ -13,7 +18,8 @@ rainbow::cpus::shapes::mesh::mesh(
 	const std::vector<vector3>& normals,
 	const std::vector<vector3>& uvs,
 	const std::vector<unsigned>& indices,
-	bool reverse_orientation) : mesh(nullptr, positions, tangents, normals, uvs, indices, reverse_orientation)
+	bool reverse_orientation, bool reorder_faces) :
+	mesh(nullptr, positions, tangents, normals, uvs, indices, reverse_orientation, reorder_faces)
 {
 }
 
@@ -24,10 +30,19 @@ rainbow::cpus::shapes::mesh::mesh(
 	const std::vector<vector3>& normals, 
 	const std::vector<vector3>& uvs,
 	const std::vector<unsigned>& indices,
-	bool reverse_orientation) : shape(reverse_orientation, indices.size() / 3),
+	bool reverse_orientation, bool reorder_faces) : shape(reverse_orientation, indices.size() / 3),
 	mMask(mask), mPositions(positions), mTangents(tangents), mNormals(normals),
 	mUVs(uvs), mIndices(indices), mArea(0)
 {
+	if (reorder_faces) mesh::reorder_faces();
+
+	if (mMask != nullptr) {
+		mOpacityMicromaps.reserve(mCount);
+
+		for (size_t index = 0; index < mCount; index++)
+			mOpacityMicromaps.push_back(build_opacity_micromap(*mMask, mesh::uvs(index)));
+	}
+
 	mBoundingBox = bounding_box(transform(), 0);
 
 	for (size_t index = 0; index < mCount; index++) {
@@ -37,24 +52,51 @@ rainbow::cpus::shapes::mesh::mesh(
 	}
 }
 
-std::optional<surface_interaction> rainbow::cpus::shapes::mesh::intersect(const ray& ray, size_t index) const
+bool rainbow::cpus::shapes::mesh::intersect(const ray& ray, size_t index, surface_hit& hit) const
 {
-	return intersect_with_triangle(ray, index);
+	return intersect_with_triangle(ray, index, hit);
 }
 
-std::optional<surface_interaction> rainbow::cpus::shapes::mesh::intersect(const ray& ray) const
+bool rainbow::cpus::shapes::mesh::intersect(const ray& ray, surface_hit& hit) const
 {
-	if (mAccelerator != nullptr) return mAccelerator->intersect(ray);
+	if (mAccelerator != nullptr) return mAccelerator->intersect(ray, hit);
 	
-	std::optional<surface_interaction> nearest_interaction;
+	auto found = false;
 
-	for (size_t index = 0; index < mCount; index++) {
-		const auto interaction = intersect_with_triangle(ray, index);
-
-		if (interaction.has_value()) nearest_interaction = interaction;
-	}
+	for (size_t index = 0; index < mCount; index++) 
+		if (intersect_with_triangle(ray, index, hit)) found = true;
 	
-	return nearest_interaction;
+	return found;
+}
+
+bool rainbow::cpus::shapes::mesh::occluded(const ray& ray, size_t index) const
+{
+	return occluded_with_triangle(ray, index);
+}
+
+bool rainbow::cpus::shapes::mesh::occluded(const ray& ray) const
+{
+	if (mAccelerator != nullptr) return mAccelerator->occluded(ray, nullptr);
+
+	for (size_t index = 0; index < mCount; index++) 
+		if (occluded_with_triangle(ray, index)) return true;
+
+	return false;
+}
+
+rainbow::core::uint32 rainbow::cpus::shapes::mesh::intersect(const ray* rays, size_t count, uint32 active, surface_hit* hits) const
+{
+	// the rays travel the hierarchy of mesh together, the blocks are still tested with each ray
+	if (mAccelerator != nullptr) return mAccelerator->intersect(rays, count, active, hits);
+
+	return shape::intersect(rays, count, active, hits);
+}
+
+rainbow::core::uint32 rainbow::cpus::shapes::mesh::occluded(const ray* rays, size_t count, uint32 active) const
+{
+	if (mAccelerator != nullptr) return mAccelerator->occluded(rays, count, active, nullptr);
+
+	return shape::occluded(rays, count, active);
 }
 
 rainbow::core::math::bound3 rainbow::cpus::shapes::mesh::bounding_box(const transform& transform, size_t index) const
@@ -156,19 +198,158 @@ rainbow::core::real rainbow::cpus::shapes::mesh::area() const noexcept
 	return mArea;
 }
 
-void rainbow::cpus::shapes::mesh::build_accelerator()
+void rainbow::cpus::shapes::mesh::build_accelerator(const accelerator_type& type)
 {
 	// we only need build it once
 	if (mAccelerator != nullptr) return;
-	
-	std::vector<accelerators::bounding_box<mesh_reference>> boxes;
+
+	std::vector<linear_bounding_volume_hierarchy_node> nodes;
+	std::string cache_name;
+
+	uint64 cache_hash = 0;
+
+	if (!mCacheDirectory.empty()) {
+		std::stringstream stream;
+
+		cache_hash = mesh_cache::hash(mPositions, mIndices, mSplitMethod);
+
+		stream << std::hex << std::setw(16) << std::setfill('0') << cache_hash;
+
+		cache_name = mCacheDirectory + "/" + stream.str() + ".bvh";
+
+		mCache = std::make_shared<mesh_cache>(cache_name, cache_hash, mIndices.size() / 3);
+
+		if (!mCache->valid()) mCache = nullptr;
+	}
+
+	if (mCache != nullptr) {
+		// the blocks are used in place, only the nodes are copied into the accelerator
+		nodes.assign(mCache->nodes(), mCache->nodes() + mCache->node_count());
+
+		mTriangleBlocks = mCache->blocks();
+		mTriangleBlockCount = mCache->block_count();
+	} else {
+		nodes = build_triangle_blocks();
+
+		mTriangleBlocks = mTriangleBlockStorage.data();
+		mTriangleBlockCount = mTriangleBlockStorage.size();
+
+		if (!cache_name.empty()) mesh_cache::write(cache_name, cache_hash, mIndices.size() / 3, nodes, mTriangleBlockStorage);
+	}
+
+	std::vector<accelerators::bounding_box<triangle_block_reference>> block_boxes;
+	std::vector<triangle_block_reference> block_references;
+
+	build_references(this, mTriangleBlockCount, block_references, block_boxes);
+
+	mAccelerator = create_accelerator(type, block_references, block_boxes, nodes);
+}
+
+void rainbow::cpus::shapes::mesh::set_accelerator_cache(const std::string& directory)
+{
+	mCacheDirectory = directory;
+}
+
+void rainbow::cpus::shapes::mesh::set_accelerator_split_method(const bounding_volume_hierarchy_split_method& method)
+{
+	mSplitMethod = method;
+}
+
+void rainbow::cpus::shapes::mesh::reorder_faces()
+{
+	if (mCount == 0) return;
+
+	// spread the lower 21 bits of value, so there are 2 zero bits between them
+	const auto expand_bits = [](uint64 value)
+	{
+		value = value & 0x1fffff;
+		value = (value | (value << 32)) & 0x1f00000000ffff;
+		value = (value | (value << 16)) & 0x1f0000ff0000ff;
+		value = (value | (value << 8)) & 0x100f00f00f00f00f;
+		value = (value | (value << 4)) & 0x10c30c30c30c30c3;
+		value = (value | (value << 2)) & 0x1249249249249249;
+
+		return value;
+	};
+
+	auto centroids = std::vector<vector3>(mCount);
+	auto centroid_box = bound3();
+
+	centroid_box.min = vector3(std::numeric_limits<real>::max());
+	centroid_box.max = vector3(std::numeric_limits<real>::lowest());
+
+	for (size_t index = 0; index < mCount; index++) {
+		const auto positions = mesh::positions(index);
+
+		centroids[index] = (positions[0] + positions[1] + positions[2]) / static_cast<real>(3);
+		centroid_box.union_it(centroids[index]);
+	}
+
+	// the morton code of centroid in the box of centroids, the face index keeps the order of faces with the same code
+	auto orders = std::vector<std::pair<uint64, uint32>>(mCount);
+
+	const auto morton_scale = static_cast<real>(1 << 21);
+
+	for (size_t index = 0; index < mCount; index++) {
+		uint64 morton = 0;
+
+		for (int axis = 0; axis < 3; axis++) {
+			const auto length = centroid_box.max[axis] - centroid_box.min[axis];
+			const auto offset = length > 0 ? (centroids[index][axis] - centroid_box.min[axis]) / length : static_cast<real>(0);
+			const auto cell = static_cast<uint64>(math::clamp(offset * morton_scale, static_cast<real>(0), morton_scale - 1));
+
+			morton = morton | (expand_bits(cell) << (2 - axis));
+		}
+
+		orders[index] = { morton, static_cast<uint32>(index) };
+	}
+
+	std::sort(orders.begin(), orders.end());
+
+	// the vertex gets its new index when the sorted faces use it first time, the vertices no face uses are put at the end
+	const auto invalid_index = std::numeric_limits<unsigned>::max();
+
+	auto vertex_indices = std::vector<unsigned>(mPositions.size(), invalid_index);
+	auto vertex_orders = std::vector<unsigned>();
+	auto indices = std::vector<unsigned>(mIndices.size());
+
+	vertex_orders.reserve(mPositions.size());
 
 	for (size_t index = 0; index < mCount; index++) {
-		boxes.push_back(accelerators::bounding_box<mesh_reference>(
-			std::make_shared<mesh_reference>(this, index)));
+		for (size_t corner = 0; corner < 3; corner++) {
+			const auto vertex = mIndices[orders[index].second * 3 + corner];
+
+			if (vertex_indices[vertex] == invalid_index) {
+				vertex_indices[vertex] = static_cast<unsigned>(vertex_orders.size());
+				vertex_orders.push_back(vertex);
+			}
+
+			indices[index * 3 + corner] = vertex_indices[vertex];
+		}
 	}
 
-	mAccelerator = std::make_shared<bounding_volume_hierarchy<mesh_reference>>(boxes);
+	for (size_t vertex = 0; vertex < mPositions.size(); vertex++)
+		if (vertex_indices[vertex] == invalid_index) vertex_orders.push_back(static_cast<unsigned>(vertex));
+
+	// the tangents, normals and uvs are optional, they are empty or have the same size as positions
+	const auto reorder_vertices = [&](std::vector<vector3>& values)
+	{
+		if (values.empty()) return;
+
+		auto reordered = std::vector<vector3>(values.size());
+
+		for (size_t index = 0; index < vertex_orders.size(); index++)
+			reordered[index] = values[vertex_orders[index]];
+
+		values = std::move(reordered);
+	};
+
+	reorder_vertices(mPositions);
+	reorder_vertices(mTangents);
+	reorder_vertices(mNormals);
+	reorder_vertices(mUVs);
+
+	mIndices = std::move(indices);
 }
 
 std::array<vector3, 3> rainbow::cpus::shapes::mesh::positions(size_t face) const noexcept
@@ -305,14 +486,19 @@ std::shared_ptr<rainbow::cpus::shapes::mesh> rainbow::cpus::shapes::mesh::create
 	return std::make_shared<mesh>(positions, tangents, normals, uvs, indices, reverse_orientation);
 }
 
-rainbow::cpus::shapes::mesh::mesh_reference::mesh_reference(mesh* const instance, size_t face) :
+rainbow::cpus::shapes::mesh::mesh_reference::mesh_reference(const mesh* instance, size_t face) :
 	instance(instance), face(face)
 {
 }
 
-std::optional<surface_interaction> rainbow::cpus::shapes::mesh::mesh_reference::intersect(const ray& ray) const
+bool rainbow::cpus::shapes::mesh::mesh_reference::intersect(const ray& ray, surface_hit& hit) const
 {
-	return instance->intersect_with_triangle(ray, face);
+	return instance->intersect_with_triangle(ray, face, hit);
+}
+
+bool rainbow::cpus::shapes::mesh::mesh_reference::occluded(const ray& ray) const
+{
+	return instance->occluded_with_triangle(ray, face);
 }
 
 rainbow::core::math::bound3 rainbow::cpus::shapes::mesh::mesh_reference::bounding_box() const
@@ -320,45 +506,107 @@ rainbow::core::math::bound3 rainbow::cpus::shapes::mesh::mesh_reference::boundin
 	return instance->bounding_box(transform(), face);
 }
 
+void rainbow::cpus::shapes::mesh::mesh_reference::split_bounding_box(size_t axis, real position, bound3& left, bound3& right) const
+{
+	const auto positions = instance->positions(face);
+	const auto dimension = static_cast<int>(axis);
+
+	left.min = vector3(+std::numeric_limits<real>::infinity());
+	left.max = vector3(-std::numeric_limits<real>::infinity());
+	right = left;
+
+	// the vertices on each side of plane and the points where the edges cross the plane
+	for (size_t index = 0; index < 3; index++) {
+		const auto& v0 = positions[index];
+		const auto& v1 = positions[(index + 1) % 3];
+
+		if (v0[dimension] <= position) left.union_it(v0);
+		if (v0[dimension] >= position) right.union_it(v0);
+
+		if ((v0[dimension] < position && v1[dimension] > position) || (v0[dimension] > position && v1[dimension] < position)) {
+			auto point = math::lerp(v0, v1, (position - v0[dimension]) / (v1[dimension] - v0[dimension]));
+
+			point[dimension] = position;
+
+			left.union_it(point);
+			right.union_it(point);
+		}
+	}
+}
+
 bool rainbow::cpus::shapes::mesh::mesh_reference::visible() const noexcept
 {
 	return true;
 }
 
-std::optional<surface_interaction> rainbow::cpus::shapes::mesh::intersect_with_triangle(const ray& ray, size_t face) const
+rainbow::cpus::shapes::mesh::triangle_block_reference::triangle_block_reference(const mesh* instance, size_t block) :
+	instance(instance), block(block)
 {
-	const auto positions = mesh::positions(face);
-	const auto uvs = mesh::uvs(face);
+}
 
-	const auto e1 = positions[1] - positions[0];
-	const auto e2 = positions[2] - positions[0];
+bool rainbow::cpus::shapes::mesh::triangle_block_reference::intersect(const ray& ray, surface_hit& hit) const
+{
+	return instance->intersect_with_block(ray, block, hit);
+}
 
-	const auto p_vec = math::cross(ray.direction, e2);
-	const auto t_vec = ray.origin - positions[0];
-	const auto q_vec = math::cross(t_vec, e1);
+bool rainbow::cpus::shapes::mesh::triangle_block_reference::occluded(const ray& ray) const
+{
+	return instance->occluded_with_block(ray, block);
+}
 
-	const auto inv_det = static_cast<real>(1) / dot(e1, p_vec);
+rainbow::core::math::bound3 rainbow::cpus::shapes::mesh::triangle_block_reference::bounding_box() const
+{
+	const auto& triangle_block = instance->mTriangleBlocks[block];
 
-	const auto b1 = dot(t_vec, p_vec) * inv_det;
-	const auto b2 = dot(ray.direction, q_vec) * inv_det;
-	const auto b0 = 1 - b1 - b2;
+	auto box = instance->bounding_box(transform(), triangle_block.faces[0]);
+
+	for (size_t lane = 1; lane < triangle_block.count; lane++)
+		box.union_it(instance->bounding_box(transform(), triangle_block.faces[lane]));
+
+	return box;
+}
+
+bool rainbow::cpus::shapes::mesh::triangle_block_reference::visible() const noexcept
+{
+	return true;
+}
+
+bool rainbow::cpus::shapes::mesh::intersect_with_triangle(const ray& ray, size_t face, surface_hit& hit) const
+{
+	triangle_hit triangle_hit;
+
+	if (!intersect_triangle(triangle_ray(ray), positions(face), ray.length, triangle_hit)) return false;
+
+	// if the mask is not nullptr and the value of mask is 0, it means the ray can pass these point
+	// so we do not record the hit
+	if (transparent(face, triangle_hit.b1, triangle_hit.b2)) return false;
+
+	ray.length = triangle_hit.t;
+
+	hit.index = face;
+	hit.parameters = vector2(triangle_hit.b1, triangle_hit.b2);
+	hit.distance = triangle_hit.t;
+
+	return true;
+}
 
-	const auto t = dot(e2, q_vec) * inv_det;
+surface_interaction rainbow::cpus::shapes::mesh::compute_surface_interaction(const ray& ray, const surface_hit& hit) const
+{
+	const auto face = hit.index;
+	const auto positions = mesh::positions(face);
+	const auto uvs = mesh::uvs(face);
 
-	if (t <= 0 || t >= ray.length) return std::nullopt;
+	const auto e1 = positions[1] - positions[0];
+	const auto e2 = positions[2] - positions[0];
 
-	if (b0 < 0 || b0 > 1) return std::nullopt;
-	if (b1 < 0 || b1 > 1) return std::nullopt;
-	if (b2 < 0 || b2 > 1) return std::nullopt;
+	const auto b1 = hit.parameters.x;
+	const auto b2 = hit.parameters.y;
+	const auto b0 = 1 - b1 - b2;
 
 	const auto point = positions[0] * b0 + positions[1] * b1 + positions[2] * b2;
 	const auto uv = uvs[0] * b0 + uvs[1] * b1 + uvs[2] * b2;
 	const auto normal = reverse_orientation() ? -normalize(math::cross(e1, e2)) : normalize(math::cross(e1, e2));
 
-	// if the mask is not nullptr and the value of mask is 0, it means the ray can pass these point
-	// so we do not return the surface_interaction
-	if (mMask != nullptr && mMask->sample(uv) == 0) return std::nullopt;
-	
 	const auto duv02 = uvs[0] - uvs[2];
 	const auto duv12 = uvs[1] - uvs[2];
 	const auto dp02 = positions[0] - positions[2];
@@ -371,9 +619,6 @@ std::optional<surface_interaction> rainbow::cpus::shapes::mesh::intersect_with_t
 	
 	// when the uv is degenerate, we will use normal to generate a space
 	if (abs(determinant) < 1e-8 || length(math::cross(dp_du, dp_dv)) == 0) {
-		// the triangle is degenerate, we can not intersect it
-		if (length_squared(normal) == 0) return std::nullopt;
-
 		const auto system = coordinate_system(normal);
 
 		dp_du = system.x();
@@ -428,8 +673,6 @@ std::optional<surface_interaction> rainbow::cpus::shapes::mesh::intersect_with_t
 	else
 		shading_space = coordinate_system(shading_space.z());
 
-	ray.length = t;
-	
 	// if the shading_space and normal is not in the same hemisphere
 	// we need reverse the orientation of normal
 	return surface_interaction(
@@ -440,3 +683,90 @@ std::optional<surface_interaction> rainbow::cpus::shapes::mesh::intersect_with_t
 		uv
 	);
 }
+
+bool rainbow::cpus::shapes::mesh::occluded_with_triangle(const ray& ray, size_t face) const
+{
+	// the same test as intersect_with_triangle, but we only need to know whether the triangle blocks the ray
+	// so we do not update the length of ray
+	triangle_hit triangle_hit;
+
+	if (!intersect_triangle(triangle_ray(ray), positions(face), ray.length, triangle_hit)) return false;
+
+	return !transparent(face, triangle_hit.b1, triangle_hit.b2);
+}
+
+bool rainbow::cpus::shapes::mesh::intersect_with_block(const ray& ray, size_t block, surface_hit& hit) const
+{
+	const auto& triangle_block = mTriangleBlocks[block];
+
+	triangle_hit hits[triangle_block::width];
+
+	const auto mask = triangle_block.intersect(triangle_ray(ray), ray.length, hits);
+
+	if (mask == 0) return false;
+
+	auto found = false;
+
+	// the triangles in block may overlap, so we need find the nearest one
+	for (size_t lane = 0; lane < triangle_block::width; lane++) {
+		if ((mask & (1u << lane)) == 0 || hits[lane].t >= ray.length) continue;
+
+		if (transparent(triangle_block.faces[lane], hits[lane].b1, hits[lane].b2)) continue;
+
+		ray.length = hits[lane].t;
+
+		hit.index = triangle_block.faces[lane];
+		hit.parameters = vector2(hits[lane].b1, hits[lane].b2);
+		hit.distance = hits[lane].t;
+
+		found = true;
+	}
+
+	return found;
+}
+
+bool rainbow::cpus::shapes::mesh::occluded_with_block(const ray& ray, size_t block) const
+{
+	const auto& triangle_block = mTriangleBlocks[block];
+
+	triangle_hit hits[triangle_block::width];
+
+	const auto mask = triangle_block.intersect(triangle_ray(ray), ray.length, hits);
+
+	for (size_t lane = 0; lane < triangle_block::width; lane++) 
+		if ((mask & (1u << lane)) != 0 && !transparent(triangle_block.faces[lane], hits[lane].b1, hits[lane].b2)) return true;
+
+	return false;
+}
+
+bool rainbow::cpus::shapes::mesh::transparent(size_t face, real b1, real b2) const
+{
+	if (mMask == nullptr) return false;
+
+	// only the micro triangles that are neither opaque nor transparent need to sample the mask
+	const auto state = mOpacityMicromaps[face].micro_state(b1, b2);
+
+	if (state != opacity_state::unknown) return state == opacity_state::transparent;
+
+	const auto uvs = mesh::uvs(face);
+
+	return mMask->sample(uvs[0] * (1 - b1 - b2) + uvs[1] * b1 + uvs[2] * b2) == 0;
+}
+
+std::vector<rainbow::cpus::shared::accelerators::linear_bounding_volume_hierarchy_node> rainbow::cpus::shapes::mesh::build_triangle_blocks()
+{
+	std::vector<accelerators::bounding_box<mesh_reference>> boxes;
+	std::vector<mesh_reference> references;
+
+	build_references(this, mCount, references, boxes);
+
+	bounding_volume_hierarchy_config config;
+
+	config.split_method = mSplitMethod;
+
+	return build_block_hierarchy(references, boxes, config, mTriangleBlockStorage,
+		[&](triangle_block& block, size_t lane, const mesh_reference& reference)
+		{
+			block.set(lane, static_cast<uint32>(reference.face), positions(reference.face));
+		});
+}
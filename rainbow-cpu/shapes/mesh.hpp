@@ -3,6 +3,9 @@
 #include "../shared/accelerators/accelerator.hpp"
 #include "../textures/texture.hpp"
 
+#include "opacity_micromap.hpp"
+#include "triangle_block.hpp"
+#include "mesh_cache.hpp"
 #include "shape.hpp"
 
 #include <vector>
@@ -13,6 +16,14 @@ namespace rainbow::cpus::shapes {
 	using namespace accelerators;
 	using namespace textures;
 
+	/*
+	 * mesh is a shape of triangles, the face i is the triangle of indices[i * 3 + 0, 1, 2].
+	 * if reorder_faces is true, the faces are sorted by the morton codes of their centroids when we create the mesh
+	 * and the vertices are renumbered in the order the sorted faces use them,
+	 * so the faces of a leaf and the vertices they use are stored together(the meshes exported by tools are not).
+	 * if the mesh has a mask, we build an opacity_micromap for each face when we create the mesh,
+	 * so the mask is only sampled when the hit is in a micro triangle that is neither opaque nor transparent.
+	 */
 	class mesh final : public shape {
 	public:
 		explicit mesh(
@@ -21,7 +32,8 @@ namespace rainbow::cpus::shapes {
 			const std::vector<vector3>& normals,
 			const std::vector<vector3>& uvs,
 			const std::vector<unsigned>& indices,
-			bool reverse_orientation = false);
+			bool reverse_orientation = false,
+			bool reorder_faces = false);
 
 		explicit mesh(
 			const std::shared_ptr<texture2d<real>>& mask,
@@ -30,13 +42,24 @@ namespace rainbow::cpus::shapes {
 			const std::vector<vector3>& normals,
 			const std::vector<vector3>& uvs,
 			const std::vector<unsigned>& indices,
-			bool reverse_orientation = false);
+			bool reverse_orientation = false,
+			bool reorder_faces = false);
 
 		~mesh() = default;
 
-		std::optional<surface_interaction> intersect(const ray& ray, size_t index) const override;
+		bool intersect(const ray& ray, size_t index, surface_hit& hit) const override;
 
-		std::optional<surface_interaction> intersect(const ray& ray) const override;
+		bool intersect(const ray& ray, surface_hit& hit) const override;
+
+		surface_interaction compute_surface_interaction(const ray& ray, const surface_hit& hit) const override;
+
+		bool occluded(const ray& ray, size_t index) const override;
+
+		bool occluded(const ray& ray) const override;
+
+		uint32 intersect(const ray* rays, size_t count, uint32 active, surface_hit* hits) const override;
+
+		uint32 occluded(const ray* rays, size_t count, uint32 active) const override;
 
 		bound3 bounding_box(const transform& transform, size_t index) const override;
 
@@ -54,7 +77,13 @@ namespace rainbow::cpus::shapes {
 
 		real area() const noexcept override;
 
-		void build_accelerator() override;
+		void build_accelerator(const accelerator_type& type) override;
+
+		// the hierarchy and triangle blocks will be loaded from(or saved to) the directory, empty means no cache
+		void set_accelerator_cache(const std::string& directory);
+
+		// spatial_split builds a better hierarchy for long and thin triangles, but it costs more time and memory
+		void set_accelerator_split_method(const bounding_volume_hierarchy_split_method& method);
 
 		std::array<vector3, 3> positions(size_t face) const noexcept;
 
@@ -75,26 +104,76 @@ namespace rainbow::cpus::shapes {
 		static std::shared_ptr<mesh> create_quad(real width, real height, bool reverse_orientation = false);
 	private:
 		struct mesh_reference {
-			mesh* const instance = nullptr;
+			const mesh* instance = nullptr;
 
 			size_t face = 0;
 
 			mesh_reference() = default;
 
-			mesh_reference(mesh* const instance, size_t face);
+			mesh_reference(const mesh* instance, size_t face);
 
-			std::optional<surface_interaction> intersect(const ray& ray) const;
+			bool intersect(const ray& ray, surface_hit& hit) const;
+
+			bool occluded(const ray& ray) const;
 
 			bound3 bounding_box() const;
 
+			void split_bounding_box(size_t axis, real position, bound3& left, bound3& right) const;
+
 			bool visible() const noexcept;
 		};
 
-		std::optional<surface_interaction> intersect_with_triangle(const ray& ray, size_t face) const;
+		struct triangle_block_reference {
+			const mesh* instance = nullptr;
+
+			size_t block = 0;
+
+			triangle_block_reference() = default;
+
+			triangle_block_reference(const mesh* instance, size_t block);
+
+			bool intersect(const ray& ray, surface_hit& hit) const;
+
+			bool occluded(const ray& ray) const;
+
+			bound3 bounding_box() const;
+
+			bool visible() const noexcept;
+		};
+
+		bool intersect_with_triangle(const ray& ray, size_t face, surface_hit& hit) const;
+
+		bool occluded_with_triangle(const ray& ray, size_t face) const;
+
+		bool intersect_with_block(const ray& ray, size_t block, surface_hit& hit) const;
+
+		bool occluded_with_block(const ray& ray, size_t block) const;
+
+		bool transparent(size_t face, real b1, real b2) const;
+
+		std::vector<linear_bounding_volume_hierarchy_node> build_triangle_blocks();
+
+		// sort the faces along the morton curve and renumber the vertices with the order they are used
+		void reorder_faces();
 	private:
-		std::shared_ptr<accelerator<mesh_reference>> mAccelerator;
+		std::shared_ptr<accelerator<triangle_block_reference>> mAccelerator;
 		std::shared_ptr<texture2d<real>> mMask;
 
+		std::vector<opacity_micromap> mOpacityMicromaps;
+
+		std::shared_ptr<mesh_cache> mCache;
+
+		// the blocks are stored in mTriangleBlockStorage or mapped from mCache
+		std::vector<triangle_block> mTriangleBlockStorage;
+
+		const triangle_block* mTriangleBlocks = nullptr;
+
+		size_t mTriangleBlockCount = 0;
+
+		std::string mCacheDirectory;
+
+		bounding_volume_hierarchy_split_method mSplitMethod = bounding_volume_hierarchy_split_method::surface_area_heuristic;
+
 		std::vector<vector3> mPositions;
 		std::vector<vector3> mTangents;
 		std::vector<vector3> mNormals;
@@ -0,0 +1,226 @@
+#include "mesh_cache.hpp"
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <functional>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace rainbow::cpus::shapes {
+
+	constexpr char mesh_cache_magic[8] = { 'R', 'B', 'V', 'H', 'C', 'A', 'C', 'H' };
+
+	constexpr uint64 mesh_cache_alignment = 64;
+
+	inline uint64 align_mesh_cache(uint64 offset)
+	{
+		return (offset + mesh_cache_alignment - 1) / mesh_cache_alignment * mesh_cache_alignment;
+	}
+
+	inline uint64 hash_bytes(uint64 hash, const void* data, size_t size)
+	{
+		const auto bytes = static_cast<const uint8*>(data);
+
+		// FNV-1a
+		for (size_t index = 0; index < size; index++)
+			hash = (hash ^ bytes[index]) * 1099511628211ull;
+
+		return hash;
+	}
+
+	// the temporary file is unique for each process and thread, so the writers of the same cache do not overwrite it
+	inline std::string temporary_mesh_cache_name(const std::string& name)
+	{
+#ifdef _WIN32
+		const auto process = static_cast<uint64>(_getpid());
+#else
+		const auto process = static_cast<uint64>(getpid());
+#endif
+
+		std::stringstream stream;
+
+		stream << name << "." << process << "." << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+
+		return stream.str();
+	}
+	
+}
+
+rainbow::cpus::shapes::mesh_cache::mesh_cache(const std::string& name, uint64 hash, uint64 face_count) :
+	mFile(std::make_unique<core::mapped_file>(name))
+{
+	if (!validate(hash, face_count)) {
+		mFile.reset();
+
+		return;
+	}
+
+	const auto file_header = reinterpret_cast<const header*>(mFile->data());
+
+	mNodes = reinterpret_cast<const linear_bounding_volume_hierarchy_node*>(mFile->data() + file_header->nodes_offset);
+	mBlocks = reinterpret_cast<const triangle_block*>(mFile->data() + file_header->blocks_offset);
+
+	mNodeCount = static_cast<size_t>(file_header->node_count);
+	mBlockCount = static_cast<size_t>(file_header->block_count);
+}
+
+const rainbow::cpus::shared::accelerators::linear_bounding_volume_hierarchy_node* rainbow::cpus::shapes::mesh_cache::nodes() const noexcept
+{
+	return mNodes;
+}
+
+const rainbow::cpus::shapes::triangle_block* rainbow::cpus::shapes::mesh_cache::blocks() const noexcept
+{
+	return mBlocks;
+}
+
+size_t rainbow::cpus::shapes::mesh_cache::node_count() const noexcept
+{
+	return mNodeCount;
+}
+
+size_t rainbow::cpus::shapes::mesh_cache::block_count() const noexcept
+{
+	return mBlockCount;
+}
+
+bool rainbow::cpus::shapes::mesh_cache::valid() const noexcept
+{
+	return mFile != nullptr;
+}
+
+void rainbow::cpus::shapes::mesh_cache::write(const std::string& name, uint64 hash, uint64 face_count,
+	const std::vector<linear_bounding_volume_hierarchy_node>& nodes,
+	const std::vector<triangle_block>& blocks)
+{
+	header file_header;
+
+	std::memset(&file_header, 0, sizeof(header));
+	std::memcpy(file_header.magic, mesh_cache_magic, sizeof(mesh_cache_magic));
+
+	file_header.version = version;
+	file_header.node_size = static_cast<uint32>(sizeof(linear_bounding_volume_hierarchy_node));
+	file_header.block_size = static_cast<uint32>(sizeof(triangle_block));
+	file_header.block_width = static_cast<uint32>(triangle_block::width);
+	file_header.hash = hash;
+	file_header.face_count = face_count;
+	file_header.node_count = nodes.size();
+	file_header.block_count = blocks.size();
+	file_header.nodes_offset = align_mesh_cache(sizeof(header));
+	file_header.blocks_offset = align_mesh_cache(file_header.nodes_offset + nodes.size() * sizeof(linear_bounding_volume_hierarchy_node));
+
+	// write into a temporary file and rename it, so other processes never map a file that is not finished
+	const auto temporary = temporary_mesh_cache_name(name);
+
+	{
+		std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+
+		if (!stream.is_open()) return;
+
+		const char padding[mesh_cache_alignment] = {};
+
+		stream.write(reinterpret_cast<const char*>(&file_header), sizeof(header));
+		stream.write(padding, static_cast<std::streamsize>(file_header.nodes_offset - sizeof(header)));
+		stream.write(reinterpret_cast<const char*>(nodes.data()), static_cast<std::streamsize>(nodes.size() * sizeof(linear_bounding_volume_hierarchy_node)));
+		stream.write(padding, static_cast<std::streamsize>(file_header.blocks_offset - file_header.nodes_offset -
+			nodes.size() * sizeof(linear_bounding_volume_hierarchy_node)));
+		stream.write(reinterpret_cast<const char*>(blocks.data()), static_cast<std::streamsize>(blocks.size() * sizeof(triangle_block)));
+
+		if (!stream.good()) {
+			stream.close();
+			std::remove(temporary.c_str());
+
+			return;
+		}
+	}
+
+	std::remove(name.c_str());
+
+	if (std::rename(temporary.c_str(), name.c_str()) != 0) std::remove(temporary.c_str());
+}
+
+rainbow::core::uint64 rainbow::cpus::shapes::mesh_cache::hash(const std::vector<vector3>& positions, const std::vector<unsigned>& indices,
+	const bounding_volume_hierarchy_split_method& method)
+{
+	// the hierarchy built with different split method is different, so the method is a part of key
+	const uint64 counts[3] = { positions.size(), indices.size(), static_cast<uint64>(method) };
+
+	auto value = 14695981039346656037ull;
+
+	value = hash_bytes(value, counts, sizeof(counts));
+	value = hash_bytes(value, positions.data(), positions.size() * sizeof(vector3));
+	value = hash_bytes(value, indices.data(), indices.size() * sizeof(unsigned));
+
+	return value;
+}
+
+bool rainbow::cpus::shapes::mesh_cache::validate(uint64 hash, uint64 face_count) const
+{
+	if (mFile->data() == nullptr || mFile->size() < sizeof(header)) return false;
+
+	const auto file_header = reinterpret_cast<const header*>(mFile->data());
+
+	if (std::memcmp(file_header->magic, mesh_cache_magic, sizeof(mesh_cache_magic)) != 0) return false;
+
+	if (file_header->version != version ||
+		file_header->node_size != sizeof(linear_bounding_volume_hierarchy_node) ||
+		file_header->block_size != sizeof(triangle_block) ||
+		file_header->block_width != triangle_block::width ||
+		file_header->hash != hash ||
+		file_header->face_count != face_count) return false;
+
+	if (file_header->nodes_offset % mesh_cache_alignment != 0 ||
+		file_header->blocks_offset % mesh_cache_alignment != 0) return false;
+
+	// the counts come from the file, so we check them before computing the end of sections
+	if (file_header->node_count == 0 || file_header->node_count > mFile->size() / sizeof(linear_bounding_volume_hierarchy_node) ||
+		file_header->block_count > mFile->size() / sizeof(triangle_block)) return false;
+
+	if (file_header->nodes_offset + file_header->node_count * sizeof(linear_bounding_volume_hierarchy_node) > mFile->size() ||
+		file_header->blocks_offset + file_header->block_count * sizeof(triangle_block) > mFile->size()) return false;
+
+	const auto nodes = reinterpret_cast<const linear_bounding_volume_hierarchy_node*>(mFile->data() + file_header->nodes_offset);
+
+	// the traversal trusts the offsets of nodes, a broken file should never make it read out of range
+	// the children are after their parent, so the depth of a node is known before we visit it.
+	// the traversal stack has a fixed size, the depth of node must be less than it(the builder limits it too)
+	// and a node can not be the child of two parents, otherwise the hierarchy is not a tree
+	auto depths = std::vector<uint32>(file_header->node_count, 0);
+	auto reached = std::vector<bool>(file_header->node_count, false);
+
+	for (uint64 index = 0; index < file_header->node_count; index++) {
+		const auto& node = nodes[index];
+
+		if (node.is_leaf() && node.offset + static_cast<uint64>(node.count) > file_header->block_count) return false;
+		if (node.is_leaf()) continue;
+
+		if (node.offset <= index || static_cast<uint64>(node.offset) + 1 >= file_header->node_count) return false;
+		if (reached[node.offset] || reached[node.offset + 1]) return false;
+		if (depths[index] + 1 >= BOUNDING_VOLUME_HIERARCHY_STACK_SIZE) return false;
+
+		depths[node.offset] = depths[node.offset + 1] = depths[index] + 1;
+		reached[node.offset] = reached[node.offset + 1] = true;
+	}
+
+	const auto blocks = reinterpret_cast<const triangle_block*>(mFile->data() + file_header->blocks_offset);
+
+	// the faces of blocks index the data of mesh(positions, uvs, opacity micromaps), so they are checked too
+	for (uint64 index = 0; index < file_header->block_count; index++) {
+		const auto& block = blocks[index];
+
+		if (block.count > triangle_block::width) return false;
+
+		for (uint32 lane = 0; lane < block.count; lane++)
+			if (block.faces[lane] >= face_count) return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "../../rainbow-core/mapped_file.hpp"
+
+#include "../shared/accelerators/bounding_volume_hierarchy.hpp"
+
+#include "triangle_block.hpp"
+
+#include <memory>
+#include <string>
+
+namespace rainbow::cpus::shapes {
+
+	using namespace accelerators;
+
+	/*
+	 * mesh_cache is the file of the flattened hierarchy and the triangle blocks built by mesh.
+	 * the file starts with a header(magic, version, the size of structures, the hash of mesh data and the number of faces),
+	 * the nodes and the blocks are stored after the header and each of them is aligned to 64 bytes.
+	 * the file is mapped with read-only access, so the blocks can be used in place without building or copying.
+	 * if the file does not exist, does not match the mesh or has the nodes and blocks out of range, valid() is false.
+	 */
+	class mesh_cache final : public interfaces::noncopyable {
+	public:
+		explicit mesh_cache(const std::string& name, uint64 hash, uint64 face_count);
+
+		~mesh_cache() = default;
+
+		const linear_bounding_volume_hierarchy_node* nodes() const noexcept;
+
+		const triangle_block* blocks() const noexcept;
+
+		size_t node_count() const noexcept;
+
+		size_t block_count() const noexcept;
+
+		bool valid() const noexcept;
+
+		static void write(const std::string& name, uint64 hash, uint64 face_count,
+			const std::vector<linear_bounding_volume_hierarchy_node>& nodes,
+			const std::vector<triangle_block>& blocks);
+
+		static uint64 hash(const std::vector<vector3>& positions, const std::vector<unsigned>& indices,
+			const bounding_volume_hierarchy_split_method& method);
+
+		// increase it when the layout of file or the way we build the hierarchy is changed
+		constexpr static inline uint32 version = 2;
+	private:
+		struct header {
+			char magic[8];
+
+			uint32 version;
+			uint32 node_size;
+			uint32 block_size;
+			uint32 block_width;
+
+			uint64 hash;
+			uint64 face_count;
+			uint64 node_count;
+			uint64 block_count;
+			uint64 nodes_offset;
+			uint64 blocks_offset;
+		};
+
+		bool validate(uint64 hash, uint64 face_count) const;
+
+		std::unique_ptr<core::mapped_file> mFile;
+
+		const linear_bounding_volume_hierarchy_node* mNodes = nullptr;
+		const triangle_block* mBlocks = nullptr;
+
+		size_t mNodeCount = 0;
+		size_t mBlockCount = 0;
+	};
+
+}
@@ -0,0 +1,144 @@
+#include "opacity_micromap.hpp"
+
+#include "../textures/constant_texture.hpp"
+#include "../textures/image_texture.hpp"
+
+namespace rainbow::cpus::shapes {
+
+	inline void texel_range(real lower, real upper, size_t size, size_t& begin, size_t& end)
+	{
+		const auto tile = floor(lower);
+
+		// the uvs are wrapped by the texture, if the range crosses a tile we use all texels
+		if (floor(upper) != tile) { begin = 0; end = size - 1; return; }
+
+		// the same mapping as image_texture::sample, a point uses the texels floor(t) and floor(t) + 1
+		// we expand the range a little, the uv of hit is interpolated and may be out of range a little
+		const auto t_lower = (lower - tile) * size - static_cast<real>(0.5) - static_cast<real>(0.01);
+		const auto t_upper = (upper - tile) * size - static_cast<real>(0.5) + static_cast<real>(0.01);
+
+		begin = static_cast<size_t>(clamp(static_cast<int>(floor(t_lower)), 0, static_cast<int>(size - 1)));
+		end = static_cast<size_t>(clamp(static_cast<int>(floor(t_upper)) + 1, 0, static_cast<int>(size - 1)));
+	}
+
+	inline opacity_state classify_micro_triangle(const image_texture2d<real>& mask, const std::array<vector2, 3>& uvs)
+	{
+		const auto size = mask.size();
+
+		size_t begin_x = 0, end_x = 0, begin_y = 0, end_y = 0;
+
+		texel_range(min(uvs[0].x, min(uvs[1].x, uvs[2].x)), max(uvs[0].x, max(uvs[1].x, uvs[2].x)), size.x, begin_x, end_x);
+		texel_range(min(uvs[0].y, min(uvs[1].y, uvs[2].y)), max(uvs[0].y, max(uvs[1].y, uvs[2].y)), size.y, begin_y, end_y);
+
+		auto has_zero = false;
+		auto has_non_zero = false;
+
+		// the bilinear interpolation of the texels is 0 only if all of them are 0 and
+		// it is greater than 0 if all of them are greater than 0
+		for (size_t y = begin_y; y <= end_y; y++) {
+			for (size_t x = begin_x; x <= end_x; x++) {
+				const auto value = mask.value(mask.index(vector_t<2, size_t>(x, y)));
+
+				if (value < 0) return opacity_state::unknown;
+
+				if (value == 0) has_zero = true; else has_non_zero = true;
+
+				if (has_zero && has_non_zero) return opacity_state::unknown;
+			}
+		}
+
+		return has_zero ? opacity_state::transparent : opacity_state::opaque;
+	}
+
+}
+
+rainbow::cpus::shapes::opacity_state rainbow::cpus::shapes::opacity_micromap::micro_state(real b1, real b2) const noexcept
+{
+	if (state != opacity_state::unknown) return state;
+
+	constexpr auto last = static_cast<int>(segments) - 1;
+
+	const auto u = clamp(b1, static_cast<real>(0), static_cast<real>(1)) * segments;
+	const auto v = clamp(b2, static_cast<real>(0), static_cast<real>(1)) * segments;
+
+	const auto j = clamp(static_cast<int>(floor(v)), 0, last);
+	const auto i = clamp(static_cast<int>(floor(u)), 0, last - j);
+
+	// the point is in the inverted micro triangle if the fractional parts sum to more than 1
+	const auto flip = i + j < last && (u - i) + (v - j) > 1;
+
+	const auto index = micro_triangle(static_cast<size_t>(i), static_cast<size_t>(j), flip);
+
+	return static_cast<opacity_state>((states[index / 32] >> ((index % 32) * 2)) & 3);
+}
+
+void rainbow::cpus::shapes::opacity_micromap::set(size_t micro_triangle, opacity_state state) noexcept
+{
+	const auto shift = (micro_triangle % 32) * 2;
+
+	states[micro_triangle / 32] = (states[micro_triangle / 32] & ~(static_cast<uint64>(3) << shift)) |
+		(static_cast<uint64>(state) << shift);
+}
+
+size_t rainbow::cpus::shapes::opacity_micromap::micro_triangle(size_t i, size_t j, bool flip) noexcept
+{
+	// the row j starts after the rows before it, the row k has 2 * (segments - k) - 1 micro triangles
+	return j * (2 * segments - j) + 2 * i + (flip ? 1 : 0);
+}
+
+rainbow::cpus::shapes::opacity_micromap rainbow::cpus::shapes::build_opacity_micromap(
+	const texture2d<real>& mask, const std::array<vector3, 3>& uvs)
+{
+	opacity_micromap micromap;
+
+	if (const auto constant = dynamic_cast<const constant_texture2d<real>*>(&mask); constant != nullptr) {
+		micromap.state = constant->sample(vector2(0)) == 0 ? opacity_state::transparent : opacity_state::opaque;
+
+		return micromap;
+	}
+
+	const auto image = dynamic_cast<const image_texture2d<real>*>(&mask);
+
+	// we can not classify the other textures, so they are always sampled
+	if (image == nullptr) return micromap;
+
+	const auto uv = [&](real b1, real b2)
+	{
+		const auto point = uvs[0] * (1 - b1 - b2) + uvs[1] * b1 + uvs[2] * b2;
+
+		return vector2(point.x, point.y);
+	};
+
+	constexpr auto segments = opacity_micromap::segments;
+	constexpr auto step = static_cast<real>(1) / segments;
+
+	auto first = true;
+	auto same = true;
+
+	for (size_t j = 0; j < segments; j++) {
+		for (size_t i = 0; i < segments - j; i++) {
+			const auto b1 = i * step, b2 = j * step;
+
+			std::array<std::array<vector2, 3>, 2> micro_uvs = {
+				std::array<vector2, 3>{ uv(b1, b2), uv(b1 + step, b2), uv(b1, b2 + step) },
+				std::array<vector2, 3>{ uv(b1 + step, b2), uv(b1, b2 + step), uv(b1 + step, b2 + step) }
+			};
+
+			// the last micro triangle of row does not have inverted one
+			for (size_t flip = 0; flip < (i + j + 1 < segments ? 2 : 1); flip++) {
+				const auto state = classify_micro_triangle(*image, micro_uvs[flip]);
+
+				micromap.set(opacity_micromap::micro_triangle(i, j, flip != 0), state);
+
+				if (first) micromap.state = state;
+				if (state != micromap.state) same = false;
+
+				first = false;
+			}
+		}
+	}
+
+	if (!same) micromap.state = opacity_state::unknown;
+
+	return micromap;
+}
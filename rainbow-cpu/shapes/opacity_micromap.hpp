@@ -0,0 +1,50 @@
+#pragma once
+
+#include "../textures/texture.hpp"
+
+#include <array>
+
+namespace rainbow::cpus::shapes {
+
+	using namespace textures;
+
+	enum class opacity_state : uint8 {
+		transparent = 0,
+		opaque = 1,
+		unknown = 2
+	};
+
+	/*
+	 * opacity_micromap stores the opacity states of a triangle with alpha mask.
+	 * the triangle is subdivided into segments * segments micro triangles in barycentric space,
+	 * the micro triangles of row j are (i, j), (i + 1, j), (i, j + 1) and (i + 1, j), (i, j + 1), (i + 1, j + 1),
+	 * the states of micro triangles are 2 bits and packed into states.
+	 * state is the state of whole triangle, if it is not unknown we do not need the micro triangles.
+	 * only the micro triangles with unknown state need to sample the mask.
+	 */
+	struct opacity_micromap {
+		constexpr static inline size_t segments = 8;
+		constexpr static inline size_t micro_triangles = segments * segments;
+
+		uint64 states[micro_triangles / 32] = {};
+
+		opacity_state state = opacity_state::unknown;
+
+		opacity_micromap() = default;
+
+		opacity_state micro_state(real b1, real b2) const noexcept;
+
+		void set(size_t micro_triangle, opacity_state state) noexcept;
+
+		static size_t micro_triangle(size_t i, size_t j, bool flip) noexcept;
+	};
+
+	/*
+	 * build_opacity_micromap classifies the micro triangles of triangle with uvs.
+	 * the classification is conservative, a micro triangle is transparent(opaque) only if all texels
+	 * that may be sampled in it are 0(greater than 0), the others are unknown.
+	 * only the image and constant textures can be classified, the micro triangles of other masks are unknown.
+	 */
+	opacity_micromap build_opacity_micromap(const texture2d<real>& mask, const std::array<vector3, 3>& uvs);
+
+}
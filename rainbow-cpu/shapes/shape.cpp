@@ -46,19 +46,48 @@ rainbow::cpus::shapes::shape_sample rainbow::cpus::shapes::shape::sample(const s
 rainbow::core::real rainbow::cpus::shapes::shape::pdf(const shape_instance_properties& properties, const interaction& reference, const vector3& wi) const
 {
 	const auto ray = reference.spawn_ray(wi);
-	const auto interaction = intersect(ray);
+
+	surface_hit hit;
 
 	// if the ray is not intersect the shape, we return 0
-	if (!interaction.has_value()) return 0;
+	if (!intersect(ray, hit)) return 0;
+
+	const auto interaction = compute_surface_interaction(ray, hit);
 
-	const auto pdf = distance_squared(reference.point, interaction->point) /
-		(abs(dot(interaction->normal, -wi)) * properties.area);
+	const auto pdf = distance_squared(reference.point, interaction.point) /
+		(abs(dot(interaction.normal, -wi)) * properties.area);
 
 	if (isinf(pdf)) return 0;
 
 	return pdf;
 }
 
+rainbow::core::uint32 rainbow::cpus::shapes::shape::intersect(const ray* rays, size_t count, uint32 active, surface_hit* hits) const
+{
+	uint32 found = 0;
+
+	for (size_t index = 0; index < count; index++) {
+		if ((active & (1u << index)) == 0) continue;
+
+		if (intersect(rays[index], hits[index])) found = found | (1u << index);
+	}
+
+	return found;
+}
+
+rainbow::core::uint32 rainbow::cpus::shapes::shape::occluded(const ray* rays, size_t count, uint32 active) const
+{
+	uint32 blocked = 0;
+
+	for (size_t index = 0; index < count; index++) {
+		if ((active & (1u << index)) == 0) continue;
+
+		if (occluded(rays[index])) blocked = blocked | (1u << index);
+	}
+
+	return blocked;
+}
+
 rainbow::cpus::shapes::shape_instance_properties rainbow::cpus::shapes::shape::instance(const transform& transform) const noexcept
 {
 	return shape_instance_properties(shared_from_this(), area(transform));
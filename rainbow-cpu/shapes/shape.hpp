@@ -3,6 +3,8 @@
 #include "../interfaces/noncopyable.hpp"
 
 #include "../shared/interactions/surface_interaction.hpp"
+#include "../shared/interactions/surface_hit.hpp"
+#include "../shared/accelerators/accelerator.hpp"
 #include "../shared/transform.hpp"
 #include "../shared/ray.hpp"
 
@@ -50,9 +52,25 @@ namespace rainbow::cpus::shapes {
 
 		~shape() = default;
 
-		virtual std::optional<surface_interaction> intersect(const ray& ray, size_t index) const = 0;
+		// if the ray intersect the shape nearer than ray.length, we update the ray.length and the hit and return true
+		// the hit only records the sub-shape, the parameters and the distance, the entity will be set by entity
+		virtual bool intersect(const ray& ray, size_t index, surface_hit& hit) const = 0;
 
-		virtual std::optional<surface_interaction> intersect(const ray& ray) const = 0;
+		virtual bool intersect(const ray& ray, surface_hit& hit) const = 0;
+
+		// build the surface_interaction in local space from the hit found by the same ray
+		virtual surface_interaction compute_surface_interaction(const ray& ray, const surface_hit& hit) const = 0;
+
+		virtual bool occluded(const ray& ray, size_t index) const = 0;
+
+		virtual bool occluded(const ray& ray) const = 0;
+
+		// trace the rays whose bit is 1 in active together, rays[i] and hits[i] are updated as intersect(rays[i], hits[i])
+		// the bit i of result is 1 means the ray i intersects the shape, the default implementation traces them one by one
+		virtual uint32 intersect(const ray* rays, size_t count, uint32 active, surface_hit* hits) const;
+
+		// the bit i of result is 1 means the ray i is blocked by the shape
+		virtual uint32 occluded(const ray* rays, size_t count, uint32 active) const;
 
 		virtual bound3 bounding_box(const transform& transform, size_t index) const = 0;
 
@@ -74,7 +92,7 @@ namespace rainbow::cpus::shapes {
 
 		virtual real area() const noexcept = 0;
 
-		virtual void build_accelerator() = 0;
+		virtual void build_accelerator(const accelerators::accelerator_type& type) = 0;
 
 		shape_instance_properties instance(const transform& transform) const noexcept;
 		
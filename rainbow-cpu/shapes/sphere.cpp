@@ -9,12 +9,12 @@ rainbow::cpus::shapes::sphere::sphere(real radius, bool reverse_orientation) : s
 {
 }
 
-std::optional<surface_interaction> rainbow::cpus::shapes::sphere::intersect(const ray& ray, size_t index) const
+bool rainbow::cpus::shapes::sphere::intersect(const ray& ray, size_t index, surface_hit& hit) const
 {
-	return intersect(ray);
+	return intersect(ray, hit);
 }
 
-std::optional<surface_interaction> rainbow::cpus::shapes::sphere::intersect(const ray& ray) const
+bool rainbow::cpus::shapes::sphere::intersect(const ray& ray, surface_hit& hit) const
 {
 	// a = direction.x * direction.x + direction.y * direction.y + direction.z * direction.z
 	// b = 2 * (direction.x * origin.x + direction.y * origin.y + direction.z * origin.z)
@@ -26,63 +26,52 @@ std::optional<surface_interaction> rainbow::cpus::shapes::sphere::intersect(cons
 	real t0, t1, t_hit;
 
 	// solve the equation to get the point ray intersect sphere
-	if (!solve_quadratic_equation(a, b, c, &t0, &t1)) return std::nullopt;
+	if (!solve_quadratic_equation(a, b, c, &t0, &t1)) return false;
 
 	// the point should on the ray
-	if (t0 > ray.length || t1 <= 0) return std::nullopt;
+	if (t0 > ray.length || t1 <= 0) return false;
 
 	if (t0 <= 0) {
-		if (t1 > ray.length) return std::nullopt;
+		if (t1 > ray.length) return false;
 		else t_hit = t1;
 	}
 	else t_hit = t0;
 
-	auto point_hit = ray.origin + ray.direction * t_hit;
+	// in this version, we need set the ray.length to t_hit to avoid the ray intersect the objects far from this
+	ray.length = t_hit;
 
-	// if the point on the sphere, the distance of point should be radius
-	// so mRadius / length(point_hit) should be 1
-	point_hit = point_hit * mRadius / length(point_hit);
+	hit.index = 0;
+	hit.distance = t_hit;
 
-	// if point is in the z-axis, the phi of point is meaningless
-	if (point_hit.x == 0 && point_hit.y == 0) point_hit.x = 1e-5f * mRadius;
+	return true;
+}
 
-	auto phi = atan2(point_hit.y, point_hit.x);
-	
-	if (phi < 0) phi = phi + two_pi<real>();
+surface_interaction rainbow::cpus::shapes::sphere::compute_surface_interaction(const ray& ray, const surface_hit& hit) const
+{
+	return sphere_surface_interaction(vector3(0), mRadius, ray, hit.distance, reverse_orientation());
+}
 
-	// we use phi_max, theta_min and theta_max to define the part of sphere
-	// now, we only use the whole sphere, so the phi_max should be 2 * pi
-	// theta should be the range [-1, 1]
-	const auto phi_max = two_pi<real>();
-	const auto theta_min = acos(static_cast<real>(-1));
-	const auto theta_max = acos(static_cast<real>(1));
-	
-	// parametric representation of sphere hit
-	const auto theta = acos(clamp(point_hit.z / mRadius, static_cast<real>(-1), static_cast<real>(1)));
-	const auto u = phi / phi_max;
-	const auto v = (theta - theta_min) / (theta_max - theta_min);
+bool rainbow::cpus::shapes::sphere::occluded(const ray& ray, size_t index) const
+{
+	return occluded(ray);
+}
 
-	// compute the dp_du, dp_dv
-	const auto radius = sqrt(point_hit.x * point_hit.x + point_hit.y * point_hit.y);
-	const auto inv_radius = 1 / radius;
-	const auto cos_phi = point_hit.x * inv_radius;
-	const auto sin_phi = point_hit.y * inv_radius;
+bool rainbow::cpus::shapes::sphere::occluded(const ray& ray) const
+{
+	const auto a = dot(ray.direction, ray.direction);
+	const auto b = dot(ray.direction, ray.origin) * 2;
+	const auto c = dot(ray.origin, ray.origin) - mRadius * mRadius;
 
-	const auto dp_du = vector3(-phi_max * point_hit.y, phi_max * point_hit.x, 0);
-	const auto dp_dv = vector3(point_hit.z * cos_phi, point_hit.z * sin_phi, -mRadius * sin(theta)) * (theta_max - theta_min);
-	const auto normal = 
-		reverse_orientation() ? -normalize(math::cross(dp_du, dp_dv)) : normalize(math::cross(dp_du, dp_dv));
-	
-	// in this version, we need set the ray.length to t_hit to avoid the ray intersect the objects far from this
-	ray.length = t_hit;
+	real t0, t1;
 
-	// the normal of surface is indicate the outside of shape
-	// the entity will be set when entity::intersect called
-	return surface_interaction(
-		nullptr,
-		dp_du, dp_dv, normal, point_hit, -ray.direction,
-		vector2(u, v)
-	);
+	// solve the equation to get the point ray intersect sphere
+	if (!solve_quadratic_equation(a, b, c, &t0, &t1)) return false;
+
+	// the ray is occluded if one of the points is on the ray
+	if (t0 > ray.length || t1 <= 0) return false;
+	if (t0 <= 0 && t1 > ray.length) return false;
+
+	return true;
 }
 
 rainbow::core::math::bound3 rainbow::cpus::shapes::sphere::bounding_box(const transform& transform, size_t index) const
@@ -236,6 +225,55 @@ rainbow::core::real rainbow::cpus::shapes::sphere::area() const noexcept
 	return 4 * pi<real>() * mRadius * mRadius;
 }
 
-void rainbow::cpus::shapes::sphere::build_accelerator()
+void rainbow::cpus::shapes::sphere::build_accelerator(const accelerators::accelerator_type& type)
+{
+}
+
+rainbow::cpus::shared::interactions::surface_interaction rainbow::cpus::shapes::sphere_surface_interaction(
+	const vector3& center, real radius, const ray& ray, real distance, bool reverse_orientation)
 {
+	// the point is in the space whose origin is the center of sphere
+	auto point_hit = ray.origin + ray.direction * distance - center;
+
+	// if the point on the sphere, the distance of point should be radius
+	// so radius / length(point_hit) should be 1
+	point_hit = point_hit * radius / length(point_hit);
+
+	// if point is in the z-axis, the phi of point is meaningless
+	if (point_hit.x == 0 && point_hit.y == 0) point_hit.x = 1e-5f * radius;
+
+	auto phi = atan2(point_hit.y, point_hit.x);
+	
+	if (phi < 0) phi = phi + two_pi<real>();
+
+	// we use phi_max, theta_min and theta_max to define the part of sphere
+	// now, we only use the whole sphere, so the phi_max should be 2 * pi
+	// theta should be the range [-1, 1]
+	const auto phi_max = two_pi<real>();
+	const auto theta_min = acos(static_cast<real>(-1));
+	const auto theta_max = acos(static_cast<real>(1));
+	
+	// parametric representation of sphere hit
+	const auto theta = acos(clamp(point_hit.z / radius, static_cast<real>(-1), static_cast<real>(1)));
+	const auto u = phi / phi_max;
+	const auto v = (theta - theta_min) / (theta_max - theta_min);
+
+	// compute the dp_du, dp_dv
+	const auto radius_xy = sqrt(point_hit.x * point_hit.x + point_hit.y * point_hit.y);
+	const auto inv_radius = 1 / radius_xy;
+	const auto cos_phi = point_hit.x * inv_radius;
+	const auto sin_phi = point_hit.y * inv_radius;
+
+	const auto dp_du = vector3(-phi_max * point_hit.y, phi_max * point_hit.x, 0);
+	const auto dp_dv = vector3(point_hit.z * cos_phi, point_hit.z * sin_phi, -radius * sin(theta)) * (theta_max - theta_min);
+	const auto normal = 
+		reverse_orientation ? -normalize(math::cross(dp_du, dp_dv)) : normalize(math::cross(dp_du, dp_dv));
+
+	// the normal of surface is indicate the outside of shape
+	// the entity will be set when entity::compute_surface_interaction called
+	return surface_interaction(
+		nullptr,
+		dp_du, dp_dv, normal, point_hit + center, -ray.direction,
+		vector2(u, v)
+	);
 }
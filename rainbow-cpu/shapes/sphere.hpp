@@ -10,9 +10,15 @@ namespace rainbow::cpus::shapes {
 
 		~sphere() = default;
 
-		std::optional<surface_interaction> intersect(const ray& ray, size_t index) const override;
+		bool intersect(const ray& ray, size_t index, surface_hit& hit) const override;
 
-		std::optional<surface_interaction> intersect(const ray& ray) const override;
+		bool intersect(const ray& ray, surface_hit& hit) const override;
+
+		surface_interaction compute_surface_interaction(const ray& ray, const surface_hit& hit) const override;
+
+		bool occluded(const ray& ray, size_t index) const override;
+
+		bool occluded(const ray& ray) const override;
 
 		bound3 bounding_box(const transform& transform, size_t index) const override;
 
@@ -34,9 +40,11 @@ namespace rainbow::cpus::shapes {
 
 		real area() const noexcept override;
 
-		void build_accelerator() override;
+		void build_accelerator(const accelerators::accelerator_type& type) override;
 	private:
 		real mRadius;
 	};
 
+	// build the interaction of the point at distance along the ray on the sphere with center and radius
+	surface_interaction sphere_surface_interaction(const vector3& center, real radius, const ray& ray, real distance, bool reverse_orientation);
 }
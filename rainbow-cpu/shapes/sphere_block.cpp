@@ -0,0 +1,127 @@
+#include "sphere_block.hpp"
+#include "../shared/simd.hpp"
+
+rainbow::cpus::shapes::sphere_block::sphere_block()
+{
+	for (size_t lane = 0; lane < width; lane++) {
+		for (size_t axis = 0; axis < 3; axis++) centers[axis][lane] = 0;
+
+		radii[lane] = 0;
+		spheres[lane] = 0;
+	}
+}
+
+void rainbow::cpus::shapes::sphere_block::set(size_t lane, uint32 sphere, const vector3& center, real radius)
+{
+	for (size_t axis = 0; axis < 3; axis++)
+		centers[axis][lane] = center[static_cast<int>(axis)];
+
+	radii[lane] = radius;
+	spheres[lane] = sphere;
+}
+
+rainbow::core::uint32 rainbow::cpus::shapes::sphere_block::intersect(const ray& ray, real length, real distances[width]) const
+{
+	static_assert(width == 4, "the SIMD test of sphere_block only support 4 spheres.");
+
+	const auto lanes = (1u << count) - 1;
+
+#if defined(RAINBOW_SSE)
+	const auto dx = _mm_set1_ps(ray.direction.x);
+	const auto dy = _mm_set1_ps(ray.direction.y);
+	const auto dz = _mm_set1_ps(ray.direction.z);
+
+	// the vector from center to origin of ray
+	const auto ox = _mm_sub_ps(_mm_set1_ps(ray.origin.x), _mm_load_ps(centers[0]));
+	const auto oy = _mm_sub_ps(_mm_set1_ps(ray.origin.y), _mm_load_ps(centers[1]));
+	const auto oz = _mm_sub_ps(_mm_set1_ps(ray.origin.z), _mm_load_ps(centers[2]));
+
+	const auto radius2 = _mm_mul_ps(_mm_load_ps(radii), _mm_load_ps(radii));
+
+	// a * t^2 + 2 * b * t + c = 0
+	const auto a = _mm_set1_ps(dot(ray.direction, ray.direction));
+	const auto b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, dx), _mm_mul_ps(oy, dy)), _mm_mul_ps(oz, dz));
+	const auto c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz)), radius2);
+
+	// the vector from center to the nearest point on the ray, b * b - a * c = a * (radius^2 - length(l)^2)
+	const auto factor = _mm_div_ps(b, a);
+	const auto lx = _mm_sub_ps(ox, _mm_mul_ps(factor, dx));
+	const auto ly = _mm_sub_ps(oy, _mm_mul_ps(factor, dy));
+	const auto lz = _mm_sub_ps(oz, _mm_mul_ps(factor, dz));
+
+	const auto discriminant = _mm_mul_ps(a, _mm_sub_ps(radius2,
+		_mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, lx), _mm_mul_ps(ly, ly)), _mm_mul_ps(lz, lz))));
+
+	const auto zero = _mm_setzero_ps();
+
+	// q = -(b + sign(b) * sqrt(discriminant)), the roots are q / a and c / q
+	const auto root = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+	const auto sign = _mm_and_ps(b, _mm_set1_ps(-0.0f));
+	const auto q = _mm_sub_ps(zero, _mm_add_ps(b, _mm_or_ps(root, sign)));
+
+	const auto t0 = _mm_div_ps(q, a);
+	const auto t1 = _mm_div_ps(c, q);
+
+	const auto t_near = _mm_min_ps(t0, t1);
+	const auto t_far = _mm_max_ps(t0, t1);
+
+	// if the near point is behind the origin, the origin is in the sphere and we use the far point
+	const auto use_near = _mm_cmpgt_ps(t_near, zero);
+	const auto t = _mm_or_ps(_mm_and_ps(use_near, t_near), _mm_andnot_ps(use_near, t_far));
+
+	auto mask = static_cast<uint32>(_mm_movemask_ps(_mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, _mm_set1_ps(length)))));
+
+	mask = mask & static_cast<uint32>(_mm_movemask_ps(_mm_cmpge_ps(discriminant, zero)));
+	mask = mask & lanes;
+
+	alignas(16) real ts[width];
+
+	_mm_store_ps(ts, t);
+
+	for (size_t lane = 0; lane < width; lane++) distances[lane] = ts[lane];
+
+	return mask;
+#else
+	uint32 mask = 0;
+
+	for (size_t lane = 0; lane < count; lane++) {
+		const auto center = vector3(centers[0][lane], centers[1][lane], centers[2][lane]);
+
+		if (intersect_sphere(ray, center, radii[lane], length, distances[lane])) mask = mask | (1u << lane);
+	}
+
+	return mask & lanes;
+#endif
+}
+
+bool rainbow::cpus::shapes::intersect_sphere(const ray& ray, const vector3& center, real radius, real length, real& distance)
+{
+	const auto origin = ray.origin - center;
+
+	// a * t^2 + 2 * b * t + c = 0
+	const auto a = dot(ray.direction, ray.direction);
+	const auto b = dot(origin, ray.direction);
+	const auto c = dot(origin, origin) - radius * radius;
+
+	// the vector from center to the nearest point on the ray, b * b - a * c = a * (radius^2 - length(l)^2)
+	const auto l = origin - ray.direction * (b / a);
+	const auto discriminant = a * (radius * radius - dot(l, l));
+
+	if (discriminant < 0) return false;
+
+	// q = -(b + sign(b) * sqrt(discriminant)), the roots are q / a and c / q
+	const auto root = sqrt(discriminant);
+	const auto q = b < 0 ? root - b : -(b + root);
+
+	const auto t0 = min(q / a, c / q);
+	const auto t1 = max(q / a, c / q);
+
+	// if the near point is behind the origin, the origin is in the sphere and we use the far point
+	const auto t = t0 > 0 ? t0 : t1;
+
+	if (t <= 0 || t >= length) return false;
+
+	distance = t;
+
+	return true;
+}
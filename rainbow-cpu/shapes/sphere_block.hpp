@@ -0,0 +1,38 @@
+#pragma once
+
+#include "../shared/ray.hpp"
+
+namespace rainbow::cpus::shapes {
+
+	using namespace shared;
+
+	/*
+	 * sphere_block stores the centers and radii of at most 4 spheres in SoA layout,
+	 * centers[axis][lane] is the axis of center of sphere(lane).
+	 * spheres[lane] is the index of sphere in sphere set and count is the number of spheres in block.
+	 * we can test the ray with all spheres in block with one SIMD test.
+	 */
+	struct alignas(16) sphere_block {
+		constexpr static inline size_t width = 4;
+
+		real centers[3][width];
+		real radii[width];
+
+		uint32 spheres[width];
+		uint32 count = 0;
+
+		sphere_block();
+
+		void set(size_t lane, uint32 sphere, const vector3& center, real radius);
+
+		// the bit i of result is 1 means the ray intersect the sphere(i) in (0, length), distances[i] is the nearest one
+		uint32 intersect(const ray& ray, real length, real distances[width]) const;
+	};
+
+	/*
+	 * intersect_sphere finds the nearest distance in (0, length) that the ray intersect the sphere.
+	 * the quadratic equation is solved with the center as origin and the discriminant is computed with
+	 * the distance from the center to the ray, so it is still accurate when the sphere is small and far from the ray.
+	 */
+	bool intersect_sphere(const ray& ray, const vector3& center, real radius, real length, real& distance);
+}
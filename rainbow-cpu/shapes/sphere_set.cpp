@@ -0,0 +1,295 @@
+#include "sphere_set.hpp"
+
+#include "../../rainbow-core/sample_function.hpp"
+
+#include "../shared/accelerators/block_hierarchy.hpp"
+#include "../shared/accelerators/accelerators.hpp"
+
+using namespace rainbow::cpus::shared::interactions;
+
+rainbow::cpus::shapes::sphere_set::sphere_set(
+	const std::vector<vector3>& centers,
+	const std::vector<real>& radii,
+	bool reverse_orientation) :
+	shape(reverse_orientation, centers.size()), mCenters(centers), mRadii(radii)
+{
+	std::vector<real> areas(mCount);
+
+	for (size_t index = 0; index < mCount; index++) {
+		areas[index] = area(index);
+
+		mArea = mArea + areas[index];
+	}
+
+	if (mCount != 0) mDistribution = std::make_shared<distribution1d>(areas);
+}
+
+bool rainbow::cpus::shapes::sphere_set::intersect(const ray& ray, size_t index, surface_hit& hit) const
+{
+	real distance = 0;
+
+	if (!intersect_sphere(ray, mCenters[index], mRadii[index], ray.length, distance)) return false;
+
+	ray.length = distance;
+
+	hit.index = index;
+	hit.distance = distance;
+
+	return true;
+}
+
+bool rainbow::cpus::shapes::sphere_set::intersect(const ray& ray, surface_hit& hit) const
+{
+	if (mAccelerator != nullptr) return mAccelerator->intersect(ray, hit);
+
+	auto found = false;
+
+	for (size_t index = 0; index < mCount; index++)
+		if (intersect(ray, index, hit)) found = true;
+
+	return found;
+}
+
+rainbow::cpus::shared::interactions::surface_interaction rainbow::cpus::shapes::sphere_set::compute_surface_interaction(
+	const ray& ray, const surface_hit& hit) const
+{
+	return sphere_surface_interaction(mCenters[hit.index], mRadii[hit.index], ray, hit.distance, reverse_orientation());
+}
+
+bool rainbow::cpus::shapes::sphere_set::occluded(const ray& ray, size_t index) const
+{
+	real distance = 0;
+
+	return intersect_sphere(ray, mCenters[index], mRadii[index], ray.length, distance);
+}
+
+bool rainbow::cpus::shapes::sphere_set::occluded(const ray& ray) const
+{
+	if (mAccelerator != nullptr) return mAccelerator->occluded(ray, nullptr);
+
+	for (size_t index = 0; index < mCount; index++)
+		if (occluded(ray, index)) return true;
+
+	return false;
+}
+
+rainbow::core::uint32 rainbow::cpus::shapes::sphere_set::intersect(const ray* rays, size_t count, uint32 active, surface_hit* hits) const
+{
+	// the rays travel the hierarchy of set together, the blocks are still tested with each ray
+	if (mAccelerator != nullptr) return mAccelerator->intersect(rays, count, active, hits);
+
+	return shape::intersect(rays, count, active, hits);
+}
+
+rainbow::core::uint32 rainbow::cpus::shapes::sphere_set::occluded(const ray* rays, size_t count, uint32 active) const
+{
+	if (mAccelerator != nullptr) return mAccelerator->occluded(rays, count, active, nullptr);
+
+	return shape::occluded(rays, count, active);
+}
+
+rainbow::core::math::bound3 rainbow::cpus::shapes::sphere_set::bounding_box(const transform& transform, size_t index) const
+{
+	const auto center = transform_point(transform, mCenters[index]);
+	const auto point = transform_point(transform, mCenters[index] + vector3(0, 0, mRadii[index]));
+	const auto radius = length(point - center);
+
+	return bound3(center - radius, center + radius);
+}
+
+rainbow::core::math::bound3 rainbow::cpus::shapes::sphere_set::bounding_box(const transform& transform) const
+{
+	// an empty set of spheres gives an empty (inverted) box
+	auto box = bound3();
+
+	box.min = vector3(+std::numeric_limits<real>::infinity());
+	box.max = vector3(-std::numeric_limits<real>::infinity());
+
+	for (size_t index = 0; index < mCount; index++)
+		box.union_it(bounding_box(transform, index));
+
+	return box;
+}
+
+rainbow::cpus::shapes::shape_sample rainbow::cpus::shapes::sphere_set::sample(const shape_instance_properties& properties, const vector2& sample) const
+{
+	// select a sphere by the areas, so the points are uniform on the surface of set
+	const auto which = mDistribution->sample(vector_t<1, real>(sample.x));
+
+	const auto sample_remapped = vector2(
+		std::min(which.value * mCount - which.offset,
+			static_cast<real>(1) - std::numeric_limits<real>::epsilon()),
+		sample.y);
+
+	const auto direction = uniform_sample_sphere(sample_remapped);
+	const auto point = mCenters[which.offset] + mRadii[which.offset] * direction;
+
+	return shape_sample(
+		interaction(reverse_orientation() ? -direction : direction, point, vector3(0)),
+		pdf(properties)
+	);
+}
+
+rainbow::core::real rainbow::cpus::shapes::sphere_set::pdf(const shape_instance_properties& properties) const
+{
+	// the transform of entity may have scale component
+	// the area of world space is not equal to the area of local space
+	// so we will use shape_instance_properties::area(the area in world space)
+	return 1 / properties.area;
+}
+
+rainbow::core::real rainbow::cpus::shapes::sphere_set::area(const transform& transform, size_t index) const noexcept
+{
+	const auto center = transform_point(transform, mCenters[index]);
+	const auto point = transform_point(transform, mCenters[index] + vector3(0, 0, mRadii[index]));
+	const auto radius = length(point - center);
+
+	return 4 * pi<real>() * radius * radius;
+}
+
+rainbow::core::real rainbow::cpus::shapes::sphere_set::area(const transform& transform) const noexcept
+{
+	real area = 0;
+
+	for (size_t index = 0; index < mCount; index++)
+		area = area + this->area(transform, index);
+
+	return area;
+}
+
+rainbow::core::real rainbow::cpus::shapes::sphere_set::area(size_t index) const noexcept
+{
+	return 4 * pi<real>() * mRadii[index] * mRadii[index];
+}
+
+rainbow::core::real rainbow::cpus::shapes::sphere_set::area() const noexcept
+{
+	return mArea;
+}
+
+void rainbow::cpus::shapes::sphere_set::build_accelerator(const accelerator_type& type)
+{
+	// we only need build it once
+	if (mAccelerator != nullptr || mCount == 0) return;
+
+	const auto nodes = build_sphere_blocks();
+
+	std::vector<accelerators::bounding_box<sphere_block_reference>> block_boxes;
+	std::vector<sphere_block_reference> block_references;
+
+	build_references(this, mSphereBlocks.size(), block_references, block_boxes);
+
+	mAccelerator = create_accelerator(type, block_references, block_boxes, nodes);
+}
+
+rainbow::cpus::shapes::sphere_set::sphere_reference::sphere_reference(const sphere_set* instance, size_t sphere) :
+	instance(instance), sphere(sphere)
+{
+}
+
+bool rainbow::cpus::shapes::sphere_set::sphere_reference::intersect(const ray& ray, surface_hit& hit) const
+{
+	return instance->intersect(ray, sphere, hit);
+}
+
+bool rainbow::cpus::shapes::sphere_set::sphere_reference::occluded(const ray& ray) const
+{
+	return instance->occluded(ray, sphere);
+}
+
+rainbow::core::math::bound3 rainbow::cpus::shapes::sphere_set::sphere_reference::bounding_box() const
+{
+	return instance->bounding_box(transform(), sphere);
+}
+
+bool rainbow::cpus::shapes::sphere_set::sphere_reference::visible() const noexcept
+{
+	return true;
+}
+
+rainbow::cpus::shapes::sphere_set::sphere_block_reference::sphere_block_reference(const sphere_set* instance, size_t block) :
+	instance(instance), block(block)
+{
+}
+
+bool rainbow::cpus::shapes::sphere_set::sphere_block_reference::intersect(const ray& ray, surface_hit& hit) const
+{
+	return instance->intersect_with_block(ray, block, hit);
+}
+
+bool rainbow::cpus::shapes::sphere_set::sphere_block_reference::occluded(const ray& ray) const
+{
+	return instance->occluded_with_block(ray, block);
+}
+
+rainbow::core::math::bound3 rainbow::cpus::shapes::sphere_set::sphere_block_reference::bounding_box() const
+{
+	const auto& sphere_block = instance->mSphereBlocks[block];
+
+	auto box = instance->bounding_box(transform(), sphere_block.spheres[0]);
+
+	for (size_t lane = 1; lane < sphere_block.count; lane++)
+		box.union_it(instance->bounding_box(transform(), sphere_block.spheres[lane]));
+
+	return box;
+}
+
+bool rainbow::cpus::shapes::sphere_set::sphere_block_reference::visible() const noexcept
+{
+	return true;
+}
+
+bool rainbow::cpus::shapes::sphere_set::intersect_with_block(const ray& ray, size_t block, surface_hit& hit) const
+{
+	const auto& sphere_block = mSphereBlocks[block];
+
+	real distances[sphere_block::width];
+
+	const auto mask = sphere_block.intersect(ray, ray.length, distances);
+
+	if (mask == 0) return false;
+
+	auto found = false;
+
+	// the spheres in block may overlap, so we need find the nearest one
+	for (size_t lane = 0; lane < sphere_block::width; lane++) {
+		if ((mask & (1u << lane)) == 0 || distances[lane] >= ray.length) continue;
+
+		ray.length = distances[lane];
+
+		hit.index = sphere_block.spheres[lane];
+		hit.distance = distances[lane];
+
+		found = true;
+	}
+
+	return found;
+}
+
+bool rainbow::cpus::shapes::sphere_set::occluded_with_block(const ray& ray, size_t block) const
+{
+	real distances[sphere_block::width];
+
+	return mSphereBlocks[block].intersect(ray, ray.length, distances) != 0;
+}
+
+std::vector<rainbow::cpus::shared::accelerators::linear_bounding_volume_hierarchy_node> rainbow::cpus::shapes::sphere_set::build_sphere_blocks()
+{
+	std::vector<accelerators::bounding_box<sphere_reference>> boxes;
+	std::vector<sphere_reference> references;
+
+	build_references(this, mCount, references, boxes);
+
+	// testing a block costs about the same as traveling a node and each sphere is a lane of it,
+	// with the default costs almost every leaf has one sphere and the blocks are mostly empty
+	bounding_volume_hierarchy_config config;
+
+	config.travel_cost = static_cast<real>(1);
+	config.test_cost = static_cast<real>(1) / sphere_block::width;
+
+	return build_block_hierarchy(references, boxes, config, mSphereBlocks,
+		[&](sphere_block& block, size_t lane, const sphere_reference& reference)
+		{
+			block.set(lane, static_cast<uint32>(reference.sphere), mCenters[reference.sphere], mRadii[reference.sphere]);
+		});
+}
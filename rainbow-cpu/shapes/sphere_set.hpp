@@ -0,0 +1,117 @@
+#pragma once
+
+#include "../shared/accelerators/bounding_volume_hierarchy.hpp"
+#include "../shared/distributions/distribution.hpp"
+
+#include "sphere_block.hpp"
+#include "sphere.hpp"
+
+#include <vector>
+
+namespace rainbow::cpus::shapes {
+
+	using namespace accelerators;
+	using namespace distributions;
+
+	/*
+	 * sphere_set is a shape of many spheres(e.g. the particles of a simulation), the sphere i is at centers[i] with radii[i].
+	 * a particle only costs its center and radius(and its part of the hierarchy) instead of an entity with a sphere shape.
+	 * the hierarchy is built over the spheres and the spheres of a leaf are packed into a sphere_block,
+	 * so a leaf can be tested with one SIMD test.
+	 * the spheres are sampled by their areas when the set is used as an emitter.
+	 */
+	class sphere_set final : public shape {
+	public:
+		explicit sphere_set(
+			const std::vector<vector3>& centers,
+			const std::vector<real>& radii,
+			bool reverse_orientation = false);
+
+		~sphere_set() = default;
+
+		bool intersect(const ray& ray, size_t index, surface_hit& hit) const override;
+
+		bool intersect(const ray& ray, surface_hit& hit) const override;
+
+		surface_interaction compute_surface_interaction(const ray& ray, const surface_hit& hit) const override;
+
+		bool occluded(const ray& ray, size_t index) const override;
+
+		bool occluded(const ray& ray) const override;
+
+		uint32 intersect(const ray* rays, size_t count, uint32 active, surface_hit* hits) const override;
+
+		uint32 occluded(const ray* rays, size_t count, uint32 active) const override;
+
+		bound3 bounding_box(const transform& transform, size_t index) const override;
+
+		bound3 bounding_box(const transform& transform) const override;
+
+		shape_sample sample(const shape_instance_properties& properties, const vector2& sample) const override;
+
+		real pdf(const shape_instance_properties& properties) const override;
+
+		real area(const transform& transform, size_t index) const noexcept override;
+
+		real area(const transform& transform) const noexcept override;
+
+		real area(size_t index) const noexcept override;
+
+		real area() const noexcept override;
+
+		void build_accelerator(const accelerator_type& type) override;
+	private:
+		struct sphere_reference {
+			const sphere_set* instance = nullptr;
+
+			size_t sphere = 0;
+
+			sphere_reference() = default;
+
+			sphere_reference(const sphere_set* instance, size_t sphere);
+
+			bool intersect(const ray& ray, surface_hit& hit) const;
+
+			bool occluded(const ray& ray) const;
+
+			bound3 bounding_box() const;
+
+			bool visible() const noexcept;
+		};
+
+		struct sphere_block_reference {
+			const sphere_set* instance = nullptr;
+
+			size_t block = 0;
+
+			sphere_block_reference() = default;
+
+			sphere_block_reference(const sphere_set* instance, size_t block);
+
+			bool intersect(const ray& ray, surface_hit& hit) const;
+
+			bool occluded(const ray& ray) const;
+
+			bound3 bounding_box() const;
+
+			bool visible() const noexcept;
+		};
+
+		bool intersect_with_block(const ray& ray, size_t block, surface_hit& hit) const;
+
+		bool occluded_with_block(const ray& ray, size_t block) const;
+
+		std::vector<linear_bounding_volume_hierarchy_node> build_sphere_blocks();
+	private:
+		std::shared_ptr<accelerator<sphere_block_reference>> mAccelerator;
+		std::shared_ptr<distribution1d> mDistribution;
+
+		std::vector<sphere_block> mSphereBlocks;
+
+		std::vector<vector3> mCenters;
+		std::vector<real> mRadii;
+
+		real mArea = 0;
+	};
+
+}
@@ -0,0 +1,156 @@
+#include "triangle_block.hpp"
+#include "../shared/simd.hpp"
+
+rainbow::cpus::shapes::triangle_ray::triangle_ray(const ray& ray) : origin(ray.origin)
+{
+	const auto direction = abs(ray.direction);
+
+	// the z-axis is the max dimension of direction, so the shear will not be too large
+	axis[2] = direction.x > direction.y ? (direction.x > direction.z ? 0 : 2) : (direction.y > direction.z ? 1 : 2);
+	axis[0] = (axis[2] + 1) % 3;
+	axis[1] = (axis[0] + 1) % 3;
+
+	// swap the x and y axes to keep the winding of triangles when the direction is negative
+	if (ray.direction[axis[2]] < 0) std::swap(axis[0], axis[1]);
+
+	shear = vector3(
+		ray.direction[axis[0]] / ray.direction[axis[2]],
+		ray.direction[axis[1]] / ray.direction[axis[2]],
+		static_cast<real>(1) / ray.direction[axis[2]]);
+}
+
+rainbow::cpus::shapes::triangle_block::triangle_block()
+{
+	for (size_t vertex = 0; vertex < 3; vertex++)
+		for (size_t axis = 0; axis < 3; axis++)
+			for (size_t lane = 0; lane < width; lane++) positions[vertex][axis][lane] = 0;
+
+	for (size_t lane = 0; lane < width; lane++) faces[lane] = 0;
+}
+
+void rainbow::cpus::shapes::triangle_block::set(size_t lane, uint32 face, const std::array<vector3, 3>& positions)
+{
+	for (size_t vertex = 0; vertex < 3; vertex++)
+		for (size_t axis = 0; axis < 3; axis++)
+			this->positions[vertex][axis][lane] = positions[vertex][static_cast<int>(axis)];
+
+	faces[lane] = face;
+}
+
+rainbow::core::uint32 rainbow::cpus::shapes::triangle_block::intersect(const triangle_ray& ray, real length, triangle_hit hits[width]) const
+{
+	static_assert(width == 4, "the SIMD test of triangle_block only support 4 triangles.");
+
+	// the lanes after count are empty, their positions are 0 and the determinant will be 0
+	// but we still mask them out to avoid testing the wrong triangles
+	const auto lanes = (1u << count) - 1;
+
+#if defined(RAINBOW_SSE)
+	__m128 x[3], y[3], z[3];
+
+	// transform the vertices into the space of ray, the origin is (0, 0, 0) and the direction is (0, 0, 1)
+	for (size_t vertex = 0; vertex < 3; vertex++) {
+		const auto px = _mm_sub_ps(_mm_load_ps(positions[vertex][ray.axis[0]]), _mm_set1_ps(ray.origin[ray.axis[0]]));
+		const auto py = _mm_sub_ps(_mm_load_ps(positions[vertex][ray.axis[1]]), _mm_set1_ps(ray.origin[ray.axis[1]]));
+		const auto pz = _mm_sub_ps(_mm_load_ps(positions[vertex][ray.axis[2]]), _mm_set1_ps(ray.origin[ray.axis[2]]));
+
+		x[vertex] = _mm_sub_ps(px, _mm_mul_ps(_mm_set1_ps(ray.shear.x), pz));
+		y[vertex] = _mm_sub_ps(py, _mm_mul_ps(_mm_set1_ps(ray.shear.y), pz));
+		z[vertex] = _mm_mul_ps(_mm_set1_ps(ray.shear.z), pz);
+	}
+
+	// the scaled barycentric coordinates, they are the edge functions of the point (0, 0)
+	const auto u = _mm_sub_ps(_mm_mul_ps(x[2], y[1]), _mm_mul_ps(y[2], x[1]));
+	const auto v = _mm_sub_ps(_mm_mul_ps(x[0], y[2]), _mm_mul_ps(y[0], x[2]));
+	const auto w = _mm_sub_ps(_mm_mul_ps(x[1], y[0]), _mm_mul_ps(y[1], x[0]));
+
+	const auto zero = _mm_setzero_ps();
+
+	// if the signs of u, v, w are different, the point (0, 0) is out of triangle
+	const auto negative = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(u, zero), _mm_cmplt_ps(v, zero)), _mm_cmplt_ps(w, zero));
+	const auto positive = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(u, zero), _mm_cmpgt_ps(v, zero)), _mm_cmpgt_ps(w, zero));
+
+	const auto determinant = _mm_add_ps(_mm_add_ps(u, v), w);
+	const auto inv_determinant = _mm_div_ps(_mm_set1_ps(1), determinant);
+
+	const auto t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(u, z[0]), _mm_mul_ps(v, z[1])), _mm_mul_ps(w, z[2])), inv_determinant);
+
+	auto mask = static_cast<uint32>(_mm_movemask_ps(_mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, _mm_set1_ps(length)))));
+
+	mask = mask & ~static_cast<uint32>(_mm_movemask_ps(_mm_and_ps(negative, positive)));
+	mask = mask & ~static_cast<uint32>(_mm_movemask_ps(_mm_cmpeq_ps(determinant, zero)));
+	mask = mask & lanes;
+
+	alignas(16) real ts[width], b1s[width], b2s[width];
+
+	_mm_store_ps(ts, t);
+	_mm_store_ps(b1s, _mm_mul_ps(v, inv_determinant));
+	_mm_store_ps(b2s, _mm_mul_ps(w, inv_determinant));
+
+	for (size_t lane = 0; lane < width; lane++) {
+		hits[lane].t = ts[lane];
+		hits[lane].b1 = b1s[lane];
+		hits[lane].b2 = b2s[lane];
+	}
+
+	return mask;
+#else
+	uint32 mask = 0;
+
+	for (size_t lane = 0; lane < count; lane++) {
+		const std::array<vector3, 3> triangle = {
+			vector3(positions[0][0][lane], positions[0][1][lane], positions[0][2][lane]),
+			vector3(positions[1][0][lane], positions[1][1][lane], positions[1][2][lane]),
+			vector3(positions[2][0][lane], positions[2][1][lane], positions[2][2][lane])
+		};
+
+		if (intersect_triangle(ray, triangle, length, hits[lane])) mask = mask | (1u << lane);
+	}
+
+	return mask & lanes;
+#endif
+}
+
+bool rainbow::cpus::shapes::intersect_triangle(const triangle_ray& ray, const std::array<vector3, 3>& positions, real length, triangle_hit& hit)
+{
+	// transform the vertices into the space of ray, the origin is (0, 0, 0) and the direction is (0, 0, 1)
+	const auto p0 = positions[0] - ray.origin;
+	const auto p1 = positions[1] - ray.origin;
+	const auto p2 = positions[2] - ray.origin;
+
+	const auto x0 = p0[ray.axis[0]] - ray.shear.x * p0[ray.axis[2]];
+	const auto y0 = p0[ray.axis[1]] - ray.shear.y * p0[ray.axis[2]];
+	const auto x1 = p1[ray.axis[0]] - ray.shear.x * p1[ray.axis[2]];
+	const auto y1 = p1[ray.axis[1]] - ray.shear.y * p1[ray.axis[2]];
+	const auto x2 = p2[ray.axis[0]] - ray.shear.x * p2[ray.axis[2]];
+	const auto y2 = p2[ray.axis[1]] - ray.shear.y * p2[ray.axis[2]];
+
+	// the scaled barycentric coordinates, they are the edge functions of the point (0, 0)
+	const auto u = x2 * y1 - y2 * x1;
+	const auto v = x0 * y2 - y0 * x2;
+	const auto w = x1 * y0 - y1 * x0;
+
+	// if the signs of u, v, w are different, the point (0, 0) is out of triangle
+	if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0)) return false;
+
+	const auto determinant = u + v + w;
+
+	// the triangle is degenerate or parallel with the ray
+	if (determinant == 0) return false;
+
+	const auto inv_determinant = static_cast<real>(1) / determinant;
+
+	const auto z0 = ray.shear.z * p0[ray.axis[2]];
+	const auto z1 = ray.shear.z * p1[ray.axis[2]];
+	const auto z2 = ray.shear.z * p2[ray.axis[2]];
+
+	const auto t = (u * z0 + v * z1 + w * z2) * inv_determinant;
+
+	if (t <= 0 || t >= length) return false;
+
+	hit.t = t;
+	hit.b1 = v * inv_determinant;
+	hit.b2 = w * inv_determinant;
+
+	return true;
+}
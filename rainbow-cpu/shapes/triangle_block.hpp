@@ -0,0 +1,56 @@
+#pragma once
+
+#include "../shared/ray.hpp"
+
+#include <array>
+
+namespace rainbow::cpus::shapes {
+
+	using namespace shared;
+
+	/*
+	 * triangle_ray is the ray we use to do watertight ray-triangle test.
+	 * we permute the axes so the z-axis is the max dimension of direction, and shear the space
+	 * so the direction of ray is (0, 0, 1). the ray will never pass through the edge shared by two triangles.
+	 */
+	struct triangle_ray {
+		vector3 origin;
+		vector3 shear;
+
+		int32 axis[3];
+
+		explicit triangle_ray(const ray& ray);
+	};
+
+	struct triangle_hit {
+		real t = 0;
+		real b1 = 0;
+		real b2 = 0;
+
+		triangle_hit() = default;
+	};
+
+	/*
+	 * triangle_block stores the positions of at most 4 triangles in SoA layout,
+	 * positions[vertex][axis][lane] is the axis of vertex of triangle(lane).
+	 * faces[lane] is the index of triangle in mesh and count is the number of triangles in block.
+	 * we can test the ray with all triangles in block with one SIMD watertight test.
+	 */
+	struct alignas(16) triangle_block {
+		constexpr static inline size_t width = 4;
+
+		real positions[3][3][width];
+
+		uint32 faces[width];
+		uint32 count = 0;
+
+		triangle_block();
+
+		void set(size_t lane, uint32 face, const std::array<vector3, 3>& positions);
+
+		// the bit i of result is 1 means the ray intersect the triangle(i) in (0, length)
+		uint32 intersect(const triangle_ray& ray, real length, triangle_hit hits[width]) const;
+	};
+
+	bool intersect_triangle(const triangle_ray& ray, const std::array<vector3, 3>& positions, real length, triangle_hit& hit);
+}
@@ -3,9 +3,12 @@
 #include "../../../rainbow-core/math/math.hpp"
 
 #include "../interactions/surface_interaction.hpp"
+#include "../interactions/surface_hit.hpp"
 #include "../../interfaces/noncopyable.hpp"
+#include "../ray_packet.hpp"
 #include "../ray.hpp"
 
+#include <functional>
 #include <optional>
 #include <memory>
 #include <vector>
@@ -14,16 +17,28 @@ namespace rainbow::cpus::shared::accelerators {
 
 	using namespace interactions;
 	using namespace core::math;
+
+	enum class accelerator_type : uint32 {
+		bounding_volume_hierarchy = 0,
+		bounding_volume_hierarchy4 = 1,
+		bounding_volume_hierarchy8 = 2,
+		quantized_bounding_volume_hierarchy = 3
+	};
 	
+	/*
+	 * bounding_box is the box of an element we put into accelerator.
+	 * index is the location of element in the elements(the reference table) we use to build the accelerator,
+	 * so we do not need to allocate memory for each element.
+	 */
 	template <typename T>
 	struct bounding_box {
-		std::shared_ptr<const T> entity = nullptr;
+		uint32 index = 0;
 
 		bound3 box = bound3();
 
 		bounding_box() = default;
 
-		bounding_box(const std::shared_ptr<const T>& entity);
+		bounding_box(const T& element, uint32 index);
 
 		bounding_box(const vector3& v0, const vector3& v1);
 
@@ -49,13 +64,42 @@ namespace rainbow::cpus::shared::accelerators {
 	template <typename T>
 	class accelerator : public interfaces::noncopyable {
 	public:
-		explicit accelerator(const std::vector<bounding_box<T>>& boxes);
+		explicit accelerator(const std::vector<T>& elements, const std::vector<bounding_box<T>>& boxes);
+
+		// find the nearest element the ray intersect, the ray.length and the hit will be updated if we find it
+		virtual bool intersect(const ray& ray, surface_hit& hit) const = 0;
+
+		virtual bool intersect_with_shadow_ray(const ray& ray, surface_hit& hit) const = 0;
+
+		// find any visible element that blocks the ray, the elements that ignore(element) is true will be skipped
+		// it stops at the first element we find, so it is cheaper than intersect_with_shadow_ray
+		virtual bool occluded(const ray& ray, const std::function<bool(const T&)>& ignore) const = 0;
 
-		virtual std::optional<surface_interaction> intersect(const ray& ray) const = 0;
+		// trace the rays whose bit is 1 in active together, rays[i] and hits[i] are updated as intersect(rays[i], hits[i])
+		// the bit i of result is 1 means the ray i finds an element
+		// it is faster than tracing the rays one by one when they are coherent, the default implementation traces them one by one
+		virtual uint32 intersect(const ray* rays, size_t count, uint32 active, surface_hit* hits) const;
 
-		virtual std::optional<surface_interaction> intersect_with_shadow_ray(const ray& ray) const = 0;
+		// the bit i of result is 1 means the ray i is blocked as occluded(rays[i], ignore)
+		virtual uint32 occluded(const ray* rays, size_t count, uint32 active, const std::function<bool(const T&)>& ignore) const;
+
+		// update the boxes after the elements changed(e.g. moved), the bounding_box of elements will be called again
+		// the accelerator may rebuild the parts of it that become too bad
+		virtual void refit() = 0;
+
+		// the boxes of elements, the order of them may be changed by the accelerator when we build it
+		const std::vector<bounding_box<T>>& boxes() const noexcept;
+
+		// the elements with the same order as boxes, elements()[i] is the element of boxes()[i]
+		const std::vector<T>& elements() const noexcept;
 	protected:
+		// reorder the elements with the order of boxes when the accelerator changes the order of boxes
+		// so we can access the elements of leaf directly when we travel the accelerator
+		// the index of boxes will be the location of them after reordering
+		void reorder_elements();
+
 		std::vector<bounding_box<T>> mBoundingBoxes;
+		std::vector<T> mElements;
 	};
 
 }
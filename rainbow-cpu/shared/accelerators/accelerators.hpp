@@ -0,0 +1,27 @@
+#pragma once
+
+#include "quantized_bounding_volume_hierarchy.hpp"
+#include "wide_bounding_volume_hierarchy.hpp"
+#include "bounding_volume_hierarchy.hpp"
+
+namespace rainbow::cpus::shared::accelerators {
+
+	template <typename T>
+	std::shared_ptr<accelerator<T>> create_accelerator(
+		const accelerator_type& type,
+		const std::vector<T>& elements,
+		const std::vector<bounding_box<T>>& boxes,
+		const bounding_volume_hierarchy_config& config = bounding_volume_hierarchy_config());
+
+	// create the accelerator with the topology of a binary hierarchy built outside
+	template <typename T>
+	std::shared_ptr<accelerator<T>> create_accelerator(
+		const accelerator_type& type,
+		const std::vector<T>& elements,
+		const std::vector<bounding_box<T>>& boxes,
+		const std::vector<linear_bounding_volume_hierarchy_node>& nodes,
+		const bounding_volume_hierarchy_config& config = bounding_volume_hierarchy_config());
+	
+}
+
+#include "detail/accelerators.hpp"
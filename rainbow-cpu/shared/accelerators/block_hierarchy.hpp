@@ -0,0 +1,26 @@
+#pragma once
+
+#include "bounding_volume_hierarchy.hpp"
+
+namespace rainbow::cpus::shared::accelerators {
+
+	// the references of elements [0, count) of instance and their boxes, Reference is built from (instance, index)
+	template <typename Reference, typename Instance>
+	void build_references(const Instance* instance, size_t count,
+		std::vector<Reference>& references, std::vector<bounding_box<Reference>>& boxes);
+
+	/*
+	 * build_block_hierarchy builds the hierarchy of elements whose leaves have at most Block::width elements
+	 * and packs the elements of each leaf into blocks, so a leaf can be tested with one SIMD test.
+	 * the leaf with too many elements(the centroids are the same) uses more than one block.
+	 * fill(block, lane, element) writes the element into the lane of block, the count of block is set before it.
+	 * the leaves of returned nodes index into the blocks, so the shape can build its accelerator on the blocks.
+	 */
+	template <typename Block, typename T, typename Fill>
+	std::vector<linear_bounding_volume_hierarchy_node> build_block_hierarchy(
+		const std::vector<T>& elements, const std::vector<bounding_box<T>>& boxes,
+		bounding_volume_hierarchy_config config, std::vector<Block>& blocks, const Fill& fill);
+
+}
+
+#include "detail/block_hierarchy.hpp"
@@ -2,6 +2,9 @@
 
 #include "accelerator.hpp"
 
+#include <array>
+#include <list>
+
 namespace rainbow::cpus::shared::accelerators {
 
 	template <typename T>
@@ -27,6 +30,66 @@ namespace rainbow::cpus::shared::accelerators {
 		bool is_leaf() const noexcept;
 	};
 
+	/*
+	 * linear_bounding_volume_hierarchy_node is the node we use to traverse the hierarchy.
+	 * all nodes are stored in one array with depth-first order and the two children of a node are stored adjacently.
+	 * if the node is leaf, offset is the first element of node and count is the number of elements.
+	 * if the node is not leaf, offset is the index of left child(the right child is offset + 1) and count is 0.
+	 */
+	struct linear_bounding_volume_hierarchy_node {
+		bound3 box;
+
+		uint32 offset = 0;
+		uint16 count = 0;
+		uint8 axis = 0;
+		uint8 padding = 0;
+
+		linear_bounding_volume_hierarchy_node() = default;
+
+		bool is_leaf() const noexcept;
+	};
+
+	enum class bounding_volume_hierarchy_split_method : uint32 {
+		equal_count = 0,
+		surface_area_heuristic = 1,
+		spatial_split = 2
+	};
+
+	/*
+	 * bounding_volume_hierarchy_config controls how we build the hierarchy.
+	 * buckets is the number of bins used by surface area heuristic, it will be clamped to [2, 32].
+	 * max_leaf_elements is the max number of elements we allow to store in one leaf(if the cost is smaller).
+	 * travel_cost and test_cost are the cost of traveling a node and testing an element with ray.
+	 * the sub-tree with more than parallel_threshold elements will be built by a task of thread pool, 0 means disable it.
+	 * when we refit the hierarchy, the sub-tree whose SAH cost is rebuild_threshold times worse than the cost
+	 * when it was built will be rebuilt.
+	 * if refittable is false, the wide hierarchies do not keep the binary hierarchy and they are rebuilt when we refit them.
+	 * spatial_split also tries to split the node by a plane and put the elements crossing it into both children(SBVH),
+	 * it is only tried when the children of the best object split overlap more than spatial_split_alpha times the area of root,
+	 * and at most spatial_split_budget times the number of elements can be duplicated.
+	 * if treelet_bytes is not 0, the nodes are reordered into treelets of that size(e.g. 4096 for a page) after building,
+	 * so the nodes a ray visits one after another are stored together.
+	 */
+	struct bounding_volume_hierarchy_config {
+		bounding_volume_hierarchy_split_method split_method = bounding_volume_hierarchy_split_method::surface_area_heuristic;
+
+		size_t buckets = 16;
+		size_t max_leaf_elements = 4;
+		size_t parallel_threshold = 1 << 16;
+
+		real travel_cost = static_cast<real>(0.125);
+		real test_cost = static_cast<real>(1);
+		real rebuild_threshold = static_cast<real>(1.5);
+		real spatial_split_alpha = static_cast<real>(1e-5);
+		real spatial_split_budget = static_cast<real>(1);
+
+		size_t treelet_bytes = 0;
+
+		bool refittable = false;
+
+		bounding_volume_hierarchy_config() = default;
+	};
+
 	template <typename T>
 	class bounding_volume_hierarchy_allocator final : public interfaces::noncopyable {
 	public:
@@ -35,22 +98,68 @@ namespace rainbow::cpus::shared::accelerators {
 		~bounding_volume_hierarchy_allocator() = default;
 
 		bounding_volume_hierarchy_node<T>* allocate();
+
+		// create a new allocator owned by this allocator, it is used by the thread that builds a sub-tree
+		// the nodes allocated by it will be released when this allocator is destroyed
+		bounding_volume_hierarchy_allocator& fork();
 	private:
 		std::vector<std::vector<bounding_volume_hierarchy_node<T>>> mMemoryPools;
 		std::vector<std::shared_ptr<bounding_volume_hierarchy_node<T>>> mNodes;
+		std::list<bounding_volume_hierarchy_allocator> mChildren;
 
 		size_t mCurrentNodes = 0;
 	};
 
+	template <typename T, size_t Width>
+	class wide_bounding_volume_hierarchy;
+
+	template <typename T>
+	class quantized_bounding_volume_hierarchy;
+
+	/*
+	 * bounding_volume_hierarchy builds a binary hierarchy of elements.
+	 * when the split method is spatial_split, an element may be referenced by more than one leaf,
+	 * so the elements() of hierarchy may have duplicated elements and more boxes than we build it with.
+	 * if T has split_bounding_box(axis, position, left, right), the spatial split uses it to find the boxes of
+	 * the parts of element on each side of plane, otherwise the box of element is cut by the plane.
+	 */
 	template <typename T>
 	class bounding_volume_hierarchy final : public accelerator<T> {
 	public:
-		explicit bounding_volume_hierarchy(const std::vector<bounding_box<T>>& boxes);
+		explicit bounding_volume_hierarchy(
+			const std::vector<T>& elements,
+			const std::vector<bounding_box<T>>& boxes, 
+			const bounding_volume_hierarchy_config& config = bounding_volume_hierarchy_config());
+
+		// adopt the binary hierarchy built outside, the leaf nodes should index into the boxes
+		explicit bounding_volume_hierarchy(
+			const std::vector<T>& elements,
+			const std::vector<bounding_box<T>>& boxes,
+			const std::vector<linear_bounding_volume_hierarchy_node>& nodes,
+			const bounding_volume_hierarchy_config& config = bounding_volume_hierarchy_config());
+
+		bool intersect(const ray& ray, surface_hit& hit) const override;
+
+		bool intersect_with_shadow_ray(const ray& ray, surface_hit& hit) const override;
+
+		bool occluded(const ray& ray, const std::function<bool(const T&)>& ignore) const override;
+
+		uint32 intersect(const ray* rays, size_t count, uint32 active, surface_hit* hits) const override;
+
+		uint32 occluded(const ray* rays, size_t count, uint32 active, const std::function<bool(const T&)>& ignore) const override;
 
-		std::optional<surface_interaction> intersect(const ray& ray) const override;
+		void refit() override;
 
-		std::optional<surface_interaction> intersect_with_shadow_ray(const ray& ray) const override;
+		const std::vector<linear_bounding_volume_hierarchy_node>& nodes() const noexcept;
 	private:
+		template <typename, size_t>
+		friend class wide_bounding_volume_hierarchy;
+
+		template <typename>
+		friend class quantized_bounding_volume_hierarchy;
+
+		constexpr static inline size_t max_buckets = 32;
+
 		struct bucket_info {
 			size_t count = 0;
 
@@ -59,7 +168,41 @@ namespace rainbow::cpus::shared::accelerators {
 			bucket_info() = default;
 		};
 
-		bounding_volume_hierarchy_node<T>* recursive_build(size_t begin, size_t end);
+		using buckets_array = std::array<bucket_info, max_buckets>;
+
+		struct spatial_bucket_info {
+			size_t enter = 0;
+			size_t exit = 0;
+
+			bounding_box<T> box;
+
+			spatial_bucket_info();
+		};
+
+		using spatial_buckets_array = std::array<spatial_bucket_info, max_buckets>;
+
+		bounding_volume_hierarchy_node<T>* recursive_build(bounding_volume_hierarchy_allocator<T>& allocator, size_t begin, size_t end, size_t depth);
+
+		// build the sub-tree of references with spatial splits, the references of leaves are appended to the boxes
+		// budget is the number of references the sub-tree can duplicate
+		bounding_volume_hierarchy_node<T>* recursive_build_spatial(bounding_volume_hierarchy_allocator<T>& allocator,
+			std::vector<bounding_box<T>>& references, size_t budget, real overlap_threshold, size_t depth);
+
+		// split the reference into the parts on each side of plane, the part may be empty if the element does not cross the plane
+		void split_reference(const bounding_box<T>& reference, size_t dimension, real position,
+			bounding_box<T>& left, bounding_box<T>& right) const;
+
+		void recursive_flatten(const bounding_volume_hierarchy_node<T>* node, size_t index);
+
+		void recursive_rebuild(bounding_volume_hierarchy_allocator<T>& allocator,
+			const std::vector<linear_bounding_volume_hierarchy_node>& nodes, const std::vector<real>& costs,
+			std::vector<real>& build_costs, uint32 from, size_t index, size_t depth);
+
+		// the SAH cost of each node, the cost of node is the expected cost of a ray that intersects its box
+		std::vector<real> evaluate_costs() const;
+
+		// reorder the pairs of children into treelets with the config, the costs are reordered with the nodes
+		void reorder_treelets();
 
 		size_t split(const bounding_box<T>& centroid_box, const bounding_box<T>& union_box,
 			size_t dimension, size_t begin, size_t end);
@@ -70,15 +213,35 @@ namespace rainbow::cpus::shared::accelerators {
 		size_t split_surface_area_heuristic(const bounding_box<T>& centroid_box, const bounding_box<T>& union_box,
 			size_t dimension, size_t begin, size_t end);
 
-		real cost_surface_area_heuristic(const std::vector<bucket_info>& infos, const bounding_box<T>& union_box,
-			size_t location);
+		void cost_surface_area_heuristic(const buckets_array& infos, const bounding_box<T>& union_box,
+			std::array<real, max_buckets>& costs) const;
+
+		size_t bucket_location(const bounding_box<T>& centroid_box, const vector3& centroid, size_t dimension) const;
+
+		std::vector<linear_bounding_volume_hierarchy_node> mNodes;
 
-		bounding_volume_hierarchy_allocator<T> mAllocator;
-		bounding_volume_hierarchy_node<T>* mRoot;
+		// the SAH cost of each node when it was built, we compare them with the cost after refitting
+		std::vector<real> mCosts;
 
-		constexpr static inline size_t max_elements_one_node = 1;
+		bounding_volume_hierarchy_config mConfig;
+
+		constexpr static inline size_t max_elements_leaf_node = std::numeric_limits<uint16>::max();
+		constexpr static inline size_t max_split_depth = 32;
 	};
 
+	inline bool intersect_bound(const bound3& box, const ray& ray, const vector3& inv_direction, const bool is_negative_direction[3]);
+
+	/*
+	 * treelet_order finds the order of count nodes that puts them into treelets with at most size nodes.
+	 * children(index, candidates) appends the (area, index) of the interior children of node(index).
+	 * a treelet starts at its root and takes the candidate with the largest area(the most likely to be visited) until it is full,
+	 * the candidates left are the roots of other treelets, they are laid out depth-first so a treelet is followed by its sub-treelets.
+	 * the nodes are always ordered after their parent.
+	 * the result is the old index of nodes in new order.
+	 */
+	template <typename Function>
+	std::vector<uint32> treelet_order(size_t count, size_t size, Function&& children);
+
 }
 
 #include "detail/bounding_volume_hierarchy.hpp"
\ No newline at end of file
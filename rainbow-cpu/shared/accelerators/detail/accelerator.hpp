@@ -8,8 +8,8 @@
 namespace rainbow::cpus::shared::accelerators {
 
 	template <typename T>
-	bounding_box<T>::bounding_box(const std::shared_ptr<const T>& entity) :
-		entity(entity), box(entity->bounding_box())
+	bounding_box<T>::bounding_box(const T& element, uint32 index) :
+		index(index), box(element.bounding_box())
 	{
 	}
 
@@ -103,9 +103,64 @@ namespace rainbow::cpus::shared::accelerators {
 	}
 
 	template <typename T>
-	accelerator<T>::accelerator(const std::vector<bounding_box<T>>& boxes) :
-		mBoundingBoxes(boxes)
+	accelerator<T>::accelerator(const std::vector<T>& elements, const std::vector<bounding_box<T>>& boxes) :
+		mBoundingBoxes(boxes), mElements(elements)
 	{
 	}
 
+	template <typename T>
+	uint32 accelerator<T>::intersect(const ray* rays, size_t count, uint32 active, surface_hit* hits) const
+	{
+		uint32 found = 0;
+
+		for (size_t index = 0; index < count; index++) {
+			if ((active & (1u << index)) == 0) continue;
+
+			if (intersect(rays[index], hits[index])) found = found | (1u << index);
+		}
+
+		return found;
+	}
+
+	template <typename T>
+	uint32 accelerator<T>::occluded(const ray* rays, size_t count, uint32 active, const std::function<bool(const T&)>& ignore) const
+	{
+		uint32 blocked = 0;
+
+		for (size_t index = 0; index < count; index++) {
+			if ((active & (1u << index)) == 0) continue;
+
+			if (occluded(rays[index], ignore)) blocked = blocked | (1u << index);
+		}
+
+		return blocked;
+	}
+
+	template <typename T>
+	const std::vector<bounding_box<T>>& accelerator<T>::boxes() const noexcept
+	{
+		return mBoundingBoxes;
+	}
+
+	template <typename T>
+	const std::vector<T>& accelerator<T>::elements() const noexcept
+	{
+		return mElements;
+	}
+
+	template <typename T>
+	void accelerator<T>::reorder_elements()
+	{
+		std::vector<T> elements;
+
+		elements.reserve(mBoundingBoxes.size());
+
+		for (const auto& box : mBoundingBoxes) elements.push_back(mElements[box.index]);
+
+		for (size_t index = 0; index < mBoundingBoxes.size(); index++) 
+			mBoundingBoxes[index].index = static_cast<uint32>(index);
+
+		mElements = std::move(elements);
+	}
+
 }
\ No newline at end of file
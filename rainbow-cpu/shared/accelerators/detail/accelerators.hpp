@@ -0,0 +1,47 @@
+#pragma once
+
+#include "../accelerators.hpp"
+
+namespace rainbow::cpus::shared::accelerators {
+
+	template <typename T>
+	std::shared_ptr<accelerator<T>> create_accelerator(
+		const accelerator_type& type,
+		const std::vector<T>& elements,
+		const std::vector<bounding_box<T>>& boxes,
+		const bounding_volume_hierarchy_config& config)
+	{
+		// the binary hierarchy is the reference implementation, the wide hierarchies are built from it
+		if (type == accelerator_type::bounding_volume_hierarchy4)
+			return std::make_shared<bounding_volume_hierarchy4<T>>(elements, boxes, config);
+
+		if (type == accelerator_type::bounding_volume_hierarchy8)
+			return std::make_shared<bounding_volume_hierarchy8<T>>(elements, boxes, config);
+
+		if (type == accelerator_type::quantized_bounding_volume_hierarchy)
+			return std::make_shared<quantized_bounding_volume_hierarchy<T>>(elements, boxes, config);
+
+		return std::make_shared<bounding_volume_hierarchy<T>>(elements, boxes, config);
+	}
+
+	template <typename T>
+	std::shared_ptr<accelerator<T>> create_accelerator(
+		const accelerator_type& type,
+		const std::vector<T>& elements,
+		const std::vector<bounding_box<T>>& boxes,
+		const std::vector<linear_bounding_volume_hierarchy_node>& nodes,
+		const bounding_volume_hierarchy_config& config)
+	{
+		if (type == accelerator_type::bounding_volume_hierarchy4)
+			return std::make_shared<bounding_volume_hierarchy4<T>>(elements, boxes, nodes, config);
+
+		if (type == accelerator_type::bounding_volume_hierarchy8)
+			return std::make_shared<bounding_volume_hierarchy8<T>>(elements, boxes, nodes, config);
+
+		if (type == accelerator_type::quantized_bounding_volume_hierarchy)
+			return std::make_shared<quantized_bounding_volume_hierarchy<T>>(elements, boxes, nodes, config);
+
+		return std::make_shared<bounding_volume_hierarchy<T>>(elements, boxes, nodes, config);
+	}
+	
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "../block_hierarchy.hpp"
+
+namespace rainbow::cpus::shared::accelerators {
+
+	template <typename Reference, typename Instance>
+	void build_references(const Instance* instance, size_t count,
+		std::vector<Reference>& references, std::vector<bounding_box<Reference>>& boxes)
+	{
+		references.clear();
+		boxes.clear();
+
+		references.reserve(count);
+		boxes.reserve(count);
+
+		for (size_t index = 0; index < count; index++) {
+			references.push_back(Reference(instance, index));
+			boxes.push_back(bounding_box<Reference>(references.back(), static_cast<uint32>(index)));
+		}
+	}
+
+	template <typename Block, typename T, typename Fill>
+	std::vector<linear_bounding_volume_hierarchy_node> build_block_hierarchy(
+		const std::vector<T>& elements, const std::vector<bounding_box<T>>& boxes,
+		bounding_volume_hierarchy_config config, std::vector<Block>& blocks, const Fill& fill)
+	{
+		config.max_leaf_elements = Block::width;
+
+		const bounding_volume_hierarchy<T> hierarchy(elements, boxes, config);
+
+		auto nodes = hierarchy.nodes();
+
+		blocks.clear();
+		blocks.reserve(nodes.size() / 2 + 1);
+
+		for (auto& node : nodes) {
+			if (!node.is_leaf()) continue;
+
+			const auto first = blocks.size();
+
+			for (size_t index = node.offset; index < node.offset + node.count; index += Block::width) {
+				Block block;
+
+				block.count = static_cast<uint32>(std::min(Block::width, node.offset + node.count - index));
+
+				for (size_t lane = 0; lane < block.count; lane++)
+					fill(block, lane, hierarchy.elements()[index + lane]);
+
+				blocks.push_back(block);
+			}
+
+			// now the leaf node indexes into the blocks
+			node.offset = static_cast<uint32>(first);
+			node.count = static_cast<uint16>(blocks.size() - first);
+		}
+
+		return nodes;
+	}
+
+}
@@ -1,14 +1,154 @@
 #pragma once
 
+#include "../../../../rainbow-core/thread_pool.hpp"
 #include "../bounding_volume_hierarchy.hpp"
 
+#include <type_traits>
 #include <algorithm>
-#include <stack>
+#include <queue>
 
 #define BOUNDING_VOLUME_HIERARCHY_POOL_SIZE 16
+#define BOUNDING_VOLUME_HIERARCHY_STACK_SIZE 64
+
+#undef near
+#undef far
 
 namespace rainbow::cpus::shared::accelerators {
 
+	template <typename T, typename = void>
+	struct has_split_bounding_box : std::false_type {};
+
+	template <typename T>
+	struct has_split_bounding_box<T, std::void_t<decltype(std::declval<const T&>().split_bounding_box(
+		std::declval<size_t>(), std::declval<real>(), std::declval<bound3&>(), std::declval<bound3&>()))>> : std::true_type {};
+
+	template <typename T, typename = void>
+	struct has_packet_intersect : std::false_type {};
+
+	template <typename T>
+	struct has_packet_intersect<T, std::void_t<decltype(std::declval<const T&>().intersect(
+		std::declval<const ray*>(), std::declval<size_t>(), std::declval<uint32>(), std::declval<surface_hit*>()))>> : std::true_type {};
+
+	template <typename T, typename = void>
+	struct has_packet_occluded : std::false_type {};
+
+	template <typename T>
+	struct has_packet_occluded<T, std::void_t<decltype(std::declval<const T&>().occluded(
+		std::declval<const ray*>(), std::declval<size_t>(), std::declval<uint32>()))>> : std::true_type {};
+
+	// test the element with the rays in mask, if the element supports packets(e.g. the instance of mesh) it traces them together
+	template <typename T>
+	uint32 intersect_element(const T& element, const ray* rays, size_t count, uint32 mask, surface_hit* hits)
+	{
+		if constexpr (has_packet_intersect<T>::value) return element.intersect(rays, count, mask, hits);
+		else {
+			uint32 found = 0;
+
+			for (size_t index = 0; index < count; index++) {
+				if ((mask & (1u << index)) == 0) continue;
+
+				if (element.intersect(rays[index], hits[index])) found = found | (1u << index);
+			}
+
+			return found;
+		}
+	}
+
+	template <typename T>
+	uint32 occluded_element(const T& element, const ray* rays, size_t count, uint32 mask)
+	{
+		if constexpr (has_packet_occluded<T>::value) return element.occluded(rays, count, mask);
+		else {
+			uint32 blocked = 0;
+
+			for (size_t index = 0; index < count; index++) {
+				if ((mask & (1u << index)) == 0) continue;
+
+				if (element.occluded(rays[index])) blocked = blocked | (1u << index);
+			}
+
+			return blocked;
+		}
+	}
+
+	template <typename T>
+	bool is_empty_box(const bounding_box<T>& box) noexcept
+	{
+		return box.box.min.x > box.box.max.x || box.box.min.y > box.box.max.y || box.box.min.z > box.box.max.z;
+	}
+
+	template <typename T>
+	bounding_box<T> empty_box() noexcept
+	{
+		bounding_box<T> box;
+
+		box.box.min = vector3(+std::numeric_limits<real>::infinity());
+		box.box.max = vector3(-std::numeric_limits<real>::infinity());
+
+		return box;
+	}
+
+	inline bool intersect_bound(const bound3& box, const ray& ray, const vector3& inv_direction, const bool is_negative_direction[3])
+	{
+		auto t0 = static_cast<real>(0), t1 = ray.length;
+
+		// enum the slab of axis-aligned bounding box
+		// we use the sign of direction to choose the near and far plane, so we do not need swap them
+		for (int dimension = 0; dimension < 3; dimension++) {
+			const auto near = ((is_negative_direction[dimension] ? box.max : box.min)[dimension] - ray.origin[dimension]) * inv_direction[dimension];
+			const auto far = ((is_negative_direction[dimension] ? box.min : box.max)[dimension] - ray.origin[dimension]) * inv_direction[dimension];
+
+			// if near or far is nan(0 * inf), the comparison is false and t0, t1 will not be changed
+			if (near > t0) t0 = near;
+			if (far < t1) t1 = far;
+
+			if (t0 > t1) return false;
+		}
+
+		return true;
+	}
+
+	template <typename Function>
+	std::vector<uint32> treelet_order(size_t count, size_t size, Function&& children)
+	{
+		std::vector<uint32> order;
+		std::vector<uint32> roots;
+		std::vector<uint32> rest;
+
+		std::vector<std::pair<real, uint32>> nodes;
+
+		order.reserve(count);
+		roots.push_back(0);
+
+		while (!roots.empty()) {
+			std::priority_queue<std::pair<real, uint32>> candidates;
+
+			candidates.push({ std::numeric_limits<real>::infinity(), roots.back() });
+
+			roots.pop_back();
+
+			for (size_t taken = 0; taken < size && !candidates.empty(); taken++) {
+				const auto index = candidates.top().second;
+
+				candidates.pop();
+				order.push_back(index);
+
+				nodes.clear();
+
+				children(index, nodes);
+
+				for (const auto& node : nodes) candidates.push(node);
+			}
+
+			// the roots are a stack, the largest candidate is on the top so its treelet will follow this one
+			for (rest.clear(); !candidates.empty(); candidates.pop()) rest.push_back(candidates.top().second);
+
+			roots.insert(roots.end(), rest.rbegin(), rest.rend());
+		}
+
+		return order;
+	}
+
 	template <typename T>
 	bounding_volume_hierarchy_node<T>::bounding_volume_hierarchy_node(const bounding_box<T>& box, size_t begin, size_t end) :
 		box(box), begin(begin), end(end)
@@ -36,12 +176,80 @@ namespace rainbow::cpus::shared::accelerators {
 		mMemoryPools.push_back(std::vector<bounding_volume_hierarchy_node<T>>(BOUNDING_VOLUME_HIERARCHY_POOL_SIZE));
 	}
 
+	inline bool linear_bounding_volume_hierarchy_node::is_leaf() const noexcept
+	{
+		return count != 0;
+	}
+
 	template <typename T>
-	bounding_volume_hierarchy<T>::bounding_volume_hierarchy(const std::vector<bounding_box<T>>& boxes) :
-		accelerator<T>(boxes), mRoot(recursive_build(0, boxes.size()))
+	bounding_volume_hierarchy<T>::spatial_bucket_info::spatial_bucket_info() : box(empty_box<T>())
 	{
 	}
 
+	template <typename T>
+	bounding_volume_hierarchy<T>::bounding_volume_hierarchy(
+		const std::vector<T>& elements, const std::vector<bounding_box<T>>& boxes,
+		const bounding_volume_hierarchy_config& config) :
+		accelerator<T>(elements, boxes), mConfig(config)
+	{
+		mConfig.buckets = std::clamp(mConfig.buckets, static_cast<size_t>(2), max_buckets);
+		mConfig.max_leaf_elements = std::clamp(mConfig.max_leaf_elements, static_cast<size_t>(1), max_elements_leaf_node);
+
+		if (this->mBoundingBoxes.empty()) return;
+
+		// the nodes built by recursive_build are only used when we build the hierarchy
+		// we will flatten them into mNodes and release them when the allocator is destroyed
+		bounding_volume_hierarchy_allocator<T> allocator;
+
+		bounding_volume_hierarchy_node<T>* root = nullptr;
+
+		if (mConfig.split_method == bounding_volume_hierarchy_split_method::spatial_split) {
+			// the spatial split duplicates the references, so the sub-trees can not be built in place
+			// the references of each node are stored in its own array and the leaves append them into the boxes
+			auto references = std::move(this->mBoundingBoxes);
+			auto union_box = references[0];
+
+			for (size_t index = 1; index < references.size(); index++) union_box.union_it(references[index]);
+
+			const auto budget = static_cast<size_t>(static_cast<real>(references.size()) * mConfig.spatial_split_budget);
+
+			this->mBoundingBoxes.clear();
+			this->mBoundingBoxes.reserve(references.size() + budget);
+
+			root = recursive_build_spatial(allocator, references, budget, union_box.area() * mConfig.spatial_split_alpha, 0);
+		}
+		else root = recursive_build(allocator, 0, this->mBoundingBoxes.size(), 0);
+
+		mNodes.reserve(2 * this->mBoundingBoxes.size());
+		mNodes.push_back(linear_bounding_volume_hierarchy_node());
+
+		recursive_flatten(root, 0);
+
+		// recursive_build changed the order of boxes, the elements of leaf should be consecutive
+		this->reorder_elements();
+
+		mCosts = evaluate_costs();
+
+		reorder_treelets();
+	}
+
+	template <typename T>
+	bounding_volume_hierarchy<T>::bounding_volume_hierarchy(
+		const std::vector<T>& elements, const std::vector<bounding_box<T>>& boxes,
+		const std::vector<linear_bounding_volume_hierarchy_node>& nodes,
+		const bounding_volume_hierarchy_config& config) :
+		accelerator<T>(elements, boxes), mNodes(nodes), mConfig(config)
+	{
+		mConfig.buckets = std::clamp(mConfig.buckets, static_cast<size_t>(2), max_buckets);
+		mConfig.max_leaf_elements = std::clamp(mConfig.max_leaf_elements, static_cast<size_t>(1), max_elements_leaf_node);
+
+		this->reorder_elements();
+
+		mCosts = evaluate_costs();
+
+		reorder_treelets();
+	}
+
 	template <typename T>
 	bounding_volume_hierarchy_node<T>* bounding_volume_hierarchy_allocator<T>::allocate()
 	{
@@ -56,14 +264,27 @@ namespace rainbow::cpus::shared::accelerators {
 		return &mMemoryPools.back()[mCurrentNodes++];
 	}
 
+	template <typename T>
+	bounding_volume_hierarchy_allocator<T>& bounding_volume_hierarchy_allocator<T>::fork()
+	{
+		// only the thread that owns this allocator can fork it, so we do not need lock the list
+		// std::list does not move the allocators when we add new one
+		return mChildren.emplace_back();
+	}
+
 
 	template <typename T>
-	std::optional<surface_interaction> bounding_volume_hierarchy<T>::intersect(const ray& ray) const
+	bool bounding_volume_hierarchy<T>::intersect(const ray& ray, surface_hit& hit) const
 	{
-		std::stack<bounding_volume_hierarchy_node<T>*> stack;
-		std::optional<surface_interaction> nearest_interaction;
+		auto found = false;
 
-		stack.push(mRoot);
+		if (mNodes.empty()) return found;
+
+		// the stack is allocated on the stack of thread, we do not need allocate memory for each ray
+		// the depth of hierarchy is limited when we build it, so the stack can not overflow
+		uint32 stack[BOUNDING_VOLUME_HIERARCHY_STACK_SIZE];
+		size_t stack_size = 0;
+		uint32 current = 0;
 
 		const auto inv_direction = static_cast<real>(1) / ray.direction;
 		const bool is_negative_direction[3] = {
@@ -72,48 +293,56 @@ namespace rainbow::cpus::shared::accelerators {
 			inv_direction.z < 0
 		};
 
-		while (!stack.empty()) {
-			const auto node = stack.top(); stack.pop();
+		while (true) {
+			const auto& node = mNodes[current];
 
 			// if the ray is not intersect with this node
 			// there are no entities in this node's bounding box intersect with ray
-			if (!node->box.intersect(ray)) continue;
-
-			// if the node is leaf, we can test the entities in this node with ray
-			if (node->is_leaf()) {
+			if (intersect_bound(node.box, ray, inv_direction, is_negative_direction)) {
 
-				// loop all entities in this node to find the nearest interaction
-				for (auto index = node->begin; index < node->end; index++) {
-					const auto interaction =
-						this->mBoundingBoxes[index].entity->intersect(ray);
+				// if the node is leaf, we can test the entities in this node with ray
+				if (node.is_leaf()) {
 
-					if (interaction.has_value()) nearest_interaction = interaction;
+					// loop all entities in this node to find the nearest hit
+					// the ray.length is updated when we find a hit, so the later hit is always nearer
+					for (auto index = node.offset; index < node.offset + node.count; index++) 
+						if (this->mElements[index].intersect(ray, hit)) found = true;
+				}
+				else {
+					// if the direction of ray is negative, the near child should be the right child
+					// if the direction of ray is not negative, the near child should be the left child
+					// we will travel the near child firstly and push the far child into stack
+					if (is_negative_direction[node.axis]) {
+						stack[stack_size++] = node.offset;
+						current = node.offset + 1;
+					}
+					else {
+						stack[stack_size++] = node.offset + 1;
+						current = node.offset;
+					}
+
+					continue;
 				}
-
-				continue;
 			}
 
-			// if the direction of ray is negative, the near child should be the right child
-			// if the direction of ray is not negative, the near child should be the left child
-			// we will travel the near child firstly
-			if (is_negative_direction[node->axis]) {
-				stack.push(node->left); stack.push(node->right);
-			}
-			else {
-				stack.push(node->right); stack.push(node->left);
-			}
+			if (stack_size == 0) break;
+
+			current = stack[--stack_size];
 		}
 
-		return nearest_interaction;
+		return found;
 	}
 
 	template <typename T>
-	std::optional<surface_interaction> bounding_volume_hierarchy<T>::intersect_with_shadow_ray(const ray& ray) const
+	bool bounding_volume_hierarchy<T>::intersect_with_shadow_ray(const ray& ray, surface_hit& hit) const
 	{
-		std::stack<bounding_volume_hierarchy_node<T>*> stack;
-		std::optional<surface_interaction> nearest_interaction;
+		auto found = false;
+
+		if (mNodes.empty()) return found;
 
-		stack.push(mRoot);
+		uint32 stack[BOUNDING_VOLUME_HIERARCHY_STACK_SIZE];
+		size_t stack_size = 0;
+		uint32 current = 0;
 
 		const auto inv_direction = static_cast<real>(1) / ray.direction;
 		const bool is_negative_direction[3] = {
@@ -122,47 +351,291 @@ namespace rainbow::cpus::shared::accelerators {
 			inv_direction.z < 0
 		};
 
-		while (!stack.empty()) {
-			const auto node = stack.top(); stack.pop();
+		while (true) {
+			const auto& node = mNodes[current];
 
 			// if the ray is not intersect with this node
 			// there are no entities in this node's bounding box intersect with ray
-			if (!node->box.intersect(ray)) continue;
+			if (intersect_bound(node.box, ray, inv_direction, is_negative_direction)) {
+
+				// if the node is leaf, we can test the entities in this node with ray
+				if (node.is_leaf()) {
+
+					// loop all entities in this node to find the nearest hit
+					for (auto index = node.offset; index < node.offset + node.count; index++) {
+						if (!this->mElements[index].visible()) continue;
+
+						if (this->mElements[index].intersect(ray, hit)) found = true;
+					}
+				}
+				else {
+					// if the direction of ray is negative, the near child should be the right child
+					// if the direction of ray is not negative, the near child should be the left child
+					// we will travel the near child firstly and push the far child into stack
+					if (is_negative_direction[node.axis]) {
+						stack[stack_size++] = node.offset;
+						current = node.offset + 1;
+					}
+					else {
+						stack[stack_size++] = node.offset + 1;
+						current = node.offset;
+					}
+
+					continue;
+				}
+			}
+
+			if (stack_size == 0) break;
+
+			current = stack[--stack_size];
+		}
+
+		return found;
+	}
+
+	template <typename T>
+	bool bounding_volume_hierarchy<T>::occluded(const ray& ray, const std::function<bool(const T&)>& ignore) const
+	{
+		if (mNodes.empty()) return false;
+
+		uint32 stack[BOUNDING_VOLUME_HIERARCHY_STACK_SIZE];
+		size_t stack_size = 0;
+		uint32 current = 0;
+
+		const auto inv_direction = static_cast<real>(1) / ray.direction;
+		const bool is_negative_direction[3] = {
+			inv_direction.x < 0,
+			inv_direction.y < 0,
+			inv_direction.z < 0
+		};
 
-			// if the node is leaf, we can test the entities in this node with ray
-			if (node->is_leaf()) {
+		while (true) {
+			const auto& node = mNodes[current];
 
-				// loop all entities in this node to find the nearest interaction
-				for (auto index = node->begin; index < node->end; index++) {
-					if (!this->mBoundingBoxes[index].entity->visible()) continue;
+			if (intersect_bound(node.box, ray, inv_direction, is_negative_direction)) {
 
-					const auto interaction =
-						this->mBoundingBoxes[index].entity->intersect(ray);
+				// if the node is leaf, we can test the entities in this node with ray
+				// any entity blocks the ray means the ray is occluded, so we can return directly
+				if (node.is_leaf()) {
+					for (auto index = node.offset; index < node.offset + node.count; index++) {
+						const auto& entity = this->mElements[index];
 
-					if (interaction.has_value()) nearest_interaction = interaction;
+						if (!entity.visible() || (ignore && ignore(entity))) continue;
+
+						if (entity.occluded(ray)) return true;
+					}
+				}
+				else {
+					// the order of children does not change the result
+					// but the near child is more likely to block the ray, so we travel it firstly
+					if (is_negative_direction[node.axis]) {
+						stack[stack_size++] = node.offset;
+						current = node.offset + 1;
+					}
+					else {
+						stack[stack_size++] = node.offset + 1;
+						current = node.offset;
+					}
+
+					continue;
 				}
+			}
 
-				continue;
+			if (stack_size == 0) break;
+
+			current = stack[--stack_size];
+		}
+
+		return false;
+	}
+
+	template <typename T>
+	uint32 bounding_volume_hierarchy<T>::intersect(const ray* rays, size_t count, uint32 active, surface_hit* hits) const
+	{
+		uint32 found = 0;
+
+		if (mNodes.empty() || active == 0) return found;
+
+		// the rays travel the hierarchy together, each node has the mask of rays that intersect its parent
+		// the rays that miss the node are removed from the mask, and we skip the node if no ray is left
+		uint32 stack[BOUNDING_VOLUME_HIERARCHY_STACK_SIZE];
+		uint32 stack_mask[BOUNDING_VOLUME_HIERARCHY_STACK_SIZE];
+		size_t stack_size = 0;
+		uint32 current = 0;
+		uint32 mask = active;
+
+		ray_packet_info info(rays, count, active);
+
+		while (true) {
+			const auto& node = mNodes[current];
+
+			mask = info.intersect(node.box, mask);
+
+			if (mask != 0) {
+				if (node.is_leaf()) {
+					for (auto index = node.offset; index < node.offset + node.count; index++)
+						found = found | intersect_element(this->mElements[index], rays, count, mask, hits);
+
+					// the rays that find a nearer hit will cull the farther nodes
+					for (size_t index = 0; index < count; index++)
+						if ((mask & (1u << index)) != 0) info.update(index, rays[index].length);
+				}
+				else {
+					// the near child is chosen by the first ray, the coherent rays have the same near child
+					if (info.is_negative_direction(node.axis, mask)) {
+						stack[stack_size] = node.offset;
+						current = node.offset + 1;
+					}
+					else {
+						stack[stack_size] = node.offset + 1;
+						current = node.offset;
+					}
+
+					stack_mask[stack_size++] = mask;
+
+					continue;
+				}
 			}
 
-			// if the direction of ray is negative, the near child should be the right child
-			// if the direction of ray is not negative, the near child should be the left child
-			// we will travel the near child firstly
-			if (is_negative_direction[node->axis]) {
-				stack.push(node->left); stack.push(node->right);
+			if (stack_size == 0) break;
+
+			current = stack[--stack_size];
+			mask = stack_mask[stack_size];
+		}
+
+		return found;
+	}
+
+	template <typename T>
+	uint32 bounding_volume_hierarchy<T>::occluded(const ray* rays, size_t count, uint32 active, const std::function<bool(const T&)>& ignore) const
+	{
+		uint32 blocked = 0;
+
+		if (mNodes.empty() || active == 0) return blocked;
+
+		uint32 stack[BOUNDING_VOLUME_HIERARCHY_STACK_SIZE];
+		uint32 stack_mask[BOUNDING_VOLUME_HIERARCHY_STACK_SIZE];
+		size_t stack_size = 0;
+		uint32 current = 0;
+		uint32 mask = active;
+
+		ray_packet_info info(rays, count, active);
+
+		while (true) {
+			const auto& node = mNodes[current];
+
+			// the blocked rays do not need to travel the hierarchy anymore
+			mask = info.intersect(node.box, mask & ~blocked);
+
+			if (mask != 0) {
+				if (node.is_leaf()) {
+					for (auto index = node.offset; index < node.offset + node.count; index++) {
+						const auto& entity = this->mElements[index];
+
+						if (!entity.visible() || (ignore && ignore(entity))) continue;
+
+						blocked = blocked | occluded_element(entity, rays, count, mask & ~blocked);
+
+						if ((active & ~blocked) == 0) return blocked;
+					}
+				}
+				else {
+					if (info.is_negative_direction(node.axis, mask)) {
+						stack[stack_size] = node.offset;
+						current = node.offset + 1;
+					}
+					else {
+						stack[stack_size] = node.offset + 1;
+						current = node.offset;
+					}
+
+					stack_mask[stack_size++] = mask;
+
+					continue;
+				}
+			}
+
+			if (stack_size == 0) break;
+
+			current = stack[--stack_size];
+			mask = stack_mask[stack_size];
+		}
+
+		return blocked;
+	}
+
+	template <typename T>
+	void bounding_volume_hierarchy<T>::refit()
+	{
+		if (mNodes.empty()) return;
+
+		for (size_t index = 0; index < this->mBoundingBoxes.size(); index++)
+			this->mBoundingBoxes[index].box = this->mElements[index].bounding_box();
+
+		// the children are always stored after their parent
+		// so we can update the boxes from leaves to root in reverse order
+		for (auto index = mNodes.size(); index > 0; index--) {
+			auto& node = mNodes[index - 1];
+
+			if (node.is_leaf()) {
+				node.box = this->mBoundingBoxes[node.offset].box;
+
+				for (auto element = node.offset + 1; element < node.offset + node.count; element++)
+					node.box.union_it(this->mBoundingBoxes[element].box);
 			}
 			else {
-				stack.push(node->right); stack.push(node->left);
+				node.box = mNodes[node.offset + 0].box;
+				node.box.union_it(mNodes[node.offset + 1].box);
 			}
 		}
 
-		return nearest_interaction;
+		// if the cost of sub-tree is much worse than the cost when it was built, we will rebuild it
+		// if there is no such sub-tree, refitting the boxes is enough
+		const auto costs = evaluate_costs();
+
+		auto worse = false;
+
+		for (size_t index = 0; index < mNodes.size() && !worse; index++)
+			worse = !mNodes[index].is_leaf() && costs[index] > mCosts[index] * mConfig.rebuild_threshold;
+
+		if (!worse) return;
+
+		// the nodes built by recursive_build are only used when we rebuild the hierarchy
+		bounding_volume_hierarchy_allocator<T> allocator;
+
+		const auto nodes = std::move(mNodes);
+
+		// the build cost of nodes we copied from old hierarchy, the rebuilt nodes are -1
+		std::vector<real> build_costs(1, static_cast<real>(-1));
+
+		mNodes.clear();
+		mNodes.reserve(nodes.size());
+		mNodes.push_back(linear_bounding_volume_hierarchy_node());
+
+		recursive_rebuild(allocator, nodes, costs, build_costs, 0, 0, 0);
+
+		build_costs.resize(mNodes.size(), static_cast<real>(-1));
+
+		mCosts = evaluate_costs();
+
+		for (size_t index = 0; index < mNodes.size(); index++)
+			if (build_costs[index] >= 0) mCosts[index] = build_costs[index];
+
+		// the rebuilt hierarchy is in depth-first order again
+		reorder_treelets();
 	}
 
 	template <typename T>
-	bounding_volume_hierarchy_node<T>* bounding_volume_hierarchy<T>::recursive_build(size_t begin, size_t end)
+	const std::vector<linear_bounding_volume_hierarchy_node>& bounding_volume_hierarchy<T>::nodes() const noexcept
 	{
-		const auto node = mAllocator.allocate();
+		return mNodes;
+	}
+
+	template <typename T>
+	bounding_volume_hierarchy_node<T>* bounding_volume_hierarchy<T>::recursive_build(
+		bounding_volume_hierarchy_allocator<T>& allocator, size_t begin, size_t end, size_t depth)
+	{
+		const auto node = allocator.allocate();
 
 		auto union_box = this->mBoundingBoxes[begin];
 
@@ -186,29 +659,528 @@ namespace rainbow::cpus::shared::accelerators {
 
 		// if the centroid of all boxes are same, we can not divide them into nodes,
 		// so the node should be leaf
-		if (centroid_box.box.max[static_cast<int>(dimension)] == centroid_box.box.min[static_cast<int>(dimension)])
-			return &((*node) = bounding_volume_hierarchy_node(union_box, begin, end));
+		// if there are too many elements to store in one leaf, we just divide them into two equal part
+		auto middle = (begin + end) >> 1;
+
+		if (centroid_box.box.max[static_cast<int>(dimension)] == centroid_box.box.min[static_cast<int>(dimension)]) {
+			if (end - begin <= max_elements_leaf_node)
+				return &((*node) = bounding_volume_hierarchy_node(union_box, begin, end));
+		}
+		else {
+			// the depth of node is limited by the size of traversal stack
+			// when the depth is too large, we will split the elements into two equal part
+			// so the depth of sub-tree is at most log2(end - begin) and the stack will never overflow
+			middle = depth < max_split_depth ?
+				split(centroid_box, union_box, dimension, begin, end) :
+				split_equal_count(centroid_box, union_box, dimension, begin, end);
+
+			// when the middle is equal to begin or end, it means the other node is empty
+			// we can reduce the situation, make the node as leaf 
+			if ((middle == begin || middle == end) && end - begin <= max_elements_leaf_node)
+				return &((*node) = bounding_volume_hierarchy_node(union_box, begin, end));
+
+			if (middle == begin || middle == end) middle = (begin + end) >> 1;
+		}
+
+		// if the sub-tree is large enough, we build the left child as a task of thread pool with its own allocator
+		// the two children use disjoint ranges of elements, so they can be built at the same time
+		// the thread waiting the left child builds other sub-trees, so the nested tasks do not block the workers
+		if (mConfig.parallel_threshold != 0 && end - begin >= mConfig.parallel_threshold) {
+			auto& left_allocator = allocator.fork();
+			auto& pool = thread_pool::instance();
+
+			auto left = pool.submit([&, begin, middle, depth]()
+				{
+					return recursive_build(left_allocator, begin, middle, depth + 1);
+				});
+
+			const auto right = recursive_build(allocator, middle, end, depth + 1);
 
-		const auto middle = split(centroid_box, union_box, dimension, begin, end);
+			(*node) = bounding_volume_hierarchy_node(pool.wait(left), right, begin, end, dimension);
 
-		// when the middle is equal to begin or end, it means the other node is empty
-		// we can reduce the situation, make the node as leaf 
-		if (middle == begin || middle == end)
-			return &((*node) = bounding_volume_hierarchy_node(union_box, begin, end));
+			return node;
+		}
 
 		(*node) = bounding_volume_hierarchy_node(
-			recursive_build(begin, middle),
-			recursive_build(middle, end),
+			recursive_build(allocator, begin, middle, depth + 1),
+			recursive_build(allocator, middle, end, depth + 1),
 			begin, end, dimension
 		);
 
 		return node;
 	}
 
+	template <typename T>
+	bounding_volume_hierarchy_node<T>* bounding_volume_hierarchy<T>::recursive_build_spatial(
+		bounding_volume_hierarchy_allocator<T>& allocator, std::vector<bounding_box<T>>& references,
+		size_t budget, real overlap_threshold, size_t depth)
+	{
+		const auto node = allocator.allocate();
+		const auto count = references.size();
+
+		auto union_box = references[0];
+
+		for (size_t index = 1; index < count; index++) union_box.union_it(references[index]);
+
+		// the leaf appends its references into the boxes, the left sub-tree is always built before the right one
+		// so the references of each sub-tree are consecutive as the hierarchy built in place
+		const auto create_leaf = [&]()
+		{
+			const auto begin = this->mBoundingBoxes.size();
+
+			this->mBoundingBoxes.insert(this->mBoundingBoxes.end(), references.begin(), references.end());
+
+			return &((*node) = bounding_volume_hierarchy_node(union_box, begin, this->mBoundingBoxes.size()));
+		};
+
+		if (count == 1) return create_leaf();
+
+		auto centroid_box = bounding_box<T>(references[0].centroid(), references[0].centroid());
+
+		for (size_t index = 1; index < count; index++) centroid_box.union_it(references[index].centroid());
+
+		const auto dimension = centroid_box.max_dimension();
+		const auto axis = static_cast<int>(dimension);
+
+		std::vector<bounding_box<T>> left_references;
+		std::vector<bounding_box<T>> right_references;
+
+		auto split_dimension = dimension;
+
+		left_references.reserve(count);
+		right_references.reserve(count);
+
+		// the same as recursive_build, the node with same centroids or too deep is split into two equal part
+		if (centroid_box.max()[axis] == centroid_box.min()[axis] || depth >= max_split_depth) {
+			if (centroid_box.max()[axis] == centroid_box.min()[axis] && count <= max_elements_leaf_node) return create_leaf();
+
+			const auto middle = references.begin() + (count >> 1);
+
+			std::nth_element(references.begin(), middle, references.end(),
+				[axis](const bounding_box<T>& left, const bounding_box<T>& right)
+				{
+					return left.centroid()[axis] < right.centroid()[axis];
+				});
+
+			left_references.assign(references.begin(), middle);
+			right_references.assign(middle, references.end());
+		}
+		else {
+			// find the best object split with the same buckets as split_surface_area_heuristic
+			buckets_array buckets;
+
+			for (const auto& reference : references) {
+				auto& bucket = buckets[bucket_location(centroid_box, reference.centroid(), dimension)];
+
+				if (bucket.count == 0) bucket.box = reference;
+				else bucket.box.union_it(reference);
+
+				bucket.count = bucket.count + 1;
+			}
+
+			std::array<real, max_buckets> costs;
+
+			cost_surface_area_heuristic(buckets, union_box, costs);
+
+			auto object_location = static_cast<size_t>(0);
+			auto object_cost = costs[0];
+
+			for (size_t location = 1; location < mConfig.buckets - 1; location++)
+				if (object_cost > costs[location]) object_cost = costs[location], object_location = location;
+
+			// the spatial split is only useful when the children of object split overlap
+			auto object_left = empty_box<T>(), object_right = empty_box<T>();
+
+			for (size_t location = 0; location < mConfig.buckets; location++) {
+				if (buckets[location].count == 0) continue;
+
+				(location <= object_location ? object_left : object_right).union_it(buckets[location].box);
+			}
+
+			auto overlap = empty_box<T>();
+
+			overlap.box.min = math::max(object_left.box.min, object_right.box.min);
+			overlap.box.max = math::min(object_left.box.max, object_right.box.max);
+
+			const auto spatial_dimension = union_box.max_dimension();
+			const auto spatial_axis = static_cast<int>(spatial_dimension);
+			const auto spatial_min = union_box.min()[spatial_axis];
+			const auto spatial_extent = union_box.max()[spatial_axis] - spatial_min;
+
+			const auto spatial_location_of = [&](real position)
+			{
+				const auto location = static_cast<size_t>(std::max(static_cast<real>(0),
+					(position - spatial_min) / spatial_extent * static_cast<real>(mConfig.buckets)));
+
+				return std::min(location, mConfig.buckets - 1);
+			};
+
+			const auto spatial_plane_of = [&](size_t location)
+			{
+				return spatial_min + spatial_extent * static_cast<real>(location) / static_cast<real>(mConfig.buckets);
+			};
+
+			auto spatial_location = static_cast<size_t>(0);
+			auto spatial_cost = std::numeric_limits<real>::infinity();
+
+			spatial_buckets_array spatial_buckets;
+
+			if (budget != 0 && spatial_extent > 0 && !is_empty_box(overlap) && overlap.area() > overlap_threshold) {
+				// put the references into the buckets they cross, the reference is chopped at the boundaries of buckets
+				// enter and exit count the references that start and end in the bucket
+				for (const auto& reference : references) {
+					const auto first = spatial_location_of(reference.min()[spatial_axis]);
+					const auto last = spatial_location_of(reference.max()[spatial_axis]);
+
+					auto remain = reference;
+
+					for (auto location = first; location < last; location++) {
+						bounding_box<T> left, right;
+
+						split_reference(remain, spatial_dimension, spatial_plane_of(location + 1), left, right);
+
+						spatial_buckets[location].box.union_it(left);
+
+						remain = right;
+					}
+
+					spatial_buckets[last].box.union_it(remain);
+					spatial_buckets[first].enter++;
+					spatial_buckets[last].exit++;
+				}
+
+				// the same sweep as cost_surface_area_heuristic, but the counts of two sides are enter and exit
+				std::array<real, max_buckets> right_costs;
+
+				auto right_box = empty_box<T>();
+				auto right_count = static_cast<size_t>(0);
+
+				for (auto location = mConfig.buckets - 1; location > 0; location--) {
+					right_box.union_it(spatial_buckets[location].box);
+					right_count = right_count + spatial_buckets[location].exit;
+
+					right_costs[location - 1] = right_count == 0 ? std::numeric_limits<real>::infinity() : right_count * right_box.area();
+				}
+
+				const auto inv_area = static_cast<real>(1) / union_box.area();
+
+				auto left_box = empty_box<T>();
+				auto left_count = static_cast<size_t>(0);
+
+				for (size_t location = 0; location < mConfig.buckets - 1; location++) {
+					left_box.union_it(spatial_buckets[location].box);
+					left_count = left_count + spatial_buckets[location].enter;
+
+					if (left_count == 0 || std::isinf(right_costs[location])) continue;
+
+					const auto cost = mConfig.travel_cost + mConfig.test_cost * (left_count * left_box.area() + right_costs[location]) * inv_area;
+
+					if (cost < spatial_cost) spatial_cost = cost, spatial_location = location;
+				}
+			}
+
+			const auto leaf_cost = mConfig.test_cost * count;
+
+			if (count <= mConfig.max_leaf_elements && leaf_cost <= std::min(object_cost, spatial_cost)) return create_leaf();
+
+			if (spatial_cost < object_cost) {
+				const auto position = spatial_plane_of(spatial_location + 1);
+
+				auto left_box = empty_box<T>(), right_box = empty_box<T>();
+				auto left_count = static_cast<size_t>(0), right_count = static_cast<size_t>(0);
+
+				for (size_t location = 0; location < mConfig.buckets; location++) {
+					(location <= spatial_location ? left_box : right_box).union_it(spatial_buckets[location].box);
+
+					left_count = left_count + (location <= spatial_location ? spatial_buckets[location].enter : 0);
+					right_count = right_count + (location > spatial_location ? spatial_buckets[location].exit : 0);
+				}
+
+				// the budget is only used when we accept the spatial split
+				auto duplicated = static_cast<size_t>(0);
+
+				for (const auto& reference : references) {
+					const auto first = spatial_location_of(reference.min()[spatial_axis]);
+					const auto last = spatial_location_of(reference.max()[spatial_axis]);
+
+					if (last <= spatial_location) { left_references.push_back(reference); continue; }
+					if (first > spatial_location) { right_references.push_back(reference); continue; }
+
+					bounding_box<T> left, right;
+
+					split_reference(reference, spatial_dimension, position, left, right);
+
+					if (is_empty_box(right)) { left_references.push_back(reference); continue; }
+					if (is_empty_box(left)) { right_references.push_back(reference); continue; }
+
+					// if putting the whole reference into one side is cheaper than duplicating it, we do not split it
+					const auto split_cost = left_box.area() * left_count + right_box.area() * right_count;
+					const auto unsplit_left_cost = bounding_box<T>(left_box, reference).area() * left_count + right_box.area() * (right_count - 1);
+					const auto unsplit_right_cost = left_box.area() * (left_count - 1) + bounding_box<T>(right_box, reference).area() * right_count;
+
+					if (duplicated == budget || std::min(unsplit_left_cost, unsplit_right_cost) < split_cost) {
+						if (unsplit_left_cost <= unsplit_right_cost) {
+							left_box.union_it(reference);
+							left_references.push_back(reference);
+							right_count = right_count - 1;
+						}
+						else {
+							right_box.union_it(reference);
+							right_references.push_back(reference);
+							left_count = left_count - 1;
+						}
+
+						continue;
+					}
+
+					left_references.push_back(left);
+					right_references.push_back(right);
+
+					duplicated = duplicated + 1;
+				}
+
+				// the chopped boxes may not match the buckets because of the precision
+				// if one side is empty, we use the object split
+				if (left_references.empty() || right_references.empty()) {
+					left_references.clear();
+					right_references.clear();
+
+					spatial_cost = std::numeric_limits<real>::infinity();
+				}
+				else budget = budget - duplicated;
+			}
+
+			if (spatial_cost >= object_cost) {
+				for (const auto& reference : references)
+					(bucket_location(centroid_box, reference.centroid(), dimension) <= object_location ?
+						left_references : right_references).push_back(reference);
+			}
+			else split_dimension = spatial_dimension;
+		}
+
+		// release the references of this node before building the children
+		std::vector<bounding_box<T>>().swap(references);
+
+		// the budget left is shared by the children with the ratio of their references
+		// so the sub-tree built firstly can not use up the budget of others
+		const auto left_budget = static_cast<size_t>(static_cast<double>(budget) * left_references.size() /
+			(left_references.size() + right_references.size()));
+
+		const auto left = recursive_build_spatial(allocator, left_references, left_budget, overlap_threshold, depth + 1);
+		const auto right = recursive_build_spatial(allocator, right_references, budget - left_budget, overlap_threshold, depth + 1);
+
+		(*node) = bounding_volume_hierarchy_node(left, right, left->begin, right->end, split_dimension);
+
+		return node;
+	}
+
+	template <typename T>
+	void bounding_volume_hierarchy<T>::split_reference(const bounding_box<T>& reference, size_t dimension, real position,
+		bounding_box<T>& left, bounding_box<T>& right) const
+	{
+		const auto axis = static_cast<int>(dimension);
+
+		left = reference;
+		right = reference;
+
+		// the element gives the boxes of its parts on each side of plane, they should be clipped by the reference
+		// because the reference may be a part of element that was split before
+		if constexpr (has_split_bounding_box<T>::value) {
+			this->mElements[reference.index].split_bounding_box(dimension, position, left.box, right.box);
+
+			left.box.min = math::max(left.box.min, reference.box.min);
+			left.box.max = math::min(left.box.max, reference.box.max);
+			right.box.min = math::max(right.box.min, reference.box.min);
+			right.box.max = math::min(right.box.max, reference.box.max);
+		}
+
+		left.box.max[axis] = std::min(left.box.max[axis], position);
+		right.box.min[axis] = std::max(right.box.min[axis], position);
+	}
+
+	template <typename T>
+	void bounding_volume_hierarchy<T>::recursive_flatten(const bounding_volume_hierarchy_node<T>* node, size_t index)
+	{
+		// the space of node(index) was reserved by its parent
+		// if the node is not leaf, we reserve two adjacent nodes for the children
+		// and flatten the left sub-tree before the right sub-tree, so the order of nodes is depth-first
+		mNodes[index].box = node->box.box;
+		mNodes[index].axis = static_cast<uint8>(node->axis);
+
+		if (node->is_leaf()) {
+			mNodes[index].offset = static_cast<uint32>(node->begin);
+			mNodes[index].count = static_cast<uint16>(node->end - node->begin);
+
+			return;
+		}
+
+		const auto children = mNodes.size();
+
+		mNodes[index].offset = static_cast<uint32>(children);
+		mNodes[index].count = 0;
+
+		mNodes.push_back(linear_bounding_volume_hierarchy_node());
+		mNodes.push_back(linear_bounding_volume_hierarchy_node());
+
+		recursive_flatten(node->left, children + 0);
+		recursive_flatten(node->right, children + 1);
+	}
+
+	template <typename T>
+	void bounding_volume_hierarchy<T>::recursive_rebuild(bounding_volume_hierarchy_allocator<T>& allocator,
+		const std::vector<linear_bounding_volume_hierarchy_node>& nodes, const std::vector<real>& costs,
+		std::vector<real>& build_costs, uint32 from, size_t index, size_t depth)
+	{
+		// the space of node(index) was reserved by its parent, the same as recursive_flatten
+		// we copy the node(from) of old hierarchy into it, or rebuild the sub-tree if it becomes too bad
+		const auto& node = nodes[from];
+
+		if (!node.is_leaf() && costs[from] > mCosts[from] * mConfig.rebuild_threshold) {
+			// the elements of sub-tree are consecutive, they start at the left-most leaf and end at the right-most leaf
+			auto first = from, last = from;
+
+			while (!nodes[first].is_leaf()) first = nodes[first].offset + 0;
+			while (!nodes[last].is_leaf()) last = nodes[last].offset + 1;
+
+			const size_t begin = nodes[first].offset;
+			const size_t end = static_cast<size_t>(nodes[last].offset) + nodes[last].count;
+
+			recursive_flatten(recursive_build(allocator, begin, end, depth), index);
+
+			// recursive_build changed the order of boxes in [begin, end)
+			// the index of box is still the location of its element before rebuilding
+			std::vector<T> elements;
+
+			elements.reserve(end - begin);
+
+			for (auto location = begin; location < end; location++)
+				elements.push_back(this->mElements[this->mBoundingBoxes[location].index]);
+
+			for (auto location = begin; location < end; location++) {
+				this->mElements[location] = elements[location - begin];
+				this->mBoundingBoxes[location].index = static_cast<uint32>(location);
+			}
+
+			build_costs.resize(mNodes.size(), static_cast<real>(-1));
+			build_costs[index] = static_cast<real>(-1);
+
+			return;
+		}
+
+		mNodes[index] = node;
+		build_costs[index] = mCosts[from];
+
+		if (node.is_leaf()) return;
+
+		const auto children = mNodes.size();
+
+		mNodes[index].offset = static_cast<uint32>(children);
+
+		mNodes.push_back(linear_bounding_volume_hierarchy_node());
+		mNodes.push_back(linear_bounding_volume_hierarchy_node());
+
+		build_costs.resize(mNodes.size(), static_cast<real>(-1));
+
+		recursive_rebuild(allocator, nodes, costs, build_costs, node.offset + 0, children + 0, depth + 1);
+		recursive_rebuild(allocator, nodes, costs, build_costs, node.offset + 1, children + 1, depth + 1);
+	}
+
+	template <typename T>
+	std::vector<real> bounding_volume_hierarchy<T>::evaluate_costs() const
+	{
+		// the cost of leaf is the cost of testing its elements
+		// the cost of interior node is the cost of traveling it and the costs of children weighted by
+		// the probability that a ray intersects the child when it intersects the node(the ratio of surface area)
+		std::vector<real> costs(mNodes.size());
+
+		for (auto index = mNodes.size(); index > 0; index--) {
+			const auto& node = mNodes[index - 1];
+
+			if (node.is_leaf()) {
+				costs[index - 1] = mConfig.test_cost * node.count;
+
+				continue;
+			}
+
+			const auto& left = mNodes[node.offset + 0];
+			const auto& right = mNodes[node.offset + 1];
+
+			const auto area = bounding_box<T>(node.box.min, node.box.max).area();
+			const auto left_area = bounding_box<T>(left.box.min, left.box.max).area();
+			const auto right_area = bounding_box<T>(right.box.min, right.box.max).area();
+
+			// if the node is flat, a ray that intersects it will intersect both children
+			costs[index - 1] = area > 0 ?
+				mConfig.travel_cost + (left_area * costs[node.offset + 0] + right_area * costs[node.offset + 1]) / area :
+				mConfig.travel_cost + costs[node.offset + 0] + costs[node.offset + 1];
+		}
+
+		return costs;
+	}
+
+	template <typename T>
+	void bounding_volume_hierarchy<T>::reorder_treelets()
+	{
+		// the two children of a node must be adjacent, so the unit we reorder is the pair of children
+		// the root is the pair 0 and the pair p is the nodes (2p - 1, 2p)
+		const auto pair_bytes = 2 * sizeof(linear_bounding_volume_hierarchy_node);
+
+		if (mConfig.treelet_bytes < 2 * pair_bytes || mNodes.size() < 3) return;
+
+		const auto pairs = (mNodes.size() + 1) / 2;
+
+		// the probability that a ray visits the pair is the area of their parent
+		const auto order = treelet_order(pairs, mConfig.treelet_bytes / pair_bytes,
+			[&](uint32 pair, std::vector<std::pair<real, uint32>>& children)
+			{
+				const auto first = pair == 0 ? 0 : 2 * pair - 1;
+				const auto last = pair == 0 ? 0 : 2 * pair;
+
+				for (auto index = first; index <= last; index++) {
+					const auto& node = mNodes[index];
+
+					if (node.is_leaf()) continue;
+
+					children.push_back({ bounding_box<T>(node.box.min, node.box.max).area(), (node.offset + 1) / 2 });
+				}
+			});
+
+		std::vector<uint32> locations(pairs);
+
+		for (size_t location = 0; location < pairs; location++) locations[order[location]] = static_cast<uint32>(location);
+
+		std::vector<linear_bounding_volume_hierarchy_node> nodes(mNodes.size());
+		std::vector<real> costs(mCosts.size());
+
+		nodes[0] = mNodes[0];
+		costs[0] = mCosts[0];
+
+		for (size_t location = 1; location < pairs; location++) {
+			for (size_t side = 0; side < 2; side++) {
+				nodes[2 * location - 1 + side] = mNodes[2 * order[location] - 1 + side];
+				costs[2 * location - 1 + side] = mCosts[2 * order[location] - 1 + side];
+			}
+		}
+
+		for (auto& node : nodes)
+			if (!node.is_leaf()) node.offset = 2 * locations[(node.offset + 1) / 2] - 1;
+
+		mNodes = std::move(nodes);
+		mCosts = std::move(costs);
+	}
+
 	template <typename T>
 	size_t bounding_volume_hierarchy<T>::split(const bounding_box<T>& centroid_box, const bounding_box<T>& union_box,
 		size_t dimension, size_t begin, size_t end)
 	{
+		// the sub-trees rebuilt by refitting do not duplicate the elements, they use surface area heuristic too
+		if (mConfig.split_method == bounding_volume_hierarchy_split_method::surface_area_heuristic ||
+			mConfig.split_method == bounding_volume_hierarchy_split_method::spatial_split)
+			return split_surface_area_heuristic(centroid_box, union_box, dimension, begin, end);
+
+		// return begin means the node should be leaf
+		if (end - begin <= mConfig.max_leaf_elements) return begin;
+
 		return split_equal_count(centroid_box, union_box, dimension, begin, end);
 	}
 
@@ -236,79 +1208,94 @@ namespace rainbow::cpus::shared::accelerators {
 	size_t bounding_volume_hierarchy<T>::split_surface_area_heuristic(const bounding_box<T>& centroid_box,
 		const bounding_box<T>& union_box, size_t dimension, size_t begin, size_t end)
 	{
-		if (end - begin <= 4) return split_equal_count(centroid_box, union_box, dimension, begin, end);
-
-		constexpr size_t buckets_count = 12;
-
-		std::vector<bucket_info> buckets(buckets_count);
+		// put the elements into buckets by the centroid, only the buckets with elements have valid box
+		buckets_array buckets;
 
 		for (auto index = begin; index < end; index++) {
-			auto location = static_cast<size_t>(
-				(this->mBoundingBoxes[index].centroid()[static_cast<int>(dimension)] - centroid_box.min()[static_cast<int>(dimension)]) /
-				(centroid_box.max()[static_cast<int>(dimension)] - centroid_box.min()[static_cast<int>(dimension)]) * buckets_count);
+			auto& bucket = buckets[bucket_location(centroid_box, this->mBoundingBoxes[index].centroid(), dimension)];
 
-			if (location == buckets_count) location = location - 1;
+			if (bucket.count == 0) bucket.box = this->mBoundingBoxes[index];
+			else bucket.box.union_it(this->mBoundingBoxes[index]);
 
-			buckets[location].box.union_it(this->mBoundingBoxes[index]);
-			buckets[location].count = buckets[location].count + 1;
+			bucket.count = bucket.count + 1;
 		}
 
-		auto min_cost_location = static_cast<size_t>(0);
-		auto min_cost = cost_surface_area_heuristic(buckets, union_box, 0);
+		// costs[location] is the cost of splitting the node between bucket(location) and bucket(location + 1)
+		std::array<real, max_buckets> costs;
 
-		for (size_t index = 1; index < buckets_count - 1; index++) {
-			const auto cost = cost_surface_area_heuristic(buckets, union_box, index);
+		cost_surface_area_heuristic(buckets, union_box, costs);
 
-			if (min_cost > cost) min_cost = cost, min_cost_location = index;
-		}
-
-		const auto leaf_cost = end - begin;
+		auto min_cost_location = static_cast<size_t>(0);
+		auto min_cost = costs[0];
 
-		if (min_cost < leaf_cost || max_elements_one_node < leaf_cost) {
-			auto middle = std::partition(this->mBoundingBoxes.data() + begin, this->mBoundingBoxes.data() + end,
-				[&](const bounding_box<T>& box)
-				{
-					auto location = static_cast<size_t>(
-						(box.centroid()[static_cast<int>(dimension)] - centroid_box.min()[static_cast<int>(dimension)]) /
-						(centroid_box.max()[static_cast<int>(dimension)] - centroid_box.min()[static_cast<int>(dimension)]) * buckets_count);
+		for (size_t location = 1; location < mConfig.buckets - 1; location++) 
+			if (min_cost > costs[location]) min_cost = costs[location], min_cost_location = location;
 
-					if (location == buckets_count) location = location - 1;
+		// if the cost of leaf is smaller than the cost of splitting, the node should be leaf
+		const auto count = end - begin;
+		const auto leaf_cost = mConfig.test_cost * count;
 
-					return location <= min_cost_location;
-				});
+		if (count <= mConfig.max_leaf_elements && leaf_cost <= min_cost) return begin;
 
-			return middle - this->mBoundingBoxes.data();
-		}
+		// the centroid box is not degenerate in this dimension, so the first and last buckets always have elements
+		// and all costs are finite, we can always split the elements into two non-empty parts
+		const auto middle = std::partition(this->mBoundingBoxes.data() + begin, this->mBoundingBoxes.data() + end,
+			[&](const bounding_box<T>& box)
+			{
+				return bucket_location(centroid_box, box.centroid(), dimension) <= min_cost_location;
+			});
 
-		// leaf node
-		return begin;
+		return middle - this->mBoundingBoxes.data();
 	}
 
 	template <typename T>
-	real bounding_volume_hierarchy<T>::cost_surface_area_heuristic(const std::vector<bucket_info>& infos,
-		const bounding_box<T>& union_box, size_t location)
+	void bounding_volume_hierarchy<T>::cost_surface_area_heuristic(const buckets_array& infos,
+		const bounding_box<T>& union_box, std::array<real, max_buckets>& costs) const
 	{
-		assert(location >= 0 && location < infos.size());
-
-		constexpr auto travel_cost = static_cast<real>(0.125);
-		constexpr auto test_cost = static_cast<real>(1);
+		// sweep the buckets from right to left, costs[location] stores the count * area of buckets (location, buckets)
+		// then sweep the buckets from left to right and add the count * area of buckets [0, location]
+		// so we can compute all costs in O(buckets) instead of O(buckets * buckets)
+		const auto buckets = mConfig.buckets;
 
 		bucket_info info0;
 		bucket_info info1;
 
-		for (size_t index = 0; index <= location; index++) {
-			info0.box.union_it(infos[index].box);
+		for (auto location = buckets - 1; location > 0; location--) {
+			if (infos[location].count != 0) {
+				if (info1.count == 0) info1.box = infos[location].box;
+				else info1.box.union_it(infos[location].box);
 
-			info0.count = info0.count + infos[index].count;
+				info1.count = info1.count + infos[location].count;
+			}
+
+			costs[location - 1] = info1.count == 0 ? std::numeric_limits<real>::infinity() : info1.count * info1.box.area();
 		}
 
-		for (size_t index = location + 1; index < infos.size(); index++) {
-			info1.box.union_it(infos[index].box);
+		const auto inv_area = static_cast<real>(1) / union_box.area();
+
+		for (size_t location = 0; location < buckets - 1; location++) {
+			if (infos[location].count != 0) {
+				if (info0.count == 0) info0.box = infos[location].box;
+				else info0.box.union_it(infos[location].box);
 
-			info1.count = info1.count + infos[index].count;
+				info0.count = info0.count + infos[location].count;
+			}
+
+			// the split with empty part is invalid, we give it infinite cost
+			costs[location] = info0.count == 0 ? std::numeric_limits<real>::infinity() :
+				mConfig.travel_cost + mConfig.test_cost * (info0.count * info0.box.area() + costs[location]) * inv_area;
 		}
+	}
+
+	template <typename T>
+	size_t bounding_volume_hierarchy<T>::bucket_location(const bounding_box<T>& centroid_box, 
+		const vector3& centroid, size_t dimension) const
+	{
+		const auto axis = static_cast<int>(dimension);
+		const auto location = static_cast<size_t>(
+			(centroid[axis] - centroid_box.min()[axis]) / (centroid_box.max()[axis] - centroid_box.min()[axis]) * mConfig.buckets);
 
-		return travel_cost + test_cost * (info0.count * info0.box.area() + info1.count * info1.box.area()) / union_box.area();
+		return std::min(location, mConfig.buckets - 1);
 	}
 
 }
\ No newline at end of file
@@ -0,0 +1,505 @@
+#pragma once
+
+#include "../quantized_bounding_volume_hierarchy.hpp"
+#include "../../simd.hpp"
+
+#include <cstring>
+#include <cmath>
+
+// each node we pop will push at most 3 nodes more than it pops
+#define QUANTIZED_BOUNDING_VOLUME_HIERARCHY_STACK_SIZE (BOUNDING_VOLUME_HIERARCHY_STACK_SIZE * 4)
+
+#undef near
+#undef far
+
+namespace rainbow::cpus::shared::accelerators {
+
+	// 2^exponent, the exponent is in [-126, 127] so the result is a normal float
+	inline real quantized_scale(int8 exponent) noexcept
+	{
+		const auto bits = static_cast<uint32>(static_cast<int32>(exponent) + 127) << 23;
+
+		real scale;
+
+		std::memcpy(&scale, &bits, sizeof(real));
+
+		return scale;
+	}
+
+	inline quantized_bounding_volume_hierarchy_node::quantized_bounding_volume_hierarchy_node()
+	{
+		for (size_t axis = 0; axis < 3; axis++) {
+			origin[axis] = 0;
+			exponent[axis] = 0;
+		}
+
+		for (size_t index = 0; index < width; index++) {
+			for (size_t axis = 0; axis < 3; axis++) {
+				bounds[axis + 0][index] = 255;
+				bounds[axis + 3][index] = 0;
+			}
+
+			offset[index] = 0;
+			count[index] = 0;
+		}
+	}
+
+	template <typename T>
+	quantized_bounding_volume_hierarchy<T>::ray_info::ray_info(const ray& ray) :
+		origin(ray.origin), inv_direction(static_cast<real>(1) / ray.direction)
+	{
+		// if the direction of ray is negative, the near plane is the max plane of box
+		for (size_t axis = 0; axis < 3; axis++) {
+			const auto is_negative_direction = inv_direction[static_cast<int>(axis)] < 0;
+
+			near_plane[axis] = is_negative_direction ? axis + 3 : axis + 0;
+			far_plane[axis] = is_negative_direction ? axis + 0 : axis + 3;
+		}
+	}
+
+	template <typename T>
+	quantized_bounding_volume_hierarchy<T>::quantized_bounding_volume_hierarchy(
+		const std::vector<T>& elements, const std::vector<bounding_box<T>>& boxes,
+		const bounding_volume_hierarchy_config& config) :
+		accelerator<T>({}, {}), mConfig(config)
+	{
+		// we build a binary hierarchy and collapse it into quantized nodes
+		// the binary hierarchy reorders the elements, so we use the elements of it
+		// the binary nodes are kept in the order of their costs, only the collapsed nodes are reordered
+		auto binary_config = config;
+
+		binary_config.treelet_bytes = 0;
+
+		const bounding_volume_hierarchy<T> hierarchy(elements, boxes, binary_config);
+
+		this->mBoundingBoxes = hierarchy.boxes();
+		this->mElements = hierarchy.elements();
+
+		if (hierarchy.nodes().empty()) return;
+
+		if (mConfig.refittable) {
+			mBinaryNodes = hierarchy.nodes();
+			mBinaryCosts = hierarchy.mCosts;
+		}
+
+		mNodes.reserve(hierarchy.nodes().size() / 2 + 1);
+
+		recursive_collapse(hierarchy.nodes(), 0);
+
+		reorder_treelets();
+	}
+
+	template <typename T>
+	quantized_bounding_volume_hierarchy<T>::quantized_bounding_volume_hierarchy(
+		const std::vector<T>& elements, const std::vector<bounding_box<T>>& boxes,
+		const std::vector<linear_bounding_volume_hierarchy_node>& nodes,
+		const bounding_volume_hierarchy_config& config) :
+		accelerator<T>(elements, boxes), mConfig(config)
+	{
+		this->reorder_elements();
+
+		if (nodes.empty()) return;
+
+		// the costs of adopted nodes will be evaluated when we refit it firstly
+		if (mConfig.refittable) mBinaryNodes = nodes;
+
+		mNodes.reserve(nodes.size() / 2 + 1);
+
+		recursive_collapse(nodes, 0);
+
+		reorder_treelets();
+	}
+
+	template <typename T>
+	bool quantized_bounding_volume_hierarchy<T>::intersect(const ray& ray, surface_hit& hit) const
+	{
+		auto found = false;
+
+		// the length of ray will be updated when we find a nearer hit
+		// so the nodes that are farther than current hit will be culled
+		traverse(ray, [&](uint32 index)
+			{
+				if (this->mElements[index].intersect(ray, hit)) found = true;
+
+				return false;
+			});
+
+		return found;
+	}
+
+	template <typename T>
+	bool quantized_bounding_volume_hierarchy<T>::intersect_with_shadow_ray(const ray& ray, surface_hit& hit) const
+	{
+		auto found = false;
+
+		traverse(ray, [&](uint32 index)
+			{
+				if (!this->mElements[index].visible()) return false;
+
+				if (this->mElements[index].intersect(ray, hit)) found = true;
+
+				return false;
+			});
+
+		return found;
+	}
+
+	template <typename T>
+	bool quantized_bounding_volume_hierarchy<T>::occluded(const ray& ray, const std::function<bool(const T&)>& ignore) const
+	{
+		auto blocked = false;
+
+		traverse(ray, [&](uint32 index)
+			{
+				const auto& entity = this->mElements[index];
+
+				if (!entity.visible() || (ignore && ignore(entity))) return false;
+
+				return blocked = entity.occluded(ray);
+			});
+
+		return blocked;
+	}
+
+	template <typename T>
+	void quantized_bounding_volume_hierarchy<T>::refit()
+	{
+		// without the binary hierarchy, we can not refit the quantized nodes so we build it again
+		if (mBinaryNodes.empty()) {
+			std::vector<bounding_box<T>> boxes;
+
+			boxes.reserve(this->mElements.size());
+
+			for (size_t index = 0; index < this->mElements.size(); index++)
+				boxes.push_back(bounding_box<T>(this->mElements[index], static_cast<uint32>(index)));
+
+			// the elements may be duplicated by spatial splits, splitting them again would duplicate them more
+			auto config = mConfig;
+
+			if (config.split_method == bounding_volume_hierarchy_split_method::spatial_split)
+				config.split_method = bounding_volume_hierarchy_split_method::surface_area_heuristic;
+
+			config.treelet_bytes = 0;
+
+			const bounding_volume_hierarchy<T> hierarchy(this->mElements, boxes, config);
+
+			this->mBoundingBoxes = hierarchy.boxes();
+			this->mElements = hierarchy.elements();
+
+			mNodes.clear();
+
+			if (!hierarchy.nodes().empty()) recursive_collapse(hierarchy.nodes(), 0);
+
+			reorder_treelets();
+
+			return;
+		}
+
+		// the quantized boxes depend on the box of parent, so we refit the binary hierarchy and collapse it again
+		auto binary_config = mConfig;
+
+		binary_config.treelet_bytes = 0;
+
+		bounding_volume_hierarchy<T> hierarchy(this->mElements, this->mBoundingBoxes, mBinaryNodes, binary_config);
+
+		if (!mBinaryCosts.empty()) hierarchy.mCosts = mBinaryCosts;
+
+		hierarchy.refit();
+
+		this->mBoundingBoxes = std::move(hierarchy.mBoundingBoxes);
+		this->mElements = std::move(hierarchy.mElements);
+
+		mBinaryNodes = std::move(hierarchy.mNodes);
+		mBinaryCosts = std::move(hierarchy.mCosts);
+
+		mNodes.clear();
+
+		recursive_collapse(mBinaryNodes, 0);
+
+		reorder_treelets();
+	}
+
+	template <typename T>
+	template <typename Function>
+	void quantized_bounding_volume_hierarchy<T>::traverse(const ray& ray, Function&& function) const
+	{
+		if (mNodes.empty()) return;
+
+		const ray_info info(ray);
+
+		uint32 stack[QUANTIZED_BOUNDING_VOLUME_HIERARCHY_STACK_SIZE];
+		size_t stack_size = 0;
+
+		stack[stack_size++] = 0;
+
+		while (stack_size != 0) {
+			const auto& node = mNodes[stack[--stack_size]];
+
+			alignas(16) real distance[width];
+
+			const auto mask = intersect_children(node, info, ray.length, distance);
+
+			// the children nodes we need travel, they are sorted by distance from far to near
+			uint32 children[width];
+			real children_distance[width];
+			size_t children_count = 0;
+
+			for (size_t index = 0; index < width; index++) {
+				if ((mask & (1u << index)) == 0) continue;
+
+				// if the child is leaf, we test the elements directly
+				// function returns true means we can stop the traversal
+				if (node.count[index] != 0) {
+					for (auto element = node.offset[index]; element < node.offset[index] + node.count[index]; element++)
+						if (function(element)) return;
+
+					continue;
+				}
+
+				auto location = children_count++;
+
+				while (location > 0 && children_distance[location - 1] < distance[index]) {
+					children[location] = children[location - 1];
+					children_distance[location] = children_distance[location - 1];
+
+					location--;
+				}
+
+				children[location] = node.offset[index];
+				children_distance[location] = distance[index];
+			}
+
+			// push the far child firstly, so we will travel the near child firstly
+			for (size_t index = 0; index < children_count; index++)
+				stack[stack_size++] = children[index];
+		}
+	}
+
+	template <typename T>
+	uint32 quantized_bounding_volume_hierarchy<T>::intersect_children(const node_type& node,
+		const ray_info& info, real length, real distance[width]) const
+	{
+		// the planes of children are origin + bounds * scale, q * scale is exact because scale is a power of 2
+		// then we do the same slab test as wide_bounding_volume_hierarchy
+		const real scale[3] = {
+			quantized_scale(node.exponent[0]),
+			quantized_scale(node.exponent[1]),
+			quantized_scale(node.exponent[2])
+		};
+
+#if defined(RAINBOW_SSE2)
+		const auto zero = _mm_setzero_si128();
+
+		// expand 4 uint8 into 4 floats
+		const auto load = [&zero](const uint8* bounds)
+		{
+			int32 value;
+
+			std::memcpy(&value, bounds, sizeof(int32));
+
+			return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(value), zero), zero));
+		};
+
+		auto t0 = _mm_setzero_ps();
+		auto t1 = _mm_set1_ps(length);
+
+		for (size_t axis = 0; axis < 3; axis++) {
+			const auto node_origin = _mm_set1_ps(node.origin[axis]);
+			const auto node_scale = _mm_set1_ps(scale[axis]);
+
+			const auto origin = _mm_set1_ps(info.origin[static_cast<int>(axis)]);
+			const auto inv_direction = _mm_set1_ps(info.inv_direction[static_cast<int>(axis)]);
+
+			const auto near_plane = _mm_add_ps(node_origin, _mm_mul_ps(load(node.bounds[info.near_plane[axis]]), node_scale));
+			const auto far_plane = _mm_add_ps(node_origin, _mm_mul_ps(load(node.bounds[info.far_plane[axis]]), node_scale));
+
+			const auto near = _mm_mul_ps(_mm_sub_ps(near_plane, origin), inv_direction);
+			const auto far = _mm_mul_ps(_mm_sub_ps(far_plane, origin), inv_direction);
+
+			t0 = _mm_max_ps(near, t0);
+			t1 = _mm_min_ps(far, t1);
+		}
+
+		_mm_store_ps(distance, t0);
+
+		return static_cast<uint32>(_mm_movemask_ps(_mm_cmple_ps(t0, t1))) & node.valid;
+#else
+		uint32 mask = 0;
+
+		for (size_t index = 0; index < width; index++) {
+			auto t0 = static_cast<real>(0), t1 = length;
+
+			for (size_t axis = 0; axis < 3; axis++) {
+				const auto near_plane = node.origin[axis] + static_cast<real>(node.bounds[info.near_plane[axis]][index]) * scale[axis];
+				const auto far_plane = node.origin[axis] + static_cast<real>(node.bounds[info.far_plane[axis]][index]) * scale[axis];
+
+				const auto near = (near_plane - info.origin[static_cast<int>(axis)]) * info.inv_direction[static_cast<int>(axis)];
+				const auto far = (far_plane - info.origin[static_cast<int>(axis)]) * info.inv_direction[static_cast<int>(axis)];
+
+				if (near > t0) t0 = near;
+				if (far < t1) t1 = far;
+			}
+
+			distance[index] = t0;
+
+			if (t0 <= t1) mask = mask | (1u << index);
+		}
+
+		return mask & node.valid;
+#endif
+	}
+
+	template <typename T>
+	uint32 quantized_bounding_volume_hierarchy<T>::recursive_collapse(
+		const std::vector<linear_bounding_volume_hierarchy_node>& nodes, uint32 index)
+	{
+		const auto current = static_cast<uint32>(mNodes.size());
+
+		mNodes.push_back(node_type());
+
+		// the same as wide_bounding_volume_hierarchy, we open the interior child with the largest area
+		// until there are 4 children or all children are leaf
+		uint32 children[width];
+		size_t count = 0;
+
+		if (nodes[index].is_leaf()) children[count++] = index;
+		else {
+			children[count++] = nodes[index].offset + 0;
+			children[count++] = nodes[index].offset + 1;
+		}
+
+		while (count < width) {
+			auto largest_location = count;
+			auto largest_area = static_cast<real>(-1);
+
+			for (size_t location = 0; location < count; location++) {
+				if (nodes[children[location]].is_leaf()) continue;
+
+				const auto area = bounding_box<T>(nodes[children[location]].box.min, nodes[children[location]].box.max).area();
+
+				if (area > largest_area) largest_area = area, largest_location = location;
+			}
+
+			if (largest_location == count) break;
+
+			const auto offset = nodes[children[largest_location]].offset;
+
+			children[largest_location] = offset + 0;
+			children[count++] = offset + 1;
+		}
+
+		// the box of node is the union of children, it is the space we quantize the boxes of children in
+		auto box = nodes[children[0]].box;
+
+		for (size_t location = 1; location < count; location++) box.union_it(nodes[children[location]].box);
+
+		real origin[3];
+		int8 exponent[3];
+
+		for (size_t axis = 0; axis < 3; axis++) {
+			const auto min = box.min[static_cast<int>(axis)];
+			const auto max = box.max[static_cast<int>(axis)];
+
+			// the smallest power of 2 that 255 * scale covers the box, we check it with float because
+			// the traversal computes origin + 255 * scale with float
+			int32 power = 0;
+
+			std::frexp((max - min) / 255, &power);
+
+			power = std::clamp(power, -126, 127);
+
+			while (power < 127 && min + 255 * quantized_scale(static_cast<int8>(power)) < max) power++;
+
+			origin[axis] = min;
+			exponent[axis] = static_cast<int8>(power);
+		}
+
+		for (size_t location = 0; location < count; location++) {
+			const auto& child = nodes[children[location]];
+
+			// recursive_collapse will push new nodes, so we can not keep the reference of current node
+			const auto offset = child.is_leaf() ? child.offset : recursive_collapse(nodes, children[location]);
+
+			auto& node = mNodes[current];
+
+			for (size_t axis = 0; axis < 3; axis++) {
+				const auto scale = quantized_scale(exponent[axis]);
+
+				// round the min down and the max up, then fix them with the float we use in traversal
+				// so the quantized box always contains the box of child
+				auto lower = static_cast<int32>(std::floor((child.box.min[static_cast<int>(axis)] - origin[axis]) / scale));
+				auto upper = static_cast<int32>(std::ceil((child.box.max[static_cast<int>(axis)] - origin[axis]) / scale));
+
+				lower = std::clamp(lower, 0, 255);
+				upper = std::clamp(upper, 0, 255);
+
+				while (lower > 0 && origin[axis] + static_cast<real>(lower) * scale > child.box.min[static_cast<int>(axis)]) lower--;
+				while (upper < 255 && origin[axis] + static_cast<real>(upper) * scale < child.box.max[static_cast<int>(axis)]) upper++;
+
+				node.bounds[axis + 0][location] = static_cast<uint8>(lower);
+				node.bounds[axis + 3][location] = static_cast<uint8>(upper);
+			}
+
+			node.offset[location] = offset;
+			node.count[location] = child.count;
+			node.valid = static_cast<uint8>(node.valid | (1u << location));
+		}
+
+		auto& node = mNodes[current];
+
+		for (size_t axis = 0; axis < 3; axis++) {
+			node.origin[axis] = origin[axis];
+			node.exponent[axis] = exponent[axis];
+		}
+
+		return current;
+	}
+
+	template <typename T>
+	void quantized_bounding_volume_hierarchy<T>::reorder_treelets()
+	{
+		if (mConfig.treelet_bytes < 2 * sizeof(node_type) || mNodes.size() < 2) return;
+
+		// the area of child is computed with its quantized box
+		const auto order = treelet_order(mNodes.size(), mConfig.treelet_bytes / sizeof(node_type),
+			[&](uint32 index, std::vector<std::pair<real, uint32>>& children)
+			{
+				const auto& node = mNodes[index];
+
+				for (size_t location = 0; location < width; location++) {
+					if (node.count[location] != 0 || (node.valid & (1u << location)) == 0) continue;
+
+					real length[3];
+
+					for (size_t axis = 0; axis < 3; axis++)
+						length[axis] = static_cast<real>(node.bounds[axis + 3][location] - node.bounds[axis][location]) *
+						quantized_scale(node.exponent[axis]);
+
+					children.push_back({ 2 * (length[0] * length[1] + length[0] * length[2] + length[1] * length[2]), node.offset[location] });
+				}
+			});
+
+		std::vector<uint32> locations(mNodes.size());
+
+		for (size_t location = 0; location < mNodes.size(); location++) locations[order[location]] = static_cast<uint32>(location);
+
+		std::vector<node_type> nodes;
+
+		nodes.reserve(mNodes.size());
+
+		for (const auto index : order) {
+			nodes.push_back(mNodes[index]);
+
+			auto& node = nodes.back();
+
+			for (size_t location = 0; location < width; location++) {
+				if (node.count[location] != 0 || (node.valid & (1u << location)) == 0) continue;
+
+				node.offset[location] = locations[node.offset[location]];
+			}
+		}
+
+		mNodes = std::move(nodes);
+	}
+
+}
@@ -0,0 +1,567 @@
+#pragma once
+
+#include "../wide_bounding_volume_hierarchy.hpp"
+#include "../../simd.hpp"
+
+#if defined(__AVX__)
+#define WIDE_BOUNDING_VOLUME_HIERARCHY_AVX
+#include <immintrin.h>
+#endif
+
+// each node we pop will push at most (Width - 1) nodes more than it pops,
+// and the depth of wide hierarchy is not greater than the depth of binary hierarchy
+#define WIDE_BOUNDING_VOLUME_HIERARCHY_STACK_SIZE (BOUNDING_VOLUME_HIERARCHY_STACK_SIZE * 8)
+
+#undef near
+#undef far
+
+namespace rainbow::cpus::shared::accelerators {
+
+	template <size_t Width>
+	wide_bounding_volume_hierarchy_node<Width>::wide_bounding_volume_hierarchy_node()
+	{
+		for (size_t index = 0; index < Width; index++) {
+			for (size_t axis = 0; axis < 3; axis++) {
+				bounds[axis + 0][index] = +std::numeric_limits<real>::infinity();
+				bounds[axis + 3][index] = -std::numeric_limits<real>::infinity();
+			}
+
+			offset[index] = 0;
+			count[index] = 0;
+		}
+	}
+
+	template <typename T, size_t Width>
+	wide_bounding_volume_hierarchy<T, Width>::ray_info::ray_info(const ray& ray) :
+		origin(ray.origin), inv_direction(static_cast<real>(1) / ray.direction)
+	{
+		// if the direction of ray is negative, the near plane is the max plane of box
+		for (size_t axis = 0; axis < 3; axis++) {
+			const auto is_negative_direction = inv_direction[static_cast<int>(axis)] < 0;
+
+			near_plane[axis] = is_negative_direction ? axis + 3 : axis + 0;
+			far_plane[axis] = is_negative_direction ? axis + 0 : axis + 3;
+		}
+	}
+
+	template <typename T, size_t Width>
+	wide_bounding_volume_hierarchy<T, Width>::wide_bounding_volume_hierarchy(
+		const std::vector<T>& elements, const std::vector<bounding_box<T>>& boxes,
+		const bounding_volume_hierarchy_config& config) :
+		accelerator<T>({}, {}), mConfig(config)
+	{
+		// we build a binary hierarchy and collapse it into wide nodes
+		// the binary hierarchy reorders the elements, so we use the elements of it
+		// the binary nodes are kept in the order of their costs, only the collapsed nodes are reordered
+		auto binary_config = config;
+
+		binary_config.treelet_bytes = 0;
+
+		const bounding_volume_hierarchy<T> hierarchy(elements, boxes, binary_config);
+
+		this->mBoundingBoxes = hierarchy.boxes();
+		this->mElements = hierarchy.elements();
+
+		if (hierarchy.nodes().empty()) return;
+
+		if (mConfig.refittable) {
+			mBinaryNodes = hierarchy.nodes();
+			mBinaryCosts = hierarchy.mCosts;
+		}
+
+		mNodes.reserve(hierarchy.nodes().size() / 2 + 1);
+
+		recursive_collapse(hierarchy.nodes(), 0);
+
+		reorder_treelets();
+	}
+
+	template <typename T, size_t Width>
+	wide_bounding_volume_hierarchy<T, Width>::wide_bounding_volume_hierarchy(
+		const std::vector<T>& elements, const std::vector<bounding_box<T>>& boxes,
+		const std::vector<linear_bounding_volume_hierarchy_node>& nodes,
+		const bounding_volume_hierarchy_config& config) :
+		accelerator<T>(elements, boxes), mConfig(config)
+	{
+		this->reorder_elements();
+
+		if (nodes.empty()) return;
+
+		// the costs of adopted nodes will be evaluated when we refit it firstly
+		if (mConfig.refittable) mBinaryNodes = nodes;
+
+		mNodes.reserve(nodes.size() / 2 + 1);
+
+		recursive_collapse(nodes, 0);
+
+		reorder_treelets();
+	}
+
+	template <typename T, size_t Width>
+	bool wide_bounding_volume_hierarchy<T, Width>::intersect(const ray& ray, surface_hit& hit) const
+	{
+		auto found = false;
+
+		// the length of ray will be updated when we find a nearer hit
+		// so the nodes that are farther than current hit will be culled
+		traverse(ray, [&](uint32 index)
+			{
+				if (this->mElements[index].intersect(ray, hit)) found = true;
+
+				return false;
+			});
+
+		return found;
+	}
+
+	template <typename T, size_t Width>
+	bool wide_bounding_volume_hierarchy<T, Width>::intersect_with_shadow_ray(const ray& ray, surface_hit& hit) const
+	{
+		auto found = false;
+
+		traverse(ray, [&](uint32 index)
+			{
+				if (!this->mElements[index].visible()) return false;
+
+				if (this->mElements[index].intersect(ray, hit)) found = true;
+
+				return false;
+			});
+
+		return found;
+	}
+
+	template <typename T, size_t Width>
+	bool wide_bounding_volume_hierarchy<T, Width>::occluded(const ray& ray, const std::function<bool(const T&)>& ignore) const
+	{
+		auto blocked = false;
+
+		traverse(ray, [&](uint32 index)
+			{
+				const auto& entity = this->mElements[index];
+
+				if (!entity.visible() || (ignore && ignore(entity))) return false;
+
+				return blocked = entity.occluded(ray);
+			});
+
+		return blocked;
+	}
+
+	template <typename T, size_t Width>
+	uint32 wide_bounding_volume_hierarchy<T, Width>::intersect(const ray* rays, size_t count, uint32 active, surface_hit* hits) const
+	{
+		uint32 found = 0;
+
+		traverse(rays, count, active, [&](uint32 index, uint32 mask)
+			{
+				found = found | intersect_element(this->mElements[index], rays, count, mask, hits);
+
+				return static_cast<uint32>(0);
+			});
+
+		return found;
+	}
+
+	template <typename T, size_t Width>
+	uint32 wide_bounding_volume_hierarchy<T, Width>::occluded(const ray* rays, size_t count, uint32 active, const std::function<bool(const T&)>& ignore) const
+	{
+		uint32 blocked = 0;
+
+		traverse(rays, count, active, [&](uint32 index, uint32 mask)
+			{
+				const auto& entity = this->mElements[index];
+
+				if (!entity.visible() || (ignore && ignore(entity))) return static_cast<uint32>(0);
+
+				const auto entity_blocked = occluded_element(entity, rays, count, mask);
+
+				blocked = blocked | entity_blocked;
+
+				return entity_blocked;
+			});
+
+		return blocked;
+	}
+
+	template <typename T, size_t Width>
+	void wide_bounding_volume_hierarchy<T, Width>::refit()
+	{
+		// without the binary hierarchy, we can not refit the wide nodes so we build it again
+		if (mBinaryNodes.empty()) {
+			std::vector<bounding_box<T>> boxes;
+
+			boxes.reserve(this->mElements.size());
+
+			for (size_t index = 0; index < this->mElements.size(); index++)
+				boxes.push_back(bounding_box<T>(this->mElements[index], static_cast<uint32>(index)));
+
+			// the elements may be duplicated by spatial splits, splitting them again would duplicate them more
+			auto config = mConfig;
+
+			if (config.split_method == bounding_volume_hierarchy_split_method::spatial_split)
+				config.split_method = bounding_volume_hierarchy_split_method::surface_area_heuristic;
+
+			config.treelet_bytes = 0;
+
+			const bounding_volume_hierarchy<T> hierarchy(this->mElements, boxes, config);
+
+			this->mBoundingBoxes = hierarchy.boxes();
+			this->mElements = hierarchy.elements();
+
+			mNodes.clear();
+
+			if (!hierarchy.nodes().empty()) recursive_collapse(hierarchy.nodes(), 0);
+
+			reorder_treelets();
+
+			return;
+		}
+
+		// refit(and rebuild the bad sub-trees of) the binary hierarchy and collapse it again
+		// collapsing is O(n) as refitting, so we do not need to refit the wide nodes directly
+		auto binary_config = mConfig;
+
+		binary_config.treelet_bytes = 0;
+
+		bounding_volume_hierarchy<T> hierarchy(this->mElements, this->mBoundingBoxes, mBinaryNodes, binary_config);
+
+		if (!mBinaryCosts.empty()) hierarchy.mCosts = mBinaryCosts;
+
+		hierarchy.refit();
+
+		this->mBoundingBoxes = std::move(hierarchy.mBoundingBoxes);
+		this->mElements = std::move(hierarchy.mElements);
+
+		mBinaryNodes = std::move(hierarchy.mNodes);
+		mBinaryCosts = std::move(hierarchy.mCosts);
+
+		mNodes.clear();
+
+		recursive_collapse(mBinaryNodes, 0);
+
+		reorder_treelets();
+	}
+
+	template <typename T, size_t Width>
+	template <typename Function>
+	void wide_bounding_volume_hierarchy<T, Width>::traverse(const ray& ray, Function&& function) const
+	{
+		if (mNodes.empty()) return;
+
+		const ray_info info(ray);
+
+		uint32 stack[WIDE_BOUNDING_VOLUME_HIERARCHY_STACK_SIZE];
+		size_t stack_size = 0;
+
+		stack[stack_size++] = 0;
+
+		while (stack_size != 0) {
+			const auto& node = mNodes[stack[--stack_size]];
+
+			alignas(32) real distance[Width];
+
+			const auto mask = intersect_children(node, info, ray.length, distance);
+
+			// the children nodes we need travel, they are sorted by distance from far to near
+			uint32 children[Width];
+			real children_distance[Width];
+			size_t children_count = 0;
+
+			for (size_t index = 0; index < Width; index++) {
+				if ((mask & (1u << index)) == 0) continue;
+
+				// if the child is leaf, we test the elements directly
+				// function returns true means we can stop the traversal
+				if (node.count[index] != 0) {
+					for (auto element = node.offset[index]; element < node.offset[index] + node.count[index]; element++)
+						if (function(element)) return;
+
+					continue;
+				}
+
+				auto location = children_count++;
+
+				while (location > 0 && children_distance[location - 1] < distance[index]) {
+					children[location] = children[location - 1];
+					children_distance[location] = children_distance[location - 1];
+
+					location--;
+				}
+
+				children[location] = node.offset[index];
+				children_distance[location] = distance[index];
+			}
+
+			// push the far child firstly, so we will travel the near child firstly
+			for (size_t index = 0; index < children_count; index++)
+				stack[stack_size++] = children[index];
+		}
+	}
+
+	template <typename T, size_t Width>
+	template <typename Function>
+	void wide_bounding_volume_hierarchy<T, Width>::traverse(const ray* rays, size_t count, uint32 active, Function&& function) const
+	{
+		if (mNodes.empty() || active == 0) return;
+
+		ray_packet_info info(rays, count, active);
+
+		// each node in stack has the mask of rays that intersect it
+		uint32 stack[WIDE_BOUNDING_VOLUME_HIERARCHY_STACK_SIZE];
+		uint32 stack_mask[WIDE_BOUNDING_VOLUME_HIERARCHY_STACK_SIZE];
+		size_t stack_size = 0;
+
+		stack[stack_size] = 0;
+		stack_mask[stack_size++] = active;
+
+		while (stack_size != 0) {
+			stack_size--;
+
+			const auto& node = mNodes[stack[stack_size]];
+			const auto mask = stack_mask[stack_size] & active;
+
+			if (mask == 0) continue;
+
+			// the children are sorted by the distance of their centers along the first ray
+			// the rays are coherent, so it is the order most rays travel the children
+			const auto& direction = info.direction(mask);
+
+			uint32 children[Width];
+			uint32 children_mask[Width];
+			real children_distance[Width];
+			size_t children_count = 0;
+
+			for (size_t index = 0; index < Width; index++) {
+				// the empty child has an inverted box, we skip it before testing the rays
+				if (node.bounds[0][index] > node.bounds[3][index]) continue;
+
+				bound3 box;
+
+				box.min = vector3(node.bounds[0][index], node.bounds[1][index], node.bounds[2][index]);
+				box.max = vector3(node.bounds[3][index], node.bounds[4][index], node.bounds[5][index]);
+
+				const auto child_mask = info.intersect(box, mask & active);
+
+				if (child_mask == 0) continue;
+
+				// if the child is leaf, we test the elements directly
+				// the rays that function returns finish the traversal, so we remove them from the packet
+				if (node.count[index] != 0) {
+					for (auto element = node.offset[index]; element < node.offset[index] + node.count[index]; element++) {
+						active = active & ~function(element, child_mask & active);
+
+						if (active == 0) return;
+					}
+
+					for (size_t lane = 0; lane < count; lane++)
+						if ((child_mask & (1u << lane)) != 0) info.update(lane, rays[lane].length);
+
+					continue;
+				}
+
+				const auto distance = dot((box.min + box.max) * static_cast<real>(0.5), direction);
+
+				auto location = children_count++;
+
+				while (location > 0 && children_distance[location - 1] < distance) {
+					children[location] = children[location - 1];
+					children_mask[location] = children_mask[location - 1];
+					children_distance[location] = children_distance[location - 1];
+
+					location--;
+				}
+
+				children[location] = node.offset[index];
+				children_mask[location] = child_mask;
+				children_distance[location] = distance;
+			}
+
+			// push the far child firstly, so we will travel the near child firstly
+			for (size_t index = 0; index < children_count; index++) {
+				stack[stack_size] = children[index];
+				stack_mask[stack_size++] = children_mask[index];
+			}
+		}
+	}
+
+	template <typename T, size_t Width>
+	uint32 wide_bounding_volume_hierarchy<T, Width>::intersect_children(const wide_bounding_volume_hierarchy_node<Width>& node,
+		const ray_info& info, real length, real distance[Width]) const
+	{
+		// the same slab test as intersect_bound, but we test all children at the same time
+		// if near or far is nan(0 * inf), max(near, t0) and min(far, t1) return t0 and t1, so they will not be changed
+		// the bit i of result is 1 means the ray intersect the child i, and distance[i] is the t value of entry point
+		uint32 mask = 0;
+
+#if defined(WIDE_BOUNDING_VOLUME_HIERARCHY_AVX)
+		if constexpr (Width == 8) {
+			auto t0 = _mm256_setzero_ps();
+			auto t1 = _mm256_set1_ps(length);
+
+			for (size_t axis = 0; axis < 3; axis++) {
+				const auto origin = _mm256_set1_ps(info.origin[static_cast<int>(axis)]);
+				const auto inv_direction = _mm256_set1_ps(info.inv_direction[static_cast<int>(axis)]);
+
+				const auto near = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[info.near_plane[axis]]), origin), inv_direction);
+				const auto far = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[info.far_plane[axis]]), origin), inv_direction);
+
+				t0 = _mm256_max_ps(near, t0);
+				t1 = _mm256_min_ps(far, t1);
+			}
+
+			_mm256_store_ps(distance, t0);
+
+			return static_cast<uint32>(_mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ)));
+		}
+#endif
+
+#if defined(RAINBOW_SSE)
+		for (size_t group = 0; group < Width; group += 4) {
+			auto t0 = _mm_setzero_ps();
+			auto t1 = _mm_set1_ps(length);
+
+			for (size_t axis = 0; axis < 3; axis++) {
+				const auto origin = _mm_set1_ps(info.origin[static_cast<int>(axis)]);
+				const auto inv_direction = _mm_set1_ps(info.inv_direction[static_cast<int>(axis)]);
+
+				const auto near = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[info.near_plane[axis]] + group), origin), inv_direction);
+				const auto far = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[info.far_plane[axis]] + group), origin), inv_direction);
+
+				t0 = _mm_max_ps(near, t0);
+				t1 = _mm_min_ps(far, t1);
+			}
+
+			_mm_store_ps(distance + group, t0);
+
+			mask = mask | (static_cast<uint32>(_mm_movemask_ps(_mm_cmple_ps(t0, t1))) << group);
+		}
+#else
+		for (size_t index = 0; index < Width; index++) {
+			auto t0 = static_cast<real>(0), t1 = length;
+
+			for (size_t axis = 0; axis < 3; axis++) {
+				const auto near = (node.bounds[info.near_plane[axis]][index] - info.origin[static_cast<int>(axis)]) *
+					info.inv_direction[static_cast<int>(axis)];
+				const auto far = (node.bounds[info.far_plane[axis]][index] - info.origin[static_cast<int>(axis)]) *
+					info.inv_direction[static_cast<int>(axis)];
+
+				if (near > t0) t0 = near;
+				if (far < t1) t1 = far;
+			}
+
+			distance[index] = t0;
+
+			if (t0 <= t1) mask = mask | (1u << index);
+		}
+#endif
+
+		return mask;
+	}
+
+	template <typename T, size_t Width>
+	uint32 wide_bounding_volume_hierarchy<T, Width>::recursive_collapse(
+		const std::vector<linear_bounding_volume_hierarchy_node>& nodes, uint32 index)
+	{
+		const auto current = static_cast<uint32>(mNodes.size());
+
+		mNodes.push_back(wide_bounding_volume_hierarchy_node<Width>());
+
+		// the children of wide node are the nodes of binary hierarchy
+		// we start with the children of binary node, and open the interior child with the largest area
+		// until there are Width children or all children are leaf
+		uint32 children[Width];
+		size_t count = 0;
+
+		if (nodes[index].is_leaf()) children[count++] = index;
+		else {
+			children[count++] = nodes[index].offset + 0;
+			children[count++] = nodes[index].offset + 1;
+		}
+
+		while (count < Width) {
+			auto largest_location = count;
+			auto largest_area = static_cast<real>(-1);
+
+			for (size_t location = 0; location < count; location++) {
+				if (nodes[children[location]].is_leaf()) continue;
+
+				const auto area = bounding_box<T>(nodes[children[location]].box.min, nodes[children[location]].box.max).area();
+
+				if (area > largest_area) largest_area = area, largest_location = location;
+			}
+
+			if (largest_location == count) break;
+
+			const auto offset = nodes[children[largest_location]].offset;
+
+			children[largest_location] = offset + 0;
+			children[count++] = offset + 1;
+		}
+
+		for (size_t location = 0; location < count; location++) {
+			const auto& child = nodes[children[location]];
+
+			// recursive_collapse will push new nodes, so we can not keep the reference of current node
+			const auto offset = child.is_leaf() ? child.offset : recursive_collapse(nodes, children[location]);
+
+			auto& node = mNodes[current];
+
+			for (size_t axis = 0; axis < 3; axis++) {
+				node.bounds[axis + 0][location] = child.box.min[static_cast<int>(axis)];
+				node.bounds[axis + 3][location] = child.box.max[static_cast<int>(axis)];
+			}
+
+			node.offset[location] = offset;
+			node.count[location] = child.count;
+		}
+
+		return current;
+	}
+
+	template <typename T, size_t Width>
+	void wide_bounding_volume_hierarchy<T, Width>::reorder_treelets()
+	{
+		if (mConfig.treelet_bytes < 2 * sizeof(wide_bounding_volume_hierarchy_node<Width>) || mNodes.size() < 2) return;
+
+		// the empty child has an inverted box, the leaf child has elements, the others are interior nodes
+		const auto order = treelet_order(mNodes.size(), mConfig.treelet_bytes / sizeof(wide_bounding_volume_hierarchy_node<Width>),
+			[&](uint32 index, std::vector<std::pair<real, uint32>>& children)
+			{
+				const auto& node = mNodes[index];
+
+				for (size_t location = 0; location < Width; location++) {
+					if (node.count[location] != 0 || node.bounds[0][location] > node.bounds[3][location]) continue;
+
+					const auto area = bounding_box<T>(
+						vector3(node.bounds[0][location], node.bounds[1][location], node.bounds[2][location]),
+						vector3(node.bounds[3][location], node.bounds[4][location], node.bounds[5][location])).area();
+
+					children.push_back({ area, node.offset[location] });
+				}
+			});
+
+		std::vector<uint32> locations(mNodes.size());
+
+		for (size_t location = 0; location < mNodes.size(); location++) locations[order[location]] = static_cast<uint32>(location);
+
+		std::vector<wide_bounding_volume_hierarchy_node<Width>> nodes;
+
+		nodes.reserve(mNodes.size());
+
+		for (const auto index : order) {
+			nodes.push_back(mNodes[index]);
+
+			auto& node = nodes.back();
+
+			for (size_t location = 0; location < Width; location++) {
+				if (node.count[location] != 0 || node.bounds[0][location] > node.bounds[3][location]) continue;
+
+				node.offset[location] = locations[node.offset[location]];
+			}
+		}
+
+		mNodes = std::move(nodes);
+	}
+
+}
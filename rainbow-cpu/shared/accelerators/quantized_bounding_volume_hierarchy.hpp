@@ -0,0 +1,96 @@
+#pragma once
+
+#include "bounding_volume_hierarchy.hpp"
+
+namespace rainbow::cpus::shared::accelerators {
+
+	/*
+	 * quantized_bounding_volume_hierarchy_node is a 4-wide node in one cache line(64 bytes).
+	 * the boxes of children are stored with 8 bits per plane relative to the box of node,
+	 * the plane of child is origin[axis] + bounds[plane][i] * 2^exponent[axis], it is never smaller than the real box.
+	 * bounds[0, 1, 2] are the min of children in x, y, z and bounds[3, 4, 5] are the max of children.
+	 * offset and count are the same as wide_bounding_volume_hierarchy_node.
+	 * the bit i of valid is 1 if the child i exists, the empty child also has an inverted box(min = 255, max = 0).
+	 */
+	struct alignas(64) quantized_bounding_volume_hierarchy_node {
+		constexpr static inline size_t width = 4;
+
+		real origin[3];
+
+		int8 exponent[3];
+		uint8 valid = 0;
+
+		uint8 bounds[6][width];
+
+		uint32 offset[width];
+		uint16 count[width];
+
+		quantized_bounding_volume_hierarchy_node();
+	};
+
+	static_assert(sizeof(quantized_bounding_volume_hierarchy_node) == 64, "the quantized node should be one cache line.");
+
+	/*
+	 * quantized_bounding_volume_hierarchy is a 4-wide hierarchy with quantized nodes.
+	 * a node is half the size of bounding_volume_hierarchy4's, so the large scenes use less memory and cache.
+	 * the boxes of children are a little larger than the real boxes, so the ray may visit a few more nodes.
+	 */
+	template <typename T>
+	class quantized_bounding_volume_hierarchy final : public accelerator<T> {
+	public:
+		explicit quantized_bounding_volume_hierarchy(
+			const std::vector<T>& elements,
+			const std::vector<bounding_box<T>>& boxes,
+			const bounding_volume_hierarchy_config& config = bounding_volume_hierarchy_config());
+
+		// adopt the binary hierarchy built outside, the leaf nodes should index into the boxes
+		explicit quantized_bounding_volume_hierarchy(
+			const std::vector<T>& elements,
+			const std::vector<bounding_box<T>>& boxes,
+			const std::vector<linear_bounding_volume_hierarchy_node>& nodes,
+			const bounding_volume_hierarchy_config& config = bounding_volume_hierarchy_config());
+
+		bool intersect(const ray& ray, surface_hit& hit) const override;
+
+		bool intersect_with_shadow_ray(const ray& ray, surface_hit& hit) const override;
+
+		bool occluded(const ray& ray, const std::function<bool(const T&)>& ignore) const override;
+
+		void refit() override;
+	private:
+		using node_type = quantized_bounding_volume_hierarchy_node;
+
+		constexpr static inline size_t width = node_type::width;
+
+		struct ray_info {
+			vector3 origin;
+			vector3 inv_direction;
+
+			size_t near_plane[3];
+			size_t far_plane[3];
+
+			ray_info(const ray& ray);
+		};
+
+		template <typename Function>
+		void traverse(const ray& ray, Function&& function) const;
+
+		uint32 intersect_children(const node_type& node, const ray_info& info, real length, real distance[width]) const;
+
+		uint32 recursive_collapse(const std::vector<linear_bounding_volume_hierarchy_node>& nodes, uint32 index);
+
+		void reorder_treelets();
+
+		std::vector<node_type> mNodes;
+
+		// the binary hierarchy we collapsed from and the costs of its nodes when they were built
+		// they are only kept when the config is refittable
+		std::vector<linear_bounding_volume_hierarchy_node> mBinaryNodes;
+		std::vector<real> mBinaryCosts;
+
+		bounding_volume_hierarchy_config mConfig;
+	};
+
+}
+
+#include "detail/quantized_bounding_volume_hierarchy.hpp"
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "bounding_volume_hierarchy.hpp"
+
+namespace rainbow::cpus::shared::accelerators {
+
+	/*
+	 * wide_bounding_volume_hierarchy_node stores the boxes of Width children in SoA layout,
+	 * so we can test all children with ray in one SIMD slab test.
+	 * bounds[0, 1, 2] are the min of children in x, y, z and bounds[3, 4, 5] are the max of children.
+	 * if count[i] is not 0, the child i is a leaf, offset[i] is the first element and count[i] is the number of elements.
+	 * if count[i] is 0, offset[i] is the index of child node.
+	 * the empty child has an inverted box(min = +inf, max = -inf), so the ray can never intersect it.
+	 */
+	template <size_t Width>
+	struct alignas(32) wide_bounding_volume_hierarchy_node {
+		real bounds[6][Width];
+
+		uint32 offset[Width];
+		uint16 count[Width];
+
+		wide_bounding_volume_hierarchy_node();
+	};
+
+	template <typename T, size_t Width>
+	class wide_bounding_volume_hierarchy final : public accelerator<T> {
+	public:
+		static_assert(Width == 4 || Width == 8, "the width of wide_bounding_volume_hierarchy should be 4 or 8.");
+
+		explicit wide_bounding_volume_hierarchy(
+			const std::vector<T>& elements,
+			const std::vector<bounding_box<T>>& boxes,
+			const bounding_volume_hierarchy_config& config = bounding_volume_hierarchy_config());
+
+		// adopt the binary hierarchy built outside, the leaf nodes should index into the boxes
+		explicit wide_bounding_volume_hierarchy(
+			const std::vector<T>& elements,
+			const std::vector<bounding_box<T>>& boxes,
+			const std::vector<linear_bounding_volume_hierarchy_node>& nodes,
+			const bounding_volume_hierarchy_config& config = bounding_volume_hierarchy_config());
+
+		bool intersect(const ray& ray, surface_hit& hit) const override;
+
+		bool intersect_with_shadow_ray(const ray& ray, surface_hit& hit) const override;
+
+		bool occluded(const ray& ray, const std::function<bool(const T&)>& ignore) const override;
+
+		uint32 intersect(const ray* rays, size_t count, uint32 active, surface_hit* hits) const override;
+
+		uint32 occluded(const ray* rays, size_t count, uint32 active, const std::function<bool(const T&)>& ignore) const override;
+
+		void refit() override;
+	private:
+		struct ray_info {
+			vector3 origin;
+			vector3 inv_direction;
+
+			size_t near_plane[3];
+			size_t far_plane[3];
+
+			ray_info(const ray& ray);
+		};
+
+		template <typename Function>
+		void traverse(const ray& ray, Function&& function) const;
+
+		// function(element, mask) tests the element with the rays in mask and returns the rays that finish the traversal
+		template <typename Function>
+		void traverse(const ray* rays, size_t count, uint32 active, Function&& function) const;
+
+		uint32 intersect_children(const wide_bounding_volume_hierarchy_node<Width>& node, const ray_info& info,
+			real length, real distance[Width]) const;
+
+		uint32 recursive_collapse(const std::vector<linear_bounding_volume_hierarchy_node>& nodes, uint32 index);
+
+		void reorder_treelets();
+
+		std::vector<wide_bounding_volume_hierarchy_node<Width>> mNodes;
+
+		// the binary hierarchy we collapsed from and the costs of its nodes when they were built
+		// they are only kept when the config is refittable
+		std::vector<linear_bounding_volume_hierarchy_node> mBinaryNodes;
+		std::vector<real> mBinaryCosts;
+
+		bounding_volume_hierarchy_config mConfig;
+	};
+
+	template <typename T>
+	using bounding_volume_hierarchy4 = wide_bounding_volume_hierarchy<T, 4>;
+
+	template <typename T>
+	using bounding_volume_hierarchy8 = wide_bounding_volume_hierarchy<T, 8>;
+
+}
+
+#include "detail/wide_bounding_volume_hierarchy.hpp"
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "../../../rainbow-core/math/math.hpp"
+
+namespace rainbow::cpus::scenes {
+	class entity;
+}
+
+namespace rainbow::cpus::shared::interactions {
+
+	using namespace math;
+	using namespace core;
+
+	/*
+	 * surface_hit is the compact record of hit we find when we travel the scene.
+	 * we only build the surface_interaction for the nearest hit with compute_surface_interaction.
+	 * entity is the entity we hit, it is set by entity::intersect.
+	 * index is the sub-shape we hit, parameters are the parametric coordinates of hit on the sub-shape.
+	 * for triangle, parameters are the barycentric coordinates (b1, b2), for curve, parameters are (u, v).
+	 * distance is the t value of hit in the local space of entity.
+	 */
+	struct surface_hit {
+		const scenes::entity* entity = nullptr;
+
+		size_t index = 0;
+
+		vector2 parameters = vector2(0);
+
+		real distance = 0;
+
+		surface_hit() = default;
+	};
+
+}
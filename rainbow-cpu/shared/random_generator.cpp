@@ -15,6 +15,11 @@ rainbow::cpus::shared::default_random_generator::default_random_generator(const
 {
 }
 
+void rainbow::cpus::shared::default_random_generator::seed(const uint64 seed)
+{
+	mEngine.seed(static_cast<unsigned>(seed));
+}
+
 rainbow::core::real rainbow::cpus::shared::default_random_generator::uniform_real()
 {
 	return mDistribution(mEngine);
@@ -39,6 +44,11 @@ rainbow::cpus::shared::pcg32::pcg32() : mState(PCG32_DEFAULT_STATE), mInc(PCG32_
 }
 
 rainbow::cpus::shared::pcg32::pcg32(const uint64 seed)
+{
+	this->seed(seed);
+}
+
+void rainbow::cpus::shared::pcg32::seed(const uint64 seed)
 {
 	mState = 0u;
 	mInc = (seed << 1u) | 1u;
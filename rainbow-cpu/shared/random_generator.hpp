@@ -18,6 +18,8 @@ namespace rainbow::cpus::shared {
 		
 		explicit default_random_generator(const uint64 seed);
 
+		void seed(const uint64 seed);
+
 		real uniform_real();
 		
 		real real(real min = 0, real max = 1);
@@ -36,6 +38,8 @@ namespace rainbow::cpus::shared {
 		~pcg32() = default;
 
 		explicit pcg32(const uint64 seed);
+
+		void seed(const uint64 seed);
 		
 		real uniform_real();
 
@@ -51,4 +55,24 @@ namespace rainbow::cpus::shared {
 	};
 	
 	using random_generator = pcg32;
+
+	// the finalizer of splitmix64, the nearby values are mapped to unrelated values
+	inline uint64 mix_bits(uint64 value)
+	{
+		value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+
+		return value ^ (value >> 31);
+	}
+
+	// hash the values into a seed of generator, the order of values matters
+	template <typename... Values>
+	uint64 hash_seed(Values... values)
+	{
+		uint64 hash = 0;
+
+		((hash = mix_bits(hash + 0x9e3779b97f4a7c15ULL + static_cast<uint64>(values))), ...);
+
+		return hash;
+	}
 }
@@ -0,0 +1,200 @@
+#include "ray_packet.hpp"
+#include "simd.hpp"
+
+#undef near
+#undef far
+
+rainbow::cpus::shared::ray_packet_info::ray_packet_info(const ray* rays, size_t count, uint32 active) :
+	mRays(rays), mCount(count), mCoherent(active != 0)
+{
+	assert(count <= max_ray_packet_size);
+
+	// the lanes without active ray have negative length, so they can not intersect any box
+	for (size_t index = 0; index < max_ray_packet_size; index++) {
+		for (size_t axis = 0; axis < 3; axis++) {
+			mOrigin[axis][index] = 0;
+			mInvDirection[axis][index] = 0;
+		}
+
+		mLength[index] = -1;
+	}
+
+	mOriginMin = vector3(+std::numeric_limits<real>::infinity());
+	mOriginMax = vector3(-std::numeric_limits<real>::infinity());
+	mInvDirectionMin = vector3(+std::numeric_limits<real>::infinity());
+	mInvDirectionMax = vector3(-std::numeric_limits<real>::infinity());
+
+	for (size_t index = 0; index < count; index++) {
+		if ((active & (1u << index)) == 0) continue;
+
+		const auto inv_direction = static_cast<real>(1) / rays[index].direction;
+
+		for (int axis = 0; axis < 3; axis++) {
+			mOrigin[axis][index] = rays[index].origin[axis];
+			mInvDirection[axis][index] = inv_direction[axis];
+
+			if (inv_direction[axis] < 0) mNegativeDirection[axis] = mNegativeDirection[axis] | (1u << index);
+
+			// the ray parallel with the plane makes the interval infinite, we can not cull the boxes with it
+			if (!std::isfinite(inv_direction[axis])) mCoherent = false;
+		}
+
+		mLength[index] = rays[index].length;
+
+		mOriginMin = math::min(mOriginMin, rays[index].origin);
+		mOriginMax = math::max(mOriginMax, rays[index].origin);
+		mInvDirectionMin = math::min(mInvDirectionMin, inv_direction);
+		mInvDirectionMax = math::max(mInvDirectionMax, inv_direction);
+		mMaxLength = math::max(mMaxLength, rays[index].length);
+	}
+
+	// if the directions have different signs in an axis, the interval of inverse directions contains infinity
+	for (size_t axis = 0; axis < 3; axis++) {
+		const auto negative = mNegativeDirection[axis] & active;
+
+		if (negative != 0 && negative != active) mCoherent = false;
+	}
+}
+
+rainbow::core::uint32 rainbow::cpus::shared::ray_packet_info::intersect(const bound3& box, uint32 mask) const
+{
+	if (mask == 0 || !intersect_interval(box)) return 0;
+
+	uint32 result = 0;
+
+#if defined(RAINBOW_SSE)
+	// the same slab test as intersect_bound, but we test 4 rays at the same time
+	// the near plane of each ray is chosen by the sign of its direction
+	// if near or far is nan(0 * inf), max(near, t0) and min(far, t1) return t0 and t1, so they will not be changed
+	const auto zero = _mm_setzero_ps();
+
+	for (size_t group = 0; group < mCount; group += 4) {
+		if (((mask >> group) & 0xf) == 0) continue;
+
+		auto t0 = zero;
+		auto t1 = _mm_load_ps(mLength + group);
+
+		for (int axis = 0; axis < 3; axis++) {
+			const auto origin = _mm_load_ps(mOrigin[axis] + group);
+			const auto inv_direction = _mm_load_ps(mInvDirection[axis] + group);
+			const auto negative = _mm_cmplt_ps(inv_direction, zero);
+
+			const auto min_plane = _mm_set1_ps(box.min[axis]);
+			const auto max_plane = _mm_set1_ps(box.max[axis]);
+
+			const auto near_plane = _mm_or_ps(_mm_and_ps(negative, max_plane), _mm_andnot_ps(negative, min_plane));
+			const auto far_plane = _mm_or_ps(_mm_and_ps(negative, min_plane), _mm_andnot_ps(negative, max_plane));
+
+			const auto near = _mm_mul_ps(_mm_sub_ps(near_plane, origin), inv_direction);
+			const auto far = _mm_mul_ps(_mm_sub_ps(far_plane, origin), inv_direction);
+
+			t0 = _mm_max_ps(near, t0);
+			t1 = _mm_min_ps(far, t1);
+		}
+
+		result = result | (static_cast<uint32>(_mm_movemask_ps(_mm_cmple_ps(t0, t1))) << group);
+	}
+#else
+	for (size_t index = 0; index < mCount; index++) {
+		if ((mask & (1u << index)) == 0) continue;
+
+		auto t0 = static_cast<real>(0), t1 = mLength[index];
+
+		for (int axis = 0; axis < 3; axis++) {
+			const auto is_negative_direction = mInvDirection[axis][index] < 0;
+
+			const auto near = ((is_negative_direction ? box.max : box.min)[axis] - mOrigin[axis][index]) * mInvDirection[axis][index];
+			const auto far = ((is_negative_direction ? box.min : box.max)[axis] - mOrigin[axis][index]) * mInvDirection[axis][index];
+
+			if (near > t0) t0 = near;
+			if (far < t1) t1 = far;
+		}
+
+		if (t0 <= t1) result = result | (1u << index);
+	}
+#endif
+
+	return result & mask;
+}
+
+void rainbow::cpus::shared::ray_packet_info::update(size_t index, real length)
+{
+	mLength[index] = length;
+}
+
+bool rainbow::cpus::shared::ray_packet_info::is_negative_direction(size_t axis, uint32 mask) const noexcept
+{
+	return (mNegativeDirection[axis] & (mask & (~mask + 1))) != 0;
+}
+
+const rainbow::core::math::vector3& rainbow::cpus::shared::ray_packet_info::direction(uint32 mask) const noexcept
+{
+	size_t index = 0;
+
+	while (index + 1 < mCount && (mask & (1u << index)) == 0) index++;
+
+	return mRays[index].direction;
+}
+
+bool rainbow::cpus::shared::ray_packet_info::intersect_interval(const bound3& box) const noexcept
+{
+	if (!mCoherent) return true;
+
+	auto t0 = static_cast<real>(0), t1 = mMaxLength;
+
+	// the t of plane is (plane - origin) * inv_direction, the origin and inv_direction are intervals
+	// the bound of product of two intervals is the min(max) of the products of their ends
+	for (int axis = 0; axis < 3; axis++) {
+		const auto is_negative_direction = mNegativeDirection[axis] != 0;
+
+		const auto near_plane = (is_negative_direction ? box.max : box.min)[axis];
+		const auto far_plane = (is_negative_direction ? box.min : box.max)[axis];
+
+		const auto near = math::min(
+			math::min((near_plane - mOriginMin[axis]) * mInvDirectionMin[axis], (near_plane - mOriginMin[axis]) * mInvDirectionMax[axis]),
+			math::min((near_plane - mOriginMax[axis]) * mInvDirectionMin[axis], (near_plane - mOriginMax[axis]) * mInvDirectionMax[axis]));
+
+		const auto far = math::max(
+			math::max((far_plane - mOriginMin[axis]) * mInvDirectionMin[axis], (far_plane - mOriginMin[axis]) * mInvDirectionMax[axis]),
+			math::max((far_plane - mOriginMax[axis]) * mInvDirectionMin[axis], (far_plane - mOriginMax[axis]) * mInvDirectionMax[axis]));
+
+		if (near > t0) t0 = near;
+		if (far < t1) t1 = far;
+
+		if (t0 > t1) return false;
+	}
+
+	return true;
+}
+
+rainbow::core::uint32 rainbow::cpus::shared::ray_sort_key(const ray& ray, const bound3& box)
+{
+	constexpr auto morton_bits = 9;
+	constexpr auto morton_scale = static_cast<real>(1 << morton_bits);
+
+	// spread the lower 9 bits of value, so there are 2 zero bits between them
+	const auto expand_bits = [](uint32 value)
+	{
+		value = (value | (value << 16)) & 0x030000ff;
+		value = (value | (value << 8)) & 0x0300f00f;
+		value = (value | (value << 4)) & 0x030c30c3;
+		value = (value | (value << 2)) & 0x09249249;
+
+		return value;
+	};
+
+	uint32 morton = 0;
+	uint32 octant = 0;
+
+	for (int axis = 0; axis < 3; axis++) {
+		const auto length = box.max[axis] - box.min[axis];
+		const auto offset = length > 0 ? (ray.origin[axis] - box.min[axis]) / length : static_cast<real>(0);
+		const auto cell = static_cast<uint32>(math::clamp(offset * morton_scale, static_cast<real>(0), morton_scale - 1));
+
+		morton = morton | (expand_bits(cell) << (2 - axis));
+
+		if (ray.direction[axis] < 0) octant = octant | (1u << axis);
+	}
+
+	return (octant << (3 * morton_bits)) | morton;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "ray.hpp"
+
+#include <array>
+
+namespace rainbow::cpus::shared {
+
+	constexpr size_t max_ray_packet_size = 16;
+
+	/*
+	 * ray_packet is a group of coherent rays(e.g. the camera rays of nearby pixels) we trace together.
+	 * the ray i is traced only if the bit i of active is 1, so a packet can be partially filled.
+	 */
+	template <size_t N>
+	struct ray_packet {
+		static_assert(N == 4 || N == 8 || N == 16, "the size of ray_packet should be 4, 8 or 16.");
+
+		constexpr static inline size_t size = N;
+
+		std::array<ray, N> rays;
+
+		uint32 active = 0;
+
+		ray_packet() = default;
+	};
+
+	/*
+	 * ray_packet_info is the data of packet we use to test a box with the rays of packet together.
+	 * the origins, inverse directions and lengths are stored in SoA layout, so we can test 4 rays in one SIMD slab test.
+	 * if the directions of rays have the same sign in each axis, the packet is coherent and we keep the intervals of
+	 * origins and inverse directions. the slab test with intervals is conservative, if it misses the box,
+	 * no ray of packet can intersect the box and we skip the tests of each ray(interval culling).
+	 */
+	class ray_packet_info {
+	public:
+		ray_packet_info(const ray* rays, size_t count, uint32 active);
+
+		// test the box with the rays in mask, the bit i of result is 1 means the ray i intersects the box
+		uint32 intersect(const bound3& box, uint32 mask) const;
+
+		// the ray found a nearer hit, the boxes farther than length will be culled
+		void update(size_t index, real length);
+
+		// the direction of the first ray in mask is negative in axis, we use it to choose the near child
+		bool is_negative_direction(size_t axis, uint32 mask) const noexcept;
+
+		const vector3& direction(uint32 mask) const noexcept;
+	private:
+		bool intersect_interval(const bound3& box) const noexcept;
+
+		alignas(16) real mOrigin[3][max_ray_packet_size];
+		alignas(16) real mInvDirection[3][max_ray_packet_size];
+		alignas(16) real mLength[max_ray_packet_size];
+
+		const ray* mRays = nullptr;
+
+		size_t mCount = 0;
+
+		uint32 mNegativeDirection[3] = { 0, 0, 0 };
+
+		// the intervals of origins, inverse directions and lengths, they are valid only if the packet is coherent
+		vector3 mOriginMin, mOriginMax;
+		vector3 mInvDirectionMin, mInvDirectionMax;
+
+		real mMaxLength = 0;
+
+		bool mCoherent = false;
+	};
+
+	/*
+	 * ray_sort_key is the key we sort the incoherent rays(e.g. the secondary rays of paths) with before we trace them.
+	 * the low 27 bits are the morton code of origin in box(9 bits per axis), the octant of direction is in
+	 * the 3 bits above it(bits 27 - 29) and the top 2 bits are always 0,
+	 * so the rays with near keys go the same way from near origins and likely visit the same nodes of hierarchy.
+	 */
+	uint32 ray_sort_key(const ray& ray, const bound3& box);
+
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// the x64 msvc compiler does not define __SSE__, but sse is always available there
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define RAINBOW_SSE
+#include <xmmintrin.h>
+#endif
+
+// the integer kernels(e.g. unpacking the quantized bounds) need sse2
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RAINBOW_SSE2
+#include <emmintrin.h>
+#endif